@@ -1,84 +1,477 @@
 #ifndef STORE_H
 #define STORE_H
 
+#include "admission_filter.h"
 #include "command.h"
-#include "customer.h"
+#include "customer_name_index.h"
+#include "customer_table.h"
+#include "error_reporter.h"
+#include "format_buffer.h"
+#include "history_spill.h"
+#include "hold_queue.h"
+#include "inventory_snapshot.h"
+#include "inventory_totals.h"
+#include "loan_tracker.h"
 #include "movie.h"
 #include "movie_factory.h"
+#include "popularity.h"
 #include <fstream>
+#include <future>
+#include <iostream>
 #include <memory>
 #include <set>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 class Movie;
 class Command;
 
-// Custom comparator for sorting movies in the inventory.
+// Custom comparator for sorting movies in the inventory. Transparent, so
+// the inventory can also be searched by raw movie pointer.
 struct MovieComparator {
+  using is_transparent = void;
+
   bool operator()(const std::unique_ptr<Movie> &a,
                   const std::unique_ptr<Movie> &b) const {
-    if (a->getGenre() != b->getGenre()) {
-      if (a->getGenre() == 'F') {
+    return compare(*a, *b);
+  }
+  bool operator()(const std::unique_ptr<Movie> &a, const Movie *b) const {
+    return compare(*a, *b);
+  }
+  bool operator()(const Movie *a, const std::unique_ptr<Movie> &b) const {
+    return compare(*a, *b);
+  }
+
+  // Orders comedies before dramas before classics, then by each genre's
+  // own sorting criteria.
+  static bool compare(const Movie &a, const Movie &b) {
+    if (a.getGenre() != b.getGenre()) {
+      if (a.getGenre() == 'F') {
         return true;
       }
-      if (b->getGenre() == 'F') {
+      if (b.getGenre() == 'F') {
         return false;
       }
-      if (a->getGenre() == 'D') {
+      if (a.getGenre() == 'D') {
         return true;
       }
-      if (b->getGenre() == 'D') {
+      if (b.getGenre() == 'D') {
         return false;
       }
       return false;
     }
-    return *a < *b;
+    return a < b;
   }
 };
 
+// The changes that bring the live catalog in line with a catalog file,
+// computed off the command thread and applied between commands.
+struct CatalogDiff {
+  std::string filename;
+  bool opened = false;
+  // Titles in the file but not in the inventory.
+  std::vector<std::unique_ptr<Movie>> added;
+  // Keys of titles whose stock differs, with their new stock in each
+  // format.
+  std::vector<std::pair<std::string, FormatCounts>> restocked;
+  // Keys of titles in the inventory but not in the file.
+  std::vector<std::string> retired;
+  // Messages produced while reading the file.
+  std::string output;
+  std::string errors;
+  // Malformed lines found in the file.
+  ErrorReporter::Counts errorCounts;
+};
+
+// What a borrow, hold or return did, for callers that take results
+// rather than report lines.
+struct StockOutcome {
+  enum Status {
+    // The copy was borrowed or returned.
+    DONE,
+    // Every copy was out, so the customer was queued for the next return.
+    HELD,
+    // Every copy was out and no hold was asked for.
+    OUT_OF_STOCK,
+    // The media type, customer or movie is invalid; `error` says which.
+    INVALID,
+  };
+  Status status = INVALID;
+  InputError error = InputError::InvalidMediaType;
+  MediaFormat format = DVD;
+  // Null if the request is invalid.
+  const Customer *customer = nullptr;
+  const Movie *movie = nullptr;
+  // Logical time the request ran at.
+  uint64_t time = 0;
+  // A hold's place in the queue.
+  size_t holdPosition = 0;
+  // The waiting customer a returned copy was lent to, if any.
+  const Customer *holdFilled = nullptr;
+};
+
 class Store {
 public:
   // Constructs a new Store object.
   Store();
   ~Store() = default;
 
+  // Sends command output and error messages, those of loading files
+  // included, to the given streams instead of standard output and
+  // standard error.
+  void setOutput(std::ostream &output, std::ostream &errors);
+
+  // Sets how many input errors of each kind get a detail line before the
+  // rest are only sampled and counted.
+  void setErrorDetailLimit(size_t limit);
+  // Records every input error, with its file and line, as a JSON line in
+  // the given file. Returns false if it cannot be opened.
+  bool openErrorSidecar(const std::string &path);
+  // Writes the input error counts since the last summary.
+  void printErrorSummary();
+
   // Loads movies from a given file.
   bool loadMovies(const std::string &filename);
-  // Loads customers from a given file.
+  // Makes loadMovies only index the file, recording each movie's key and
+  // where its line starts. A movie is built from its line the first time
+  // a command looks it up; the rest are built when an inventory report
+  // or a reload needs the whole catalog.
+  void setLazyCatalog(bool lazy);
+  // Builds every movie of a lazily loaded catalog not built yet.
+  void materializeCatalog();
+  // Loads customers from a given file, then sorts them into the name
+  // index.
   bool loadCustomers(const std::string &filename);
+  // Adds a single customer. Name searches sort it into the name index
+  // first.
+  void addCustomer(int id, const std::string &lastName,
+                   const std::string &firstName);
+  // The fields of one line of a customer file.
+  struct CustomerRecord {
+    int id = 0;
+    std::string lastName;
+    std::string firstName;
+  };
+  // Parses one line of a customer file. A malformed line is counted in
+  // this store's error summary and, if admitted, reported on its error
+  // stream; the line is then skipped and false returned.
+  bool parseCustomerLine(const std::string &source, size_t lineNumber,
+                         const std::string &line, CustomerRecord &record);
+  // Sorts the customers added since the last sort into the name index, as
+  // loadCustomers does once it has read its file.
+  void sortCustomerNames();
   // Processes commands from a given file.
   bool processCommands(const std::string &filename);
+  // Processes command lines the way processCommands processes the lines
+  // of a file, batching borrows and returns, and naming `source` in error
+  // reports. Unlike processCommands, it neither waits for a reload nor
+  // prints the error summary, so it can be called for each slice of a
+  // longer stream.
+  void processLines(const std::vector<std::string> &lines,
+                    const std::string &source);
+  // Processes a command line parsed ahead of time, possibly on another
+  // thread, as processLines processes each of its lines. A null command
+  // means the line did not parse; it is parsed again here to report the
+  // error. `source` must stay valid until finishCommands is called.
+  void processParsedLine(const std::string &source, size_t lineNumber,
+                         std::string line, std::unique_ptr<Command> command);
+  // Ends a command stream as processCommands ends a file: runs what is
+  // left of the batch, applies a pending reload and prints the error
+  // summary.
+  void finishCommands();
+  // Executes a command, first applying a catalog reload that has finished
+  // diffing.
+  bool runCommand(Command &command);
+  // Sets how many consecutive borrows and returns processCommands
+  // executes as one batch. A batch looks up each distinct title once and
+  // applies the stock changes movie by movie, with the same results and
+  // output as executing the commands one at a time. 1 disables batching.
+  void setBatchSize(size_t size);
+
+  // Returns the store's logical time: the number of commands run so far.
+  uint64_t getTime() const { return now; }
+  // Returns the number of borrows refused so far because every copy was
+  // out.
+  uint64_t getOutOfStockCount() const { return outOfStock; }
+  // Sets how many ticks of logical time after a borrow the copy is due.
+  void setLoanPeriod(uint64_t ticks);
+  // Keeps at most `entries` recent transactions of each customer in
+  // memory, writing older ones to a spill file created in `directory`, or
+  // in the system's temporary directory if empty. Budgets below
+  // HistorySpill::MIN_BUDGET are raised to it. 0 stops spilling; what was
+  // spilled stays readable. Returns false if the file cannot be created.
+  bool setHistoryBudget(size_t entries, const std::string &directory = "");
+
+  // Starts reloading the catalog from a file in the same format as
+  // loadMovies. The file is diffed against the inventory in the
+  // background; the changes are applied by the first command that runs
+  // after the diff is ready, or by finishReload. Titles keep their
+  // borrowed counts and history.
+  void reloadCatalog(const std::string &filename);
+  // Waits for a pending catalog reload and applies it.
+  void finishReload();
+  // Sets the number of DVDs owned of every movie of the genre (0 means all
+  // genres) released in or after `minYear`, filling the holds the new
+  // copies allow. Returns the number of movies changed.
+  size_t overrideStock(char genre, int minYear, int stock);
 
   // Finds a movie based on its genre and specific search criteria.
   Movie *findMovie(char genre, const std::string &searchCriteria);
-  // Handles the borrowing of a movie by a customer.
+  // Handles the borrowing of a movie by a customer. The media type picks
+  // the format: 'D' for DVD, 'B' for Blu-ray or 'L' for digital.
   bool borrowMovie(int customerId, char mediaType, char movieType,
                    const std::string &movieInfo);
+  // Handles the borrowing of a movie by a customer, placing a hold on it
+  // if it is out of stock. The hold is filled by the next return.
+  bool holdMovie(int customerId, char mediaType, char movieType,
+                 const std::string &movieInfo);
   // Handles the return of a movie by a customer.
   bool returnMovie(int customerId, char mediaType, char movieType,
                    const std::string &movieInfo);
+  // Returns the number of customers waiting for a movie in a format.
+  size_t holdCount(const Movie *movie, MediaFormat format) const;
+  // Runs a borrow or return as a command, first applying a reload that
+  // has finished diffing and advancing the logical time, and returns what
+  // it did instead of reporting it. With `hold`, a borrow of a title out
+  // of stock places a hold as holdMovie does.
+  StockOutcome transact(const StockRequest &request, bool hold = false);
 
-  // Finds a customer by their ID.
+  // Finds a customer by their ID. Customers never move, so the pointer
+  // stays valid for the life of the store.
   Customer *findCustomer(int customerId);
 
   // Displays the current inventory of movies.
   void displayInventory();
+  // Displays the inventory summed over snapshots of stores with the same
+  // catalog, such as the shards of a ShardedStore, in the order of the
+  // first.
+  void displayInventory(const std::vector<InventorySnapshot> &snapshots);
+  // Takes a consistent point-in-time view of the inventory. Unlike the
+  // other members, this may be called from any thread while the command
+  // thread keeps borrowing and returning. A lazily loaded catalog only
+  // shows up once it has been materialized.
+  InventorySnapshot snapshotInventory() const;
   // Displays the transaction history for a specific customer.
   void displayCustomerHistory(int customerId);
+  // Displays the selected page of a customer's transaction history.
+  void displayCustomerHistory(int customerId, const HistoryQuery &query);
+  // Copies the selected page of a customer's transaction history, spilled
+  // entries included, into `page`, and returns how many entries match the
+  // query's filters. Returns false if there is no such customer.
+  bool customerHistory(int customerId, const HistoryQuery &query,
+                       std::vector<Transaction> &page, size_t &total);
+  // Displays the n most borrowed titles, optionally limited to one genre
+  // (genre 0 means all genres).
+  void displayPopularity(size_t n, char genre);
+  // Displays the IDs and names of the first `count` customers, in name
+  // order, whose last name starts with `prefix` (in any case), and how
+  // many match.
+  void displayCustomersNamed(const std::string &prefix, size_t count);
+  // Displays the loans past their due date, in the order they fell due.
+  void displayOverdue();
+  // Displays an estimate of the memory held by the movies, customers,
+  // transactions and loans, in total and per item.
+  void displayMemory();
+  // Displays the copies out, titles fully checked out and utilization of
+  // the catalog and of each genre, of one genre, or of one director's
+  // titles if `director` is not empty. Reads counters kept up to date by
+  // every borrow, return and reload, so it takes the same time however
+  // large the catalog is.
+  void displaySummary(char genre, const std::string &director);
+  // Writes the inventory and every customer's transactions, spilled ones
+  // included, to a columnar file (see columnar.h). Returns false, after
+  // reporting the error, if the file cannot be written.
+  bool exportColumnar(const std::string &filename);
 
 private:
+  std::ostream *out;
+  std::ostream *err;
+  // Scratch buffer every report is formatted into before it is written.
+  FormatBuffer report;
+  ErrorReporter inputErrors;
+  // Per-genre and per-director counters of the titles in the catalog,
+  // including those of a lazy catalog not built yet.
+  InventoryTotals totals;
   std::set<std::unique_ptr<Movie>, MovieComparator> movies;
-  HashTable<int, Customer *> customers;
-  std::vector<std::unique_ptr<Customer>> customerStorage;
+  // Movies in the inventory by key, for constant time lookups.
+  HashTable<std::string, Movie *> movieIndex;
+  // Lines of a lazily loaded catalog whose movies are not built yet, in
+  // file order, and their positions in that list by movie key.
+  struct LazyRecord {
+    std::streamoff offset;
+    size_t lineNumber;
+    // The copies the line gave, over every format, counted in the totals
+    // until it is built.
+    int stock;
+    StockTally tally;
+  };
+  static constexpr std::streamoff BUILT = -1;
+  bool lazyCatalog = false;
+  std::string lazyFilename;
+  std::ifstream lazyFile;
+  std::vector<LazyRecord> lazyRecords;
+  HashTable<std::string, size_t> unbuiltMovies;
+  // Customer IDs and movie keys ever added, so requests naming neither
+  // are rejected without a lookup.
+  AdmissionFilter admission;
+  // Movies dropped by a reload. Kept alive for the histories and reports
+  // that point at them, and restored if a later reload brings them back.
+  std::unordered_map<std::string, std::unique_ptr<Movie>> retiredMovies;
+  InventoryVersions versions;
+  CustomerTable customers;
+  CustomerNameIndex customerNames{customers};
+  PopularityTracker popularity;
+  // Waiting customers of each out of stock movie, created on first hold,
+  // one map per format.
+  std::unordered_map<const Movie *, HoldQueue> holds[MEDIA_FORMATS];
+  static constexpr uint64_t DEFAULT_LOAN_PERIOD = 1000;
+  uint64_t now = 0;
+  uint64_t outOfStock = 0;
+  uint64_t loanPeriod = DEFAULT_LOAN_PERIOD;
+  // Copies borrowed and not returned yet, by due date.
+  LoanTracker loans;
+  // Where older history entries go once a history exceeds the budget;
+  // null until a budget is set.
+  std::unique_ptr<HistorySpill> historySpill;
+
+  // A borrow or return waiting in the current batch, and what executing
+  // it found.
+  struct BatchSlot {
+    std::unique_ptr<Command> command;
+    StockRequest request;
+    std::string line;
+    // The stream named in error reports, which outlives the batch.
+    const std::string *source;
+    size_t lineNumber;
+    // Logical time the command runs at.
+    uint64_t time;
+    // Set while the batch runs.
+    InputError error = InputError::InvalidMovie;
+    bool valid = false;
+    bool succeeded = false;
+    MediaFormat format = DVD;
+    Customer *customer = nullptr;
+    Movie *movie = nullptr;
+    Customer *holdFilled = nullptr;
+  };
+  static constexpr size_t DEFAULT_BATCH_SIZE = 256;
+  size_t batchSize = DEFAULT_BATCH_SIZE;
+  std::vector<BatchSlot> batch;
+  std::ostringstream deferred;
+  // Slot indices, reordered while a batch runs.
+  std::vector<size_t> batchOrder;
+
+  // Looks up a request's format, customer and movie. Returns false, and
+  // the first problem found in `error`, if one is invalid.
+  bool lookupRequest(int customerId, char mediaType, char movieType,
+                     const std::string &movieInfo, MediaFormat &format,
+                     Customer *&customer, Movie *&movie, InputError &error);
+  // Validates a request and looks up its format, customer and movie,
+  // reporting the first problem found.
+  bool resolveRequest(int customerId, char mediaType, char movieType,
+                      const std::string &movieInfo, MediaFormat &format,
+                      Customer *&customer, Movie *&movie);
+  // Reports a request naming an invalid media type, customer or movie.
+  void reportInvalidRequest(InputError error, int customerId, char mediaType,
+                            char movieType, const std::string &movieInfo,
+                            const Customer *customer);
+  // Reports a borrow that failed because the format is out of stock.
+  void reportOutOfStock(const Customer &customer, const Movie &movie,
+                        MediaFormat format);
+  // Lends a returned copy to the next customer waiting for the format.
+  void fulfillHold(Movie *movie, MediaFormat format);
+  // Lends copies to the customers waiting for each format while there are
+  // copies on the shelf, after the movie was restocked.
+  void fillHolds(Movie *movie);
+  // Lends a copy to the next customer waiting for the format, returning
+  // them, without recording the borrow yet.
+  Customer *lendToHold(Movie *movie, MediaFormat format);
+  // Records the borrow of a customer whose hold was filled.
+  void recordHoldFilled(Customer &customer, Movie *movie, MediaFormat format,
+                        uint64_t time);
+  // Records a borrow in the customer's history and opens its loan.
+  void recordBorrow(Customer &customer, Movie *movie, MediaFormat format,
+                    uint64_t time);
+  // Records a return in the customer's history and closes its loan.
+  void recordReturn(Customer &customer, Movie *movie, MediaFormat format,
+                    uint64_t time);
+  // Records the key and offset of every movie line in a catalog file.
+  void indexMovies(std::ifstream &file, const std::string &filename);
+  // Builds the movie of a lazily loaded record, or of its line once read,
+  // and adds it to the inventory. Returns nullptr if the line no longer
+  // describes a new movie.
+  Movie *buildMovie(size_t record);
+  Movie *buildMovie(const std::string &line, size_t lineNumber,
+                    ErrorReporter &reporter);
+  // Applies a pending catalog reload if its diff is ready.
+  void applyReadyReload();
+  // Counts a movie that joined the catalog in the totals.
+  void attachTotals(Movie &movie);
+  // Processes one line of a command stream. Error messages of lines parsed
+  // while a batch is pending are held in `deferred` until it has run.
+  void processLine(const std::string &source, size_t lineNumber,
+                   const std::string &line);
+  // Adds a parsed line to the batch if it is a borrow or a return,
+  // otherwise runs the batch and then the command.
+  void runLine(const std::string &source, size_t lineNumber, std::string line,
+               std::unique_ptr<Command> cmd);
+  // Executes the borrows and returns waiting in the batch.
+  void runBatch();
+  // Runs the batch, then writes the error messages deferred while it
+  // filled.
+  void finishBatch();
+  // Publishes the catalog order that inventory snapshots iterate.
+  void publishCatalog();
+  // Diffs a catalog file against an inventory snapshot. Runs on a
+  // background thread, so it only reads state that is safe to share.
+  CatalogDiff diffCatalog(const std::string &filename,
+                          size_t detailLimit) const;
+  // Applies a catalog diff to the inventory, in time proportional to the
+  // size of the diff.
+  void applyCatalogDiff(CatalogDiff diff);
+
+  // The fields of one line of a movie file, viewing the line.
+  struct MovieRecord {
+    char genre;
+    FormatCounts stock;
+    std::string_view director;
+    std::string_view title;
+    // Everything after the title, with the fields rejoined by commas.
+    std::string_view extra;
+    // Holds the rejoined fields when there are several.
+    std::string joinedExtra;
+  };
+  // Splits one line of a movie file into trimmed fields without copying
+  // them. Returns false, and the problem found in `error`, if it has too
+  // few fields or a non-numeric stock.
+  static bool splitMovieLine(std::string_view line, MovieRecord &record,
+                             InputError &error);
+  // Parses one line of a movie file, counting problems in `reporter` and
+  // writing the detail lines it admits to the given streams. Returns
+  // nullptr if the line does not describe a movie.
+  static Movie *parseMovieLine(const std::string &line,
+                               ErrorReporter &reporter, std::ostream &output,
+                               std::ostream &errors);
+  // Builds the key of the movie a command searches for, or an empty
+  // string if the search criteria are malformed.
+  static std::string searchKey(char genre, const std::string &info);
 
   // Parses the search criteria string for a movie.
   static std::string parseMovieSearchCriteria(char genre,
                                               const std::string &info);
   // Trims leading and trailing whitespace from a string.
   static void trimString(std::string &str);
+  static std::string_view trimString(std::string_view str);
   // Splits a string into a vector of substrings based on a delimiter.
   static std::vector<std::string> split(const std::string &str, char delimiter);
+
+  // Declared last so a reload still diffing finishes before the rest of
+  // the store is destroyed.
+  std::future<CatalogDiff> pendingReload;
 };
 
 #endif // STORE_H
\ No newline at end of file
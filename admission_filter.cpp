@@ -0,0 +1,259 @@
+#include "admission_filter.h"
+#include "movie.h"
+#include <cctype>
+#include <charconv>
+#include <climits>
+
+namespace {
+
+// FNV-1a hash of a movie key, fed piece by piece so the key string never
+// has to be built.
+class KeyHash {
+public:
+  // Adds one character.
+  void add(char ch) {
+    hash = (hash ^ static_cast<unsigned char>(ch)) * PRIME;
+  }
+  // Adds a run of characters.
+  void add(std::string_view text) {
+    for (char ch : text) {
+      add(ch);
+    }
+  }
+  // Adds an integer as std::to_string would print it.
+  void add(int value) {
+    char digits[16];
+    std::to_chars_result result =
+        std::to_chars(digits, digits + sizeof(digits), value);
+    add(std::string_view(digits, result.ptr - digits));
+  }
+  // Returns the hash, mixed so every bit depends on every character.
+  uint64_t finish() const {
+    uint64_t mixed = hash;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    return mixed ^ (mixed >> 31);
+  }
+
+private:
+  static constexpr uint64_t PRIME = 1099511628211ULL;
+  uint64_t hash = 14695981039346656037ULL;
+};
+
+// Returns true for the characters Store::trimString removes.
+bool isSpace(char ch) { return std::isspace(static_cast<unsigned char>(ch)); }
+
+// Removes leading and trailing whitespace.
+std::string_view trim(std::string_view text) {
+  size_t begin = 0;
+  while (begin < text.size() && isSpace(text[begin])) {
+    begin++;
+  }
+  size_t end = text.size();
+  while (end > begin && isSpace(text[end - 1])) {
+    end--;
+  }
+  return text.substr(begin, end - begin);
+}
+
+// Parses an optional sign and decimal digits from the start of the text.
+// Returns the number of characters used, 0 if there are no digits.
+// Sets overflow if the number does not fit in an int.
+size_t parseInt(std::string_view text, int &value, bool &overflow) {
+  size_t i = 0;
+  bool negative = false;
+  if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+    negative = text[i] == '-';
+    i++;
+  }
+  size_t digitsStart = i;
+  long long magnitude = 0;
+  overflow = false;
+  while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+    magnitude = magnitude * 10 + (text[i] - '0');
+    if (magnitude > static_cast<long long>(INT_MAX) + 1) {
+      overflow = true;
+      magnitude = 0;
+    }
+    i++;
+  }
+  if (i == digitsStart) {
+    return 0;
+  }
+  long long signedValue = negative ? -magnitude : magnitude;
+  if (signedValue > INT_MAX) {
+    overflow = true;
+  }
+  value = static_cast<int>(signedValue);
+  return i;
+}
+
+} // namespace
+
+// Constructs an empty AdmissionFilter.
+AdmissionFilter::AdmissionFilter() : movieBits(16, 0) {}
+
+// Sets the bit of a customer ID.
+void AdmissionFilter::addCustomer(int id) {
+  if (id < 0 || id >= MAX_BITMAP_ID) {
+    return;
+  }
+  size_t word = static_cast<size_t>(id) / 64;
+  if (word >= customerBits.size()) {
+    customerBits.resize(word + 1, 0);
+  }
+  customerBits[word] |= uint64_t{1} << (id % 64);
+}
+
+// Tests the bit of a customer ID; IDs outside the bitmap always pass.
+bool AdmissionFilter::mayHaveCustomer(int id) const {
+  if (id < 0 || id >= MAX_BITMAP_ID) {
+    return true;
+  }
+  size_t word = static_cast<size_t>(id) / 64;
+  return word < customerBits.size() &&
+         (customerBits[word] >> (id % 64) & 1) != 0;
+}
+
+// Adds a movie key, doubling and rebuilding the filter when it holds more
+// keys than it was sized for.
+void AdmissionFilter::addMovie(std::string_view key) {
+  KeyHash hash;
+  hash.add(key);
+  movieHashes.push_back(hash.finish());
+
+  if (movieHashes.size() * BITS_PER_MOVIE > movieBits.size() * 64) {
+    movieBits.assign(movieBits.size() * 2, 0);
+    for (uint64_t old : movieHashes) {
+      insertHash(old);
+    }
+  } else {
+    insertHash(movieHashes.back());
+  }
+}
+
+// Tests the filter bits of the key the search criteria name.
+bool AdmissionFilter::mayHaveMovie(char genre,
+                                   std::string_view criteria) const {
+  uint64_t hash = 0;
+  Search search = hashSearch(genre, criteria, hash);
+  if (search != Search::Hashed) {
+    return search == Search::Unsure;
+  }
+
+  uint64_t mask = movieBits.size() * 64 - 1;
+  uint64_t step = (hash >> 33) | 1;
+  for (int i = 0; i < HASH_COUNT; i++) {
+    uint64_t bit = (hash + i * step) & mask;
+    if ((movieBits[bit / 64] >> (bit % 64) & 1) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Sets the filter bits of a key hash.
+void AdmissionFilter::insertHash(uint64_t hash) {
+  uint64_t mask = movieBits.size() * 64 - 1;
+  uint64_t step = (hash >> 33) | 1;
+  for (int i = 0; i < HASH_COUNT; i++) {
+    uint64_t bit = (hash + i * step) & mask;
+    movieBits[bit / 64] |= uint64_t{1} << (bit % 64);
+  }
+}
+
+// Hashes the key Store::searchKey would build from the criteria:
+// "Title, Year" for comedies, "Director, Title" for dramas and
+// "Month Year First Last" for classics. Mirrors its std::getline, std::stoi
+// and stream extraction rules for well-formed criteria and gives up on
+// anything stranger.
+AdmissionFilter::Search AdmissionFilter::hashSearch(char genre,
+                                                    std::string_view criteria,
+                                                    uint64_t &hash) {
+  criteria = trim(criteria);
+  KeyHash key;
+  key.add(genre);
+  key.add(Movie::KEY_SEPARATOR);
+
+  if (genre == 'F' || genre == 'D') {
+    // Splitting on ',' yields a second field only if the first comma is
+    // followed by something.
+    size_t comma = criteria.find(',');
+    if (comma == std::string_view::npos || comma + 1 == criteria.size()) {
+      return Search::Invalid;
+    }
+    std::string_view first = criteria.substr(0, comma);
+    std::string_view second = criteria.substr(comma + 1);
+    second = second.substr(0, second.find(','));
+
+    if (genre == 'D') {
+      key.add(trim(first));
+      key.add(Movie::KEY_SEPARATOR);
+      key.add(trim(second));
+    } else {
+      size_t start = 0;
+      while (start < second.size() && isSpace(second[start])) {
+        start++;
+      }
+      int year = 0;
+      bool overflow = false;
+      size_t used = parseInt(second.substr(start), year, overflow);
+      if (overflow) {
+        return Search::Unsure;
+      }
+      if (used == 0) {
+        return Search::Invalid;
+      }
+      key.add(trim(first));
+      key.add(Movie::KEY_SEPARATOR);
+      key.add(year);
+    }
+    hash = key.finish();
+    return Search::Hashed;
+  }
+
+  if (genre == 'C') {
+    std::string_view tokens[4];
+    size_t count = 0;
+    size_t i = 0;
+    while (count < 4) {
+      while (i < criteria.size() && isSpace(criteria[i])) {
+        i++;
+      }
+      if (i == criteria.size()) {
+        break;
+      }
+      size_t start = i;
+      while (i < criteria.size() && !isSpace(criteria[i])) {
+        i++;
+      }
+      tokens[count++] = criteria.substr(start, i - start);
+    }
+    if (count < 2) {
+      return Search::Unsure;
+    }
+
+    int date[2];
+    for (int field = 0; field < 2; field++) {
+      bool overflow = false;
+      if (parseInt(tokens[field], date[field], overflow) !=
+              tokens[field].size() ||
+          overflow) {
+        return Search::Unsure;
+      }
+    }
+    key.add(date[0]);
+    key.add(Movie::KEY_SEPARATOR);
+    key.add(date[1]);
+    key.add(Movie::KEY_SEPARATOR);
+    key.add(tokens[2]);
+    if (!tokens[3].empty()) {
+      key.add(' ');
+      key.add(tokens[3]);
+    }
+    hash = key.finish();
+    return Search::Hashed;
+  }
+
+  return Search::Invalid;
+}
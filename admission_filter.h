@@ -0,0 +1,53 @@
+#ifndef ADMISSION_FILTER_H
+#define ADMISSION_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Compact membership structures that let borrow and return requests for
+// unknown customers or titles be rejected before the store looks them up.
+// Customer IDs are kept in a bitmap and movie keys in a Bloom filter, so
+// a negative answer is certain while a positive one only means the
+// request deserves a full lookup.
+class AdmissionFilter {
+public:
+  // Customer IDs from 0 up to this bound are tracked exactly; any other
+  // ID is always let through.
+  static constexpr int MAX_BITMAP_ID = 1 << 24;
+
+  AdmissionFilter();
+
+  // Records a customer ID.
+  void addCustomer(int id);
+  // Returns false if no customer with the ID was added.
+  bool mayHaveCustomer(int id) const;
+
+  // Records the key of a movie in the catalog (see Movie::getKey).
+  void addMovie(std::string_view key);
+  // Returns false if no movie added can match the search criteria of a
+  // command, parsed the way Store::findMovie parses them. Never builds
+  // the key string, so it does not allocate.
+  bool mayHaveMovie(char genre, std::string_view criteria) const;
+
+private:
+  static constexpr size_t BITS_PER_MOVIE = 16;
+  static constexpr int HASH_COUNT = 6;
+
+  std::vector<uint64_t> customerBits;
+  std::vector<uint64_t> movieBits;
+  // Hashes of every movie added, to rebuild the filter when it grows.
+  std::vector<uint64_t> movieHashes;
+
+  // Outcome of hashing search criteria without building the key.
+  enum class Search { Invalid, Hashed, Unsure };
+  // Hashes the key the criteria name. Invalid means no key can match,
+  // Unsure that the criteria are unusual enough to need a full lookup.
+  static Search hashSearch(char genre, std::string_view criteria,
+                           uint64_t &hash);
+  // Sets the filter bits of a key hash.
+  void insertHash(uint64_t hash);
+};
+
+#endif // ADMISSION_FILTER_H
@@ -0,0 +1,15 @@
+#include "append_buffer.h"
+
+// Appends one character to the target string.
+AppendBuffer::int_type AppendBuffer::overflow(int_type ch) {
+  if (ch != traits_type::eof()) {
+    target->push_back(traits_type::to_char_type(ch));
+  }
+  return ch;
+}
+
+// Appends a run of characters to the target string.
+std::streamsize AppendBuffer::xsputn(const char *s, std::streamsize count) {
+  target->append(s, static_cast<size_t>(count));
+  return count;
+}
@@ -0,0 +1,23 @@
+#ifndef APPEND_BUFFER_H
+#define APPEND_BUFFER_H
+
+#include <streambuf>
+#include <string>
+
+// Stream buffer that appends everything written to it to a string.
+class AppendBuffer : public std::streambuf {
+public:
+  // Directs subsequent output to the end of the given string.
+  void setTarget(std::string *target) { this->target = target; }
+
+protected:
+  // Appends one character.
+  int_type overflow(int_type ch) override;
+  // Appends a run of characters.
+  std::streamsize xsputn(const char *s, std::streamsize count) override;
+
+private:
+  std::string *target = nullptr;
+};
+
+#endif // APPEND_BUFFER_H
@@ -0,0 +1,47 @@
+#ifndef ARG_PARSE_H
+#define ARG_PARSE_H
+
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+
+// Helpers for the numbers of the command line modes. Unlike std::stoi and
+// friends they never throw, so a mode can print its usage line instead of
+// aborting on a mistyped argument.
+
+// Parses a whole argument as a decimal number from 0 to `max`. Returns
+// false, leaving `value` alone, if it is anything else, signs included.
+inline bool parseNumber(const std::string &text, unsigned long max,
+                        unsigned long &value) {
+  if (text.empty() ||
+      text.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  errno = 0;
+  unsigned long parsed = std::strtoul(text.c_str(), nullptr, 10);
+  if (errno == ERANGE || parsed > max) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+// Parses a whole argument as a finite number greater than 0. Returns
+// false, leaving `value` alone, if it is anything else.
+inline bool parsePositive(const std::string &text, double &value) {
+  if (text.empty()) {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  double parsed = std::strtod(text.c_str(), &end);
+  // Written so that NaN fails too.
+  if (errno == ERANGE || *end != '\0' || !(parsed > 0.0) ||
+      parsed > 1e300) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+#endif // ARG_PARSE_H
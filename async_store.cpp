@@ -0,0 +1,110 @@
+#include "async_store.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include "trace.h"
+
+// Starts the store's thread.
+AsyncStore::AsyncStore(Store &store, std::function<void()> wake)
+    : store(store), wake(std::move(wake)),
+      worker(&AsyncStore::serve, this) {}
+
+// Lets the store's thread finish what is queued, then joins it.
+AsyncStore::~AsyncStore() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueReady.notify_one();
+  worker.join();
+}
+
+// Appends the operation to the queue, waking the store's thread if it
+// was empty.
+void AsyncStore::submit(Job *job) {
+  inFlight.fetch_add(1, std::memory_order_relaxed);
+  bool wasEmpty = false;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    wasEmpty = queueHead == nullptr;
+    if (wasEmpty) {
+      queueHead = job;
+    } else {
+      queueTail->next = job;
+    }
+    queueTail = job;
+  }
+  if (wasEmpty) {
+    queueReady.notify_one();
+  }
+}
+
+// Takes the whole queue at a time and hands back the finished coroutines
+// together, so a burst of operations costs one lock round trip each way
+// rather than one per operation.
+void AsyncStore::serve() {
+  Tracer::nameThread("async store");
+  std::vector<std::coroutine_handle<>> finished;
+  for (;;) {
+    Job *job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueReady.wait(lock,
+                      [this] { return queueHead != nullptr || stopping; });
+      if (queueHead == nullptr) {
+        return;
+      }
+      job = queueHead;
+      queueHead = nullptr;
+      queueTail = nullptr;
+    }
+
+    {
+      TraceSpan span("asyncBatch");
+      while (job != nullptr) {
+        job->run(store);
+        finished.push_back(job->waiter);
+        job = job->next;
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(doneMutex);
+      done.insert(done.end(), finished.begin(), finished.end());
+    }
+    finished.clear();
+    doneReady.notify_all();
+    if (wake) {
+      wake();
+    }
+  }
+}
+
+// Resumes the finished coroutines. One may await again while resumed;
+// its next operation is left for a later call.
+size_t AsyncStore::poll() {
+  std::vector<std::coroutine_handle<>> ready;
+  {
+    std::lock_guard<std::mutex> lock(doneMutex);
+    ready.swap(done);
+  }
+  inFlight.fetch_sub(ready.size(), std::memory_order_release);
+  for (std::coroutine_handle<> handle : ready) {
+    handle.resume();
+  }
+  return ready.size();
+}
+
+// Waits for finished coroutines and resumes them until nothing is in
+// flight.
+void AsyncStore::drain() {
+  while (pending() > 0) {
+    {
+      std::unique_lock<std::mutex> lock(doneMutex);
+      doneReady.wait(lock, [this] { return !done.empty(); });
+    }
+    poll();
+  }
+}
+
+#endif // __cpp_impl_coroutine
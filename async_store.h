@@ -0,0 +1,212 @@
+#ifndef ASYNC_STORE_H
+#define ASYNC_STORE_H
+
+// Coroutines need C++20; a C++17 build leaves the asynchronous API out.
+#if defined(__cpp_impl_coroutine)
+
+#include "Store.h"
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A coroutine that starts at once and frees itself when it finishes, for
+// handling one request of an event loop. Its result is what it does.
+struct StoreTask {
+  struct promise_type {
+    StoreTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Runs a Store on a thread of its own for coroutines running elsewhere,
+// such as on an event loop's thread:
+//
+//   StoreTask serve(AsyncStore &store, int id, std::string title) {
+//     StockOutcome outcome = co_await store.borrow(id, 'D', 'F', title);
+//     ...
+//   }
+//
+// Awaiting an operation queues it for the store's thread and suspends the
+// coroutine, so an inventory report or a columnar export never blocks the
+// caller. The store's thread runs the operations in the order they were
+// awaited. A finished operation's coroutine is resumed by the next call
+// to poll() or drain() on the caller's thread, never on the store's;
+// `wake` is called on the store's thread when there are some, so a loop
+// waiting on a file descriptor can be woken up.
+//
+// Results are returned rather than printed. Their customers and movies
+// live as long as the store, but only their names may be read off the
+// store's thread; stock is read from an inventory snapshot.
+class AsyncStore {
+public:
+  // A page of a customer's history.
+  struct HistoryPage {
+    // False if there is no such customer.
+    bool found = false;
+    // Entries matching the query's filters on all pages.
+    size_t total = 0;
+    std::vector<Transaction> entries;
+  };
+
+  // Starts the store's thread. The store must not be used otherwise until
+  // the AsyncStore is destroyed.
+  explicit AsyncStore(Store &store, std::function<void()> wake = nullptr);
+  // Runs the queued operations and stops the store's thread. Coroutines
+  // still suspended are not resumed, so drain() first.
+  ~AsyncStore();
+  AsyncStore(const AsyncStore &) = delete;
+  AsyncStore &operator=(const AsyncStore &) = delete;
+
+  // Borrows a copy, as the B command does.
+  auto borrow(int customerId, char mediaType, char movieType,
+              std::string movieInfo) {
+    return stock(Transaction::BORROW, false, customerId, mediaType, movieType,
+                 std::move(movieInfo));
+  }
+  // Borrows a copy, or places a hold if every copy is out, as the H
+  // command does.
+  auto hold(int customerId, char mediaType, char movieType,
+            std::string movieInfo) {
+    return stock(Transaction::BORROW, true, customerId, mediaType, movieType,
+                 std::move(movieInfo));
+  }
+  // Returns a copy, as the R command does.
+  auto giveBack(int customerId, char mediaType, char movieType,
+                std::string movieInfo) {
+    return stock(Transaction::RETURN, false, customerId, mediaType,
+                 movieType, std::move(movieInfo));
+  }
+  // Takes a snapshot of the whole inventory, building a lazily loaded
+  // catalog first. The snapshot can be read on any thread.
+  auto inventory() {
+    return operation<InventorySnapshot>([](Store &store) {
+      store.materializeCatalog();
+      return store.snapshotInventory();
+    });
+  }
+  // Copies a page of a customer's history.
+  auto history(int customerId, HistoryQuery query = HistoryQuery()) {
+    return operation<HistoryPage>([customerId, query](Store &store) {
+      HistoryPage page;
+      page.found =
+          store.customerHistory(customerId, query, page.entries, page.total);
+      return page;
+    });
+  }
+  // Writes the columnar export. Returns false if the file cannot be
+  // written.
+  auto exportColumnar(std::string filename) {
+    return operation<bool>([filename = std::move(filename)](Store &store) {
+      return store.exportColumnar(filename);
+    });
+  }
+
+  // Resumes the coroutines whose operations have finished. Returns how
+  // many were resumed.
+  size_t poll();
+  // Resumes coroutines as their operations finish until none is waiting.
+  void drain();
+  // Returns the number of operations awaited and not resumed yet.
+  size_t pending() const { return inFlight.load(std::memory_order_acquire); }
+
+private:
+  // An operation queued for the store's thread by the coroutine awaiting
+  // it, which holds it in its frame until resumed.
+  struct Job {
+    std::coroutine_handle<> waiter;
+    Job *next = nullptr;
+    // Runs the operation on the store's thread.
+    virtual void run(Store &store) = 0;
+
+  protected:
+    ~Job() = default;
+  };
+
+  // The awaitable of an operation computing its result with `Work`.
+  template <typename Result, typename Work> class Operation : Job {
+  public:
+    Operation(AsyncStore &owner, Work work)
+        : owner(owner), work(std::move(work)) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      this->waiter = handle;
+      owner.submit(this);
+    }
+    Result await_resume() { return std::move(*result); }
+
+  private:
+    AsyncStore &owner;
+    Work work;
+    std::optional<Result> result;
+
+    void run(Store &store) override { result.emplace(work(store)); }
+  };
+
+  template <typename Result, typename Work>
+  Operation<Result, Work> operation(Work work) {
+    return Operation<Result, Work>(*this, std::move(work));
+  }
+  // A borrow, hold or return, owning the search text its request points
+  // to.
+  struct StockWork {
+    Transaction::Type type;
+    bool hold;
+    int customerId;
+    char mediaType;
+    char movieType;
+    std::string movieInfo;
+
+    StockOutcome operator()(Store &store) const {
+      StockRequest request{type, customerId, mediaType, movieType,
+                           &movieInfo};
+      return store.transact(request, hold);
+    }
+  };
+  Operation<StockOutcome, StockWork>
+  stock(Transaction::Type type, bool hold, int customerId, char mediaType,
+        char movieType, std::string movieInfo) {
+    return operation<StockOutcome>(StockWork{
+        type, hold, customerId, mediaType, movieType, std::move(movieInfo)});
+  }
+
+  Store &store;
+  std::function<void()> wake;
+  std::atomic<size_t> inFlight{0};
+
+  // Operations waiting for the store's thread, oldest first.
+  std::mutex queueMutex;
+  std::condition_variable queueReady;
+  Job *queueHead = nullptr;
+  Job *queueTail = nullptr;
+  bool stopping = false;
+
+  // Coroutines whose operations have finished, in order.
+  std::mutex doneMutex;
+  std::condition_variable doneReady;
+  std::vector<std::coroutine_handle<>> done;
+
+  // Declared last, so it starts once the rest is constructed.
+  std::thread worker;
+
+  // Queues an operation for the store's thread.
+  void submit(Job *job);
+  // Runs queued operations until stopped. The store's thread.
+  void serve();
+};
+
+#endif // __cpp_impl_coroutine
+
+#endif // ASYNC_STORE_H
@@ -0,0 +1,270 @@
+#include "columnar.h"
+#include "customer.h"
+#include "movie.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+// Appends an integer in little-endian order.
+template <typename T> void appendValue(std::string &out, T value) {
+  auto bits = static_cast<std::make_unsigned_t<T>>(value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out.push_back(static_cast<char>((bits >> (8 * i)) & 0xff));
+  }
+}
+
+// Appends a column of integers in little-endian order.
+template <typename T>
+void appendColumn(std::string &out, const std::vector<T> &column) {
+  size_t start = out.size();
+  out.resize(start + column.size() * sizeof(T));
+  char *next = &out[start];
+  for (T value : column) {
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+      *next++ = static_cast<char>((bits >> (8 * i)) & 0xff);
+    }
+  }
+}
+
+// Decodes a little-endian integer.
+template <typename T> T decodeValue(const char *bytes) {
+  std::make_unsigned_t<T> bits = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    bits |= static_cast<std::make_unsigned_t<T>>(
+                static_cast<unsigned char>(bytes[i]))
+            << (8 * i);
+  }
+  return static_cast<T>(bits);
+}
+
+} // namespace
+
+namespace columnar {
+
+// Empties every column.
+void InventoryColumns::clear() {
+  genres.clear();
+  keys.clear();
+  formats.clear();
+  stock.clear();
+  borrowed.clear();
+}
+
+// Empties every column.
+void TransactionColumns::clear() {
+  customers.clear();
+  types.clear();
+  formats.clear();
+  times.clear();
+  movies.clear();
+}
+
+} // namespace columnar
+
+// Creates the file and writes its header.
+ColumnarWriter::ColumnarWriter(const std::string &filename, size_t chunkRows)
+    : file(filename, std::ios::binary | std::ios::trunc),
+      chunkRows(chunkRows == 0 ? CHUNK_ROWS : chunkRows) {
+  file.write(columnar::MAGIC, columnar::MAGIC_SIZE);
+}
+
+// Adds the inventory rows of a movie, skipping the formats other than
+// DVD it has no copies of, as the inventory report does.
+void ColumnarWriter::addMovie(const Movie &movie) {
+  uint32_t key = keyId(movie);
+  for (int index = 0; index < MEDIA_FORMATS; index++) {
+    auto format = static_cast<MediaFormat>(index);
+    if (format != DVD && movie.getStock(format) == 0 &&
+        movie.getBorrowed(format) == 0) {
+      continue;
+    }
+    startRow(columnar::INVENTORY);
+    inventory.genres.push_back(movie.getGenre());
+    inventory.keys.push_back(key);
+    inventory.formats.push_back(mediaCode(format));
+    inventory.stock.push_back(movie.getStock(format));
+    inventory.borrowed.push_back(movie.getBorrowed(format));
+    inventoryRows++;
+  }
+}
+
+// Adds a transaction row.
+void ColumnarWriter::addTransaction(int customerId, const Transaction &txn) {
+  startRow(columnar::TRANSACTIONS);
+  transactions.customers.push_back(customerId);
+  transactions.types.push_back(txn.getType() == Transaction::BORROW ? 'B'
+                                                                    : 'R');
+  transactions.formats.push_back(mediaCode(txn.getFormat()));
+  transactions.times.push_back(txn.getTime());
+  transactions.movies.push_back(keyId(*txn.getMovie()));
+  transactionRows++;
+}
+
+// Writes what is pending and the end marker.
+bool ColumnarWriter::finish() {
+  writeChunk();
+  bytes.clear();
+  bytes.push_back(columnar::END);
+  appendValue(bytes, inventoryRows);
+  appendValue(bytes, transactionRows);
+  file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  file.close();
+  return !file.fail();
+}
+
+// Looks the movie up by address first; a movie seen for the first time
+// may still share its key with a movie retired by a reload.
+uint32_t ColumnarWriter::keyId(const Movie &movie) {
+  auto known = movieIds.find(&movie);
+  if (known != movieIds.end()) {
+    return known->second;
+  }
+  std::string key = movie.getKey();
+  auto added = keyIds.emplace(key, static_cast<uint32_t>(keyIds.size()));
+  if (added.second) {
+    newKeys.push_back(std::move(key));
+  }
+  movieIds.emplace(&movie, added.first->second);
+  return added.first->second;
+}
+
+// Counts a row of the table, first writing out a chunk it cannot join.
+void ColumnarWriter::startRow(char rowTable) {
+  if (rows > 0 && (rowTable != table || rows == chunkRows)) {
+    writeChunk();
+  }
+  table = rowTable;
+  rows++;
+}
+
+// Encodes the chunk's header, new keys and columns, then writes them in
+// one call.
+void ColumnarWriter::writeChunk() {
+  if (rows == 0) {
+    return;
+  }
+  bytes.clear();
+  bytes.push_back(table);
+  appendValue(bytes, static_cast<uint32_t>(rows));
+  appendValue(bytes, static_cast<uint32_t>(newKeys.size()));
+  for (const std::string &key : newKeys) {
+    appendValue(bytes, static_cast<uint32_t>(key.size()));
+    bytes += key;
+  }
+  if (table == columnar::INVENTORY) {
+    appendColumn(bytes, inventory.genres);
+    appendColumn(bytes, inventory.keys);
+    appendColumn(bytes, inventory.formats);
+    appendColumn(bytes, inventory.stock);
+    appendColumn(bytes, inventory.borrowed);
+  } else {
+    appendColumn(bytes, transactions.customers);
+    appendColumn(bytes, transactions.types);
+    appendColumn(bytes, transactions.formats);
+    appendColumn(bytes, transactions.times);
+    appendColumn(bytes, transactions.movies);
+  }
+  file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+  inventory.clear();
+  transactions.clear();
+  newKeys.clear();
+  rows = 0;
+}
+
+// Opens the file and checks the magic bytes.
+ColumnarReader::ColumnarReader(const std::string &filename)
+    : file(filename, std::ios::binary) {
+  char magic[columnar::MAGIC_SIZE];
+  valid = file.read(magic, sizeof(magic)) &&
+          std::memcmp(magic, columnar::MAGIC, sizeof(magic)) == 0;
+}
+
+// Reads the chunk header and new keys, then the table's columns. Key ids
+// are checked against the dictionary, so key() is safe for every id in a
+// chunk that was read.
+bool ColumnarReader::next(Chunk &chunk) {
+  if (!valid || ended) {
+    return false;
+  }
+  char table = 0;
+  if (!file.get(table)) {
+    valid = false;
+    return false;
+  }
+  if (table == columnar::END) {
+    char counts[16];
+    valid = static_cast<bool>(file.read(counts, sizeof(counts)));
+    inventoryRows = decodeValue<uint64_t>(counts);
+    transactionRows = decodeValue<uint64_t>(counts + 8);
+    ended = true;
+    return false;
+  }
+
+  char header[8];
+  if ((table != columnar::INVENTORY && table != columnar::TRANSACTIONS) ||
+      !file.read(header, sizeof(header))) {
+    valid = false;
+    return false;
+  }
+  chunk.table = table;
+  chunk.rows = decodeValue<uint32_t>(header);
+  uint32_t newKeys = decodeValue<uint32_t>(header + 4);
+  std::vector<char> key;
+  for (uint32_t i = 0; i < newKeys; i++) {
+    char length[4];
+    if (!file.read(length, sizeof(length)) ||
+        !readColumn(key, decodeValue<uint32_t>(length))) {
+      valid = false;
+      return false;
+    }
+    keys.emplace_back(key.begin(), key.end());
+  }
+
+  chunk.inventory.clear();
+  chunk.transactions.clear();
+  const std::vector<uint32_t> *ids;
+  if (table == columnar::INVENTORY) {
+    columnar::InventoryColumns &columns = chunk.inventory;
+    valid = readColumn(columns.genres, chunk.rows) &&
+            readColumn(columns.keys, chunk.rows) &&
+            readColumn(columns.formats, chunk.rows) &&
+            readColumn(columns.stock, chunk.rows) &&
+            readColumn(columns.borrowed, chunk.rows);
+    ids = &columns.keys;
+  } else {
+    columnar::TransactionColumns &columns = chunk.transactions;
+    valid = readColumn(columns.customers, chunk.rows) &&
+            readColumn(columns.types, chunk.rows) &&
+            readColumn(columns.formats, chunk.rows) &&
+            readColumn(columns.times, chunk.rows) &&
+            readColumn(columns.movies, chunk.rows);
+    ids = &columns.movies;
+  }
+  for (size_t i = 0; valid && i < ids->size(); i++) {
+    valid = (*ids)[i] < keys.size();
+  }
+  return valid;
+}
+
+// Reads the column a block at a time, so a corrupt row count fails at the
+// end of the file instead of allocating it all up front.
+template <typename T>
+bool ColumnarReader::readColumn(std::vector<T> &column, size_t count) {
+  const size_t blockValues = 65536;
+  column.clear();
+  while (column.size() < count) {
+    size_t values = std::min(blockValues, count - column.size());
+    bytes.resize(values * sizeof(T));
+    if (!file.read(&bytes[0], static_cast<std::streamsize>(bytes.size()))) {
+      return false;
+    }
+    for (size_t i = 0; i < values; i++) {
+      column.push_back(decodeValue<T>(&bytes[i * sizeof(T)]));
+    }
+  }
+  return true;
+}
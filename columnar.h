@@ -0,0 +1,160 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Movie;
+class Transaction;
+
+// Columnar export of the inventory and the transaction histories, for
+// tools that would otherwise parse `I` and `H` reports. Integers are
+// little-endian.
+//
+//   file   := "MVCOLS02" chunk* end
+//   chunk  := table:u8 rows:u32 strings:u32 string* column*
+//   string := length:u32 bytes
+//   end    := 'E' inventoryRows:u64 transactionRows:u64
+//
+// An inventory chunk ('I') has the columns genre:u8, key:u32, format:u8,
+// stock:i32 and borrowed:i32, with a row for each title's DVDs and one
+// for each other format it has copies of; a transaction chunk ('T') has
+// customer:i32, type:u8 ('B' or 'R'), format:u8, time:u64 and movie:u32.
+// Formats are media type codes: 'D', 'B' or 'L'. Each column is the
+// values of all the chunk's rows back to back. Keys and movies are ids in
+// a dictionary of movie keys: ids count up from 0 in the order keys first
+// appear, and a chunk carries the keys its rows are the first to use, so
+// reading the chunks in order gives every id before it is needed.
+namespace columnar {
+
+constexpr char MAGIC[] = "MVCOLS02";
+constexpr size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+constexpr char INVENTORY = 'I';
+constexpr char TRANSACTIONS = 'T';
+constexpr char END = 'E';
+
+// The columns of an inventory chunk.
+struct InventoryColumns {
+  std::vector<char> genres;
+  std::vector<uint32_t> keys;
+  std::vector<char> formats;
+  std::vector<int32_t> stock;
+  std::vector<int32_t> borrowed;
+
+  void clear();
+};
+
+// The columns of a transaction chunk.
+struct TransactionColumns {
+  std::vector<int32_t> customers;
+  std::vector<char> types;
+  std::vector<char> formats;
+  std::vector<uint64_t> times;
+  std::vector<uint32_t> movies;
+
+  void clear();
+};
+
+} // namespace columnar
+
+// Streams rows to a columnar file, holding one chunk in memory. Rows of
+// one table are written as they come; switching tables ends the chunk.
+class ColumnarWriter {
+public:
+  static constexpr size_t CHUNK_ROWS = 65536;
+
+  // Creates the file. Check isOpen() for failure.
+  explicit ColumnarWriter(const std::string &filename,
+                          size_t chunkRows = CHUNK_ROWS);
+
+  // Returns true if the file was created.
+  bool isOpen() const { return file.is_open(); }
+  // Adds a movie with its current counters to the inventory table, as a
+  // row per format it has copies of and always one for DVDs.
+  void addMovie(const Movie &movie);
+  // Adds a customer's transaction to the transaction table.
+  void addTransaction(int customerId, const Transaction &txn);
+  // Writes the last chunk and the end marker and closes the file. Returns
+  // false if any write failed.
+  bool finish();
+
+  // Returns the rows added to the inventory table.
+  uint64_t getInventoryRows() const { return inventoryRows; }
+  // Returns the rows added to the transaction table.
+  uint64_t getTransactionRows() const { return transactionRows; }
+
+private:
+  std::ofstream file;
+  size_t chunkRows;
+  char table = 0;
+  size_t rows = 0;
+  uint64_t inventoryRows = 0;
+  uint64_t transactionRows = 0;
+  columnar::InventoryColumns inventory;
+  columnar::TransactionColumns transactions;
+  // Dictionary ids of the keys, and of the movies already looked up so a
+  // transaction does not build its movie's key again.
+  std::unordered_map<std::string, uint32_t> keyIds;
+  std::unordered_map<const Movie *, uint32_t> movieIds;
+  // Keys first used by the pending chunk.
+  std::vector<std::string> newKeys;
+  // Encoding buffer for one chunk.
+  std::string bytes;
+
+  // Returns the dictionary id of a movie's key, adding it if new.
+  uint32_t keyId(const Movie &movie);
+  // Ends the pending chunk if it belongs to another table or is full.
+  void startRow(char rowTable);
+  // Writes the pending chunk, if it has rows.
+  void writeChunk();
+};
+
+// Reads a file written by ColumnarWriter one chunk at a time.
+class ColumnarReader {
+public:
+  // One chunk of rows. Only the columns of its table are filled.
+  struct Chunk {
+    char table = 0;
+    size_t rows = 0;
+    columnar::InventoryColumns inventory;
+    columnar::TransactionColumns transactions;
+  };
+
+  // Opens the file and checks its header. Check isOpen() for failure.
+  explicit ColumnarReader(const std::string &filename);
+
+  // Returns true if the file was opened and has a valid header.
+  bool isOpen() const { return valid; }
+  // Reads the next chunk. Returns false at the end marker, or with
+  // failed() set if the file is truncated or malformed.
+  bool next(Chunk &chunk);
+  // Returns true if reading stopped at something other than the end
+  // marker.
+  bool failed() const { return !valid; }
+  // Returns the movie key with a dictionary id read so far.
+  const std::string &key(uint32_t id) const { return keys[id]; }
+  // Returns the number of keys read so far.
+  size_t keyCount() const { return keys.size(); }
+  // Returns the row counts of the end marker, once it was read.
+  uint64_t getInventoryRows() const { return inventoryRows; }
+  uint64_t getTransactionRows() const { return transactionRows; }
+
+private:
+  std::ifstream file;
+  bool valid = false;
+  bool ended = false;
+  std::vector<std::string> keys;
+  uint64_t inventoryRows = 0;
+  uint64_t transactionRows = 0;
+  // Decoding buffer for one column.
+  std::string bytes;
+
+  // Reads `count` values of a column. Returns false if the file ends.
+  template <typename T> bool readColumn(std::vector<T> &column, size_t count);
+};
+
+#endif // COLUMNAR_H
@@ -1,12 +1,23 @@
 #include "command.h"
 #include "Store.h"
+#include "movie_factory.h"
+#include "trace.h"
+#include <cctype>
 #include <iostream>
 #include <sstream>
 
 bool BorrowCommand::registered = BorrowCommand::registerSelf();
+bool HoldCommand::registered = HoldCommand::registerSelf();
 bool ReturnCommand::registered = ReturnCommand::registerSelf();
 bool InventoryCommand::registered = InventoryCommand::registerSelf();
 bool HistoryCommand::registered = HistoryCommand::registerSelf();
+bool TopCommand::registered = TopCommand::registerSelf();
+bool ReloadCommand::registered = ReloadCommand::registerSelf();
+bool OverdueCommand::registered = OverdueCommand::registerSelf();
+bool MemoryCommand::registered = MemoryCommand::registerSelf();
+bool SummaryCommand::registered = SummaryCommand::registerSelf();
+bool ExportCommand::registered = ExportCommand::registerSelf();
+bool NameSearchCommand::registered = NameSearchCommand::registerSelf();
 
 // Constructs a new BorrowCommand.
 BorrowCommand::BorrowCommand(int customerId, char mediaType, char movieType,
@@ -19,6 +30,13 @@ bool BorrowCommand::execute(Store &store) {
   return store.borrowMovie(customerId, mediaType, movieType, movieInfo);
 }
 
+// Describes the BorrowCommand as a borrow request.
+bool BorrowCommand::getStockRequest(StockRequest &request) const {
+  request = {Transaction::BORROW, customerId, mediaType, movieType,
+             &movieInfo};
+  return true;
+}
+
 // Provides a string representation of the BorrowCommand.
 std::string BorrowCommand::toString() const {
   return "Borrow: Customer " + std::to_string(customerId) + " borrows " +
@@ -52,6 +70,50 @@ bool BorrowCommand::registerSelf() {
                                                        BorrowCommand::create);
 }
 
+// Constructs a new HoldCommand.
+HoldCommand::HoldCommand(int customerId, char mediaType, char movieType,
+                         const std::string &movieInfo)
+    : customerId(customerId), mediaType(mediaType), movieType(movieType),
+      movieInfo(movieInfo) {}
+
+// Executes the borrow-or-hold action in the store.
+bool HoldCommand::execute(Store &store) {
+  return store.holdMovie(customerId, mediaType, movieType, movieInfo);
+}
+
+// Provides a string representation of the HoldCommand.
+std::string HoldCommand::toString() const {
+  return "Hold: Customer " + std::to_string(customerId) + " waits for " +
+         movieInfo;
+}
+
+// Factory method to create a HoldCommand from a line of text.
+Command *HoldCommand::create(const std::string &line) {
+  std::istringstream iss(line);
+  char cmd;
+  int customerId;
+  char mediaType;
+  char movieType;
+
+  if (!(iss >> cmd >> customerId >> mediaType >> movieType)) {
+    return nullptr;
+  }
+
+  std::string movieInfo;
+  std::getline(iss, movieInfo);
+  if (!movieInfo.empty() && movieInfo[0] == ' ') {
+    movieInfo = movieInfo.substr(1);
+  }
+
+  return new HoldCommand(customerId, mediaType, movieType, movieInfo);
+}
+
+// Registers the HoldCommand with the CommandFactory.
+bool HoldCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand('W',
+                                                       HoldCommand::create);
+}
+
 // Constructs a new ReturnCommand.
 ReturnCommand::ReturnCommand(int customerId, char mediaType, char movieType,
                              const std::string &movieInfo)
@@ -63,6 +125,13 @@ bool ReturnCommand::execute(Store &store) {
   return store.returnMovie(customerId, mediaType, movieType, movieInfo);
 }
 
+// Describes the ReturnCommand as a return request.
+bool ReturnCommand::getStockRequest(StockRequest &request) const {
+  request = {Transaction::RETURN, customerId, mediaType, movieType,
+             &movieInfo};
+  return true;
+}
+
 // Provides a string representation of the ReturnCommand.
 std::string ReturnCommand::toString() const {
   return "Return: Customer " + std::to_string(customerId) + " returns " +
@@ -119,9 +188,13 @@ bool InventoryCommand::registerSelf() {
 // Constructs a new HistoryCommand.
 HistoryCommand::HistoryCommand(int customerId) : customerId(customerId) {}
 
+// Constructs a new HistoryCommand for one page of the history.
+HistoryCommand::HistoryCommand(int customerId, const HistoryQuery &query)
+    : customerId(customerId), query(query) {}
+
 // Executes the customer history display action in the store.
 bool HistoryCommand::execute(Store &store) {
-  store.displayCustomerHistory(customerId);
+  store.displayCustomerHistory(customerId, query);
   return true;
 }
 
@@ -140,7 +213,44 @@ Command *HistoryCommand::create(const std::string &line) {
     return nullptr;
   }
 
-  return new HistoryCommand(customerId);
+  HistoryQuery query;
+  std::string token;
+  if (iss >> token) {
+    if (std::isdigit(static_cast<unsigned char>(token[0])) != 0 ||
+        token[0] == '-') {
+      // Read as signed numbers, so a negative page is rejected rather than
+      // wrapping around to a huge one.
+      std::istringstream number(token);
+      long long offset = 0;
+      long long limit = 0;
+      if (!(number >> offset) || !number.eof() || offset < 0 ||
+          !(iss >> limit) || limit < 0) {
+        return nullptr;
+      }
+      query.offset = static_cast<size_t>(offset);
+      query.limit = static_cast<size_t>(limit);
+      token.clear();
+      iss >> token;
+    }
+    while (!token.empty()) {
+      if (token == "newest") {
+        query.newestFirst = true;
+      } else if (token == "oldest") {
+        query.newestFirst = false;
+      } else if (token.size() == 6 && token.compare(0, 5, "type=") == 0 &&
+                 (token[5] == 'B' || token[5] == 'R')) {
+        query.type = token[5];
+      } else if (token.size() == 7 && token.compare(0, 6, "genre=") == 0) {
+        query.genre = token[6];
+      } else {
+        return nullptr;
+      }
+      token.clear();
+      iss >> token;
+    }
+  }
+
+  return new HistoryCommand(customerId, query);
 }
 
 // Registers the HistoryCommand with the CommandFactory.
@@ -149,6 +259,258 @@ bool HistoryCommand::registerSelf() {
                                                        HistoryCommand::create);
 }
 
+// Constructs a new TopCommand.
+TopCommand::TopCommand(size_t count, char genre)
+    : count(count), genre(genre) {}
+
+// Executes the top titles display action in the store.
+bool TopCommand::execute(Store &store) {
+  store.displayPopularity(count, genre);
+  return true;
+}
+
+// Provides a string representation of the TopCommand.
+std::string TopCommand::toString() const {
+  std::string result = "Display Top " + std::to_string(count) + " Titles";
+  if (genre != 0) {
+    result += " in Genre " + std::string(1, genre);
+  }
+  return result;
+}
+
+// Factory method to create a TopCommand from a line of text.
+Command *TopCommand::create(const std::string &line) {
+  std::istringstream iss(line);
+  char cmd;
+  iss >> cmd;
+
+  size_t count = 10;
+  char genre = 0;
+  std::string token;
+  if (iss >> token) {
+    if (std::isdigit(static_cast<unsigned char>(token[0])) != 0) {
+      try {
+        count = std::stoul(token);
+      } catch (...) {
+        return nullptr;
+      }
+      if (count == 0) {
+        return nullptr;
+      }
+      token.clear();
+      iss >> token;
+    }
+    if (token.size() > 1) {
+      return nullptr;
+    }
+    if (!token.empty()) {
+      genre = token[0];
+      if (!MovieFactory::getInstance().hasGenre(genre)) {
+        return nullptr;
+      }
+    }
+  }
+
+  return new TopCommand(count, genre);
+}
+
+// Registers the TopCommand with the CommandFactory.
+bool TopCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand('T', TopCommand::create);
+}
+
+// Constructs a new ReloadCommand.
+ReloadCommand::ReloadCommand(const std::string &filename)
+    : filename(filename) {}
+
+// Starts the catalog reload in the store.
+bool ReloadCommand::execute(Store &store) {
+  store.reloadCatalog(filename);
+  return true;
+}
+
+// Provides a string representation of the ReloadCommand.
+std::string ReloadCommand::toString() const {
+  return "Reload Catalog from " + filename;
+}
+
+// Factory method to create a ReloadCommand from a line of text.
+Command *ReloadCommand::create(const std::string &line) {
+  std::istringstream iss(line);
+  char cmd;
+  std::string filename;
+  if (!(iss >> cmd >> filename)) {
+    return nullptr;
+  }
+  return new ReloadCommand(filename);
+}
+
+// Registers the ReloadCommand with the CommandFactory.
+bool ReloadCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand('L',
+                                                       ReloadCommand::create);
+}
+
+// Displays the overdue loans in the store.
+bool OverdueCommand::execute(Store &store) {
+  store.displayOverdue();
+  return true;
+}
+
+// Provides a string representation of the OverdueCommand.
+std::string OverdueCommand::toString() const { return "Display Overdue"; }
+
+// Factory method to create a new OverdueCommand.
+Command *OverdueCommand::create(const std::string & /*unused*/) {
+  return new OverdueCommand();
+}
+
+// Registers the OverdueCommand with the CommandFactory.
+bool OverdueCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand('O',
+                                                       OverdueCommand::create);
+}
+
+// Displays the memory accounting of the store.
+bool MemoryCommand::execute(Store &store) {
+  store.displayMemory();
+  return true;
+}
+
+// Provides a string representation of the MemoryCommand.
+std::string MemoryCommand::toString() const { return "Display Memory"; }
+
+// Factory method to create a new MemoryCommand.
+Command *MemoryCommand::create(const std::string & /*unused*/) {
+  return new MemoryCommand();
+}
+
+// Registers the MemoryCommand with the CommandFactory.
+bool MemoryCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand('M',
+                                                       MemoryCommand::create);
+}
+
+// Constructs a new SummaryCommand.
+SummaryCommand::SummaryCommand(char genre, const std::string &director)
+    : genre(genre), director(director) {}
+
+// Displays the stock totals in the store.
+bool SummaryCommand::execute(Store &store) {
+  store.displaySummary(genre, director);
+  return true;
+}
+
+// Provides a string representation of the SummaryCommand.
+std::string SummaryCommand::toString() const {
+  if (!director.empty()) {
+    return "Display Summary for " + director;
+  }
+  return genre == 0 ? "Display Summary"
+                    : std::string("Display Summary for genre ") + genre;
+}
+
+// Factory method to create a SummaryCommand from a line of text. A single
+// character names a genre; anything longer names a director.
+Command *SummaryCommand::create(const std::string &line) {
+  std::istringstream iss(line);
+  char cmd;
+  iss >> cmd >> std::ws;
+  std::string rest;
+  std::getline(iss, rest);
+  while (!rest.empty() &&
+         std::isspace(static_cast<unsigned char>(rest.back())) != 0) {
+    rest.pop_back();
+  }
+
+  if (rest.size() == 1) {
+    return new SummaryCommand(rest[0], "");
+  }
+  return new SummaryCommand(0, rest);
+}
+
+// Registers the SummaryCommand with the CommandFactory.
+bool SummaryCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand('S',
+                                                       SummaryCommand::create);
+}
+
+// Constructs a new ExportCommand.
+ExportCommand::ExportCommand(const std::string &filename)
+    : filename(filename) {}
+
+// Writes the export file from the store.
+bool ExportCommand::execute(Store &store) {
+  return store.exportColumnar(filename);
+}
+
+// Provides a string representation of the ExportCommand.
+std::string ExportCommand::toString() const {
+  return "Export Columnar to " + filename;
+}
+
+// Factory method to create an ExportCommand from a line of text.
+Command *ExportCommand::create(const std::string &line) {
+  std::istringstream iss(line);
+  char cmd;
+  std::string filename;
+  if (!(iss >> cmd >> filename)) {
+    return nullptr;
+  }
+  return new ExportCommand(filename);
+}
+
+// Registers the ExportCommand with the CommandFactory.
+bool ExportCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand('E',
+                                                       ExportCommand::create);
+}
+
+// Constructs a new NameSearchCommand.
+NameSearchCommand::NameSearchCommand(const std::string &prefix, size_t count)
+    : prefix(prefix), count(count) {}
+
+// Displays the customers matching the prefix.
+bool NameSearchCommand::execute(Store &store) {
+  store.displayCustomersNamed(prefix, count);
+  return true;
+}
+
+// Provides a string representation of the NameSearchCommand.
+std::string NameSearchCommand::toString() const {
+  return "Find Customers Named " + prefix;
+}
+
+// Factory method to create a NameSearchCommand from a line of text.
+Command *NameSearchCommand::create(const std::string &line) {
+  std::istringstream iss(line);
+  char cmd;
+  std::string prefix;
+  if (!(iss >> cmd >> prefix)) {
+    return nullptr;
+  }
+
+  size_t count = 10;
+  std::string token;
+  if (iss >> token) {
+    if (std::isdigit(static_cast<unsigned char>(token[0])) == 0) {
+      return nullptr;
+    }
+    try {
+      count = std::stoul(token);
+    } catch (...) {
+      return nullptr;
+    }
+  }
+  return new NameSearchCommand(prefix, count);
+}
+
+// Registers the NameSearchCommand with the CommandFactory.
+bool NameSearchCommand::registerSelf() {
+  return CommandFactory::getInstance().registerCommand(
+      'N', NameSearchCommand::create);
+}
+
 // Returns the singleton instance of the CommandFactory.
 CommandFactory &CommandFactory::getInstance() {
   static CommandFactory instance;
@@ -163,6 +525,31 @@ bool CommandFactory::registerCommand(char cmdType, CreateFunction func) {
 
 // Creates a command object based on a line of text.
 Command *CommandFactory::createCommand(const std::string &line) {
+  return createCommand(line, std::cout);
+}
+
+// Creates a command object, reporting unknown command types to a stream.
+Command *CommandFactory::createCommand(const std::string &line,
+                                       std::ostream &out) {
+  ErrorReporter errors(ErrorReporter::UNLIMITED);
+  return createCommand(line, out, errors);
+}
+
+// Creates a command object quietly. Only reads the registered creators.
+Command *CommandFactory::parseCommand(const std::string &line) const {
+  TraceSpan span("parse");
+  if (line.empty()) {
+    return nullptr;
+  }
+  auto it = creators.find(line[0]);
+  return it == creators.end() ? nullptr : it->second(line);
+}
+
+// Creates a command object, counting the lines that are not commands.
+Command *CommandFactory::createCommand(const std::string &line,
+                                       std::ostream &out,
+                                       ErrorReporter &errors) {
+  TraceSpan span("parse");
   if (line.empty()) {
     return nullptr;
   }
@@ -172,12 +559,15 @@ Command *CommandFactory::createCommand(const std::string &line) {
 
   if (it != creators.end()) {
     Command *cmd = it->second(line);
-    if (cmd == nullptr) {
+    if (cmd == nullptr && errors.admit(InputError::MalformedCommand)) {
+      out << "Malformed command, discarding line: " << line << std::endl;
     }
     return cmd;
   }
 
-  std::cout << "Unknown command type: " << cmdType
-            << ", discarding line: " << line << std::endl;
+  if (errors.admit(InputError::UnknownCommand)) {
+    out << "Unknown command type: " << cmdType
+        << ", discarding line: " << line << std::endl;
+  }
   return nullptr;
-}
\ No newline at end of file
+}
@@ -1,13 +1,26 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#include "customer.h"
+#include "error_reporter.h"
 #include <functional>
+#include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
 
 class Store;
 
+// A borrow or return, in the form batched execution groups by movie.
+struct StockRequest {
+  Transaction::Type type;
+  int customerId;
+  char mediaType;
+  char movieType;
+  // Owned by the command the request was taken from.
+  const std::string *movieInfo;
+};
+
 // Abstract base class for all command types.
 class Command {
 public:
@@ -16,6 +29,17 @@ public:
   virtual bool execute(Store &store) = 0;
   // Returns a string representation of the command.
   virtual std::string toString() const = 0;
+  // Returns the id of the customer the command acts for, or -1 if the
+  // command concerns the whole store.
+  virtual int getCustomerId() const { return -1; }
+  // Describes the command as a borrow or return request. Returns false if
+  // the command is neither, so it cannot be batched.
+  virtual bool getStockRequest(StockRequest & /*unused*/) const {
+    return false;
+  }
+  // Returns true if the command reads or writes a file named in its
+  // line, so it must not run for a remote client.
+  virtual bool accessesFiles() const { return false; }
 };
 
 // Command to handle borrowing a movie.
@@ -29,6 +53,10 @@ public:
   bool execute(Store &store) override;
   // Returns a string representation of the borrow command.
   std::string toString() const override;
+  // Returns the id of the customer the command acts for.
+  int getCustomerId() const override { return customerId; }
+  // Describes the borrow for batched execution.
+  bool getStockRequest(StockRequest &request) const override;
 
   // Creates a BorrowCommand from a command line string.
   static Command *create(const std::string &line);
@@ -43,6 +71,33 @@ private:
   static bool registered;
 };
 
+// Command to borrow a movie, or wait for it if it is out of stock.
+class HoldCommand : public Command {
+public:
+  // Constructs a HoldCommand.
+  HoldCommand(int customerId, char mediaType, char movieType,
+              const std::string &movieInfo);
+
+  // Executes the hold command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the hold command.
+  std::string toString() const override;
+  // Returns the id of the customer the command acts for.
+  int getCustomerId() const override { return customerId; }
+
+  // Creates a HoldCommand from a command line string.
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
+  int customerId;
+  char mediaType;
+  char movieType;
+  std::string movieInfo;
+  static bool registered;
+};
+
 // Command to handle returning a movie.
 class ReturnCommand : public Command {
 public:
@@ -54,6 +109,10 @@ public:
   bool execute(Store &store) override;
   // Returns a string representation of the return command.
   std::string toString() const override;
+  // Returns the id of the customer the command acts for.
+  int getCustomerId() const override { return customerId; }
+  // Describes the return for batched execution.
+  bool getStockRequest(StockRequest &request) const override;
 
   // Creates a ReturnCommand from a command line string.
   static Command *create(const std::string &line);
@@ -92,19 +151,111 @@ class HistoryCommand : public Command {
 public:
   // Constructs a HistoryCommand.
   explicit HistoryCommand(int customerId);
+  // Constructs a HistoryCommand that displays one page of the history.
+  HistoryCommand(int customerId, const HistoryQuery &query);
 
   // Executes the history display command.
   bool execute(Store &store) override;
   // Returns a string representation of the history command.
   std::string toString() const override;
+  // Returns the id of the customer the command acts for.
+  int getCustomerId() const override { return customerId; }
 
-  // Creates a HistoryCommand from a command line string.
+  // Creates a HistoryCommand from a command line string of the form
+  // "H id [offset limit] [newest] [type=B|R] [genre=F|D|C]".
   static Command *create(const std::string &line);
   // Registers this command type with the factory.
   static bool registerSelf();
 
 private:
   int customerId;
+  HistoryQuery query;
+  static bool registered;
+};
+
+// Command to display the most borrowed titles.
+class TopCommand : public Command {
+public:
+  // Constructs a TopCommand for the n most borrowed titles of a genre
+  // (genre 0 means all genres).
+  TopCommand(size_t count, char genre);
+
+  // Executes the top titles display command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the top titles command.
+  std::string toString() const override;
+
+  // Creates a TopCommand from a command line string of the form
+  // "T [count] [genre]".
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
+  size_t count;
+  char genre;
+  static bool registered;
+};
+
+// Command to reload the movie catalog from a file without restarting.
+class ReloadCommand : public Command {
+public:
+  // Constructs a ReloadCommand for the given catalog file.
+  explicit ReloadCommand(const std::string &filename);
+
+  // Executes the catalog reload command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the reload command.
+  std::string toString() const override;
+  // Reads the catalog file.
+  bool accessesFiles() const override { return true; }
+
+  // Creates a ReloadCommand from a command line string of the form
+  // "L filename".
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
+  std::string filename;
+  static bool registered;
+};
+
+// Command to list the loans that are past their due date.
+class OverdueCommand : public Command {
+public:
+  OverdueCommand() = default;
+
+  // Executes the overdue report command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the overdue command.
+  std::string toString() const override;
+
+  // Creates an OverdueCommand from a command line string.
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
+  static bool registered;
+};
+
+// Command to display the store's memory accounting.
+class MemoryCommand : public Command {
+public:
+  MemoryCommand() = default;
+
+  // Executes the memory report command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the memory command.
+  std::string toString() const override;
+
+  // Creates a MemoryCommand from a command line string.
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
   static bool registered;
 };
 
@@ -120,10 +271,92 @@ public:
   bool registerCommand(char cmdType, CreateFunction func);
   // Creates a command object from a command line string.
   Command *createCommand(const std::string &line);
+  // Creates a command object, reporting unknown command types to `out`.
+  Command *createCommand(const std::string &line, std::ostream &out);
+  // Creates a command object, counting unknown and malformed commands in
+  // `errors` and writing the detail lines it admits to `out`.
+  Command *createCommand(const std::string &line, std::ostream &out,
+                         ErrorReporter &errors);
+  // Creates a command object without reporting anything, so threads
+  // other than the store's can parse ahead of it once every command type
+  // is registered. Returns nullptr for unknown and malformed commands.
+  Command *parseCommand(const std::string &line) const;
 
 private:
   std::map<char, CreateFunction> creators;
   CommandFactory() = default;
 };
 
+// Command to display stock totals of the catalog, a genre or a director.
+class SummaryCommand : public Command {
+public:
+  // Constructs a SummaryCommand for one genre (0 means every genre) or,
+  // if `director` is not empty, for that director's titles.
+  SummaryCommand(char genre, const std::string &director);
+
+  // Executes the summary command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the summary command.
+  std::string toString() const override;
+
+  // Creates a SummaryCommand from a command line string of the form
+  // "S [genre | director]".
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
+  char genre;
+  std::string director;
+  static bool registered;
+};
+
+// Command to export the inventory and transactions to a columnar file.
+class ExportCommand : public Command {
+public:
+  // Constructs an ExportCommand writing the given file.
+  explicit ExportCommand(const std::string &filename);
+
+  // Executes the export command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the export command.
+  std::string toString() const override;
+  // Writes the export file.
+  bool accessesFiles() const override { return true; }
+
+  // Creates an ExportCommand from a command line string of the form
+  // "E filename".
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
+  std::string filename;
+  static bool registered;
+};
+
+// Command to find customers by the start of their last name.
+class NameSearchCommand : public Command {
+public:
+  // Constructs a NameSearchCommand listing up to `count` customers whose
+  // last name starts with `prefix`.
+  NameSearchCommand(const std::string &prefix, size_t count);
+
+  // Executes the name search command.
+  bool execute(Store &store) override;
+  // Returns a string representation of the name search command.
+  std::string toString() const override;
+
+  // Creates a NameSearchCommand from a command line string of the form
+  // "N prefix [count]".
+  static Command *create(const std::string &line);
+  // Registers this command type with the factory.
+  static bool registerSelf();
+
+private:
+  std::string prefix;
+  size_t count;
+  static bool registered;
+};
+
 #endif // COMMAND_H
\ No newline at end of file
@@ -1,49 +1,407 @@
 #include "customer.h"
+#include "memory_usage.h"
 #include "movie.h"
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 
 // Constructs a Transaction object.
-Transaction::Transaction(Type type, Movie *movie) : type(type), movie(movie) {}
+Transaction::Transaction(Type type, Movie *movie, MediaFormat format,
+                         uint64_t time)
+    : type(type), format(format), movie(movie), time(time) {}
 
 // Returns a string representation of the transaction.
 std::string Transaction::toString() const {
-  std::string action = (type == BORROW) ? "Borrowed" : "Returned";
+  FormatBuffer buffer;
+  formatTo(buffer);
+  return buffer.str();
+}
+
+// Appends a string representation of the transaction to a buffer.
+void Transaction::formatTo(FormatBuffer &buffer) const {
+  buffer << ((type == BORROW) ? "Borrowed" : "Returned");
   if (movie != nullptr) {
-    return action + " " + movie->getTitle();
+    buffer << " " << movie->getTitle();
+    appendMediaFormat(buffer, format);
+  } else {
+    buffer << " [Unknown Movie]";
   }
-  return action + " [Unknown Movie]";
 }
 
-// Constructs a Customer object.
-Customer::Customer(int id, const std::string &lastName,
-                   const std::string &firstName)
-    : id(id), lastName(lastName), firstName(firstName) {}
+// Constructs a Customer object, storing the names inline if they fit
+// before the tag byte.
+Customer::Customer(CustomerHandle handle, int id, std::string_view lastName,
+                   std::string_view firstName, char *longNames)
+    : id(id), handle(handle), names() {
+  char *target = names;
+  if (namesSize(lastName, firstName) >= INLINE_NAMES) {
+    target = longNames;
+    std::memcpy(names, &longNames, sizeof(longNames));
+    names[INLINE_NAMES - 1] = LONG_NAMES;
+  }
+  std::memcpy(target, firstName.data(), firstName.size());
+  target[firstName.size()] = '\0';
+  std::memcpy(target + firstName.size() + 1, lastName.data(),
+              lastName.size());
+  target[firstName.size() + 1 + lastName.size()] = '\0';
+}
 
-// Adds a transaction to the customer's history.
-void Customer::addTransaction(Transaction::Type type, Movie *movie) {
-  if (movie != nullptr) {
-    history.emplace_back(type, movie);
+// Returns the inline names, or the copy they point to when too long.
+const char *Customer::getNames() const {
+  if (names[INLINE_NAMES - 1] != LONG_NAMES) {
+    return names;
+  }
+  const char *longNames = nullptr;
+  std::memcpy(&longNames, names, sizeof(longNames));
+  return longNames;
+}
+
+// Adds a transaction to the customer's history, spilling the oldest
+// entries once the entries in memory reach the spill budget. Spilling
+// before the budget is exceeded keeps a vector sized to a power of two
+// budget from growing past it.
+void Customer::addTransaction(Transaction::Type type, Movie *movie,
+                              MediaFormat format, uint64_t time,
+                              HistorySpill *spill) {
+  if (movie == nullptr) {
+    return;
+  }
+
+  if (!history) {
+    history = std::make_unique<History>();
+  }
+  auto position = static_cast<uint32_t>(getHistorySize());
+  history->entries.emplace_back(type, movie, format, time);
+
+  char genre = movie->getGenre();
+  HistoryBucket *target = nullptr;
+  for (auto &bucket : history->buckets) {
+    if (bucket.type == type && bucket.genre == genre) {
+      target = &bucket;
+      break;
+    }
+  }
+  if (target == nullptr) {
+    target = &history->buckets.emplace_back(HistoryBucket{type, genre, 0, {}});
+  }
+  target->total++;
+  target->positions.push_back(position);
+
+  if (spill != nullptr && spill->getBudget() > 0 &&
+      history->entries.size() >= spill->getBudget()) {
+    spillOldest(*spill);
+  }
+}
+
+// Writes all but the newest half budget of entries as one segment. If the
+// write fails, the entries stay in memory.
+void Customer::spillOldest(HistorySpill &spill) {
+  auto &entries = history->entries;
+  size_t count = entries.size() - spill.getBudget() / 2;
+  HistorySpill::Segment segment;
+  if (!spill.write(entries.data(), count, segment)) {
+    return;
   }
+
+  history->segments.push_back(segment);
+  history->spilled += count;
+  entries.erase(entries.begin(), entries.begin() + count);
+  for (auto &bucket : history->buckets) {
+    auto &positions = bucket.positions;
+    positions.erase(positions.begin(),
+                    std::lower_bound(positions.begin(), positions.end(),
+                                     history->spilled));
+  }
+}
+
+// Returns the bytes of the history record, its entries, its buckets and
+// its segment list.
+size_t Customer::historyMemoryUsage() const {
+  if (!history) {
+    return 0;
+  }
+  size_t bytes = sizeof(History) + heapBytes(history->entries) +
+                 heapBytes(history->buckets) + heapBytes(history->segments);
+  for (const auto &bucket : history->buckets) {
+    bytes += heapBytes(bucket.positions);
+  }
+  return bytes;
 }
 
 // Displays the customer's transaction history.
 void Customer::displayHistory() const {
-  std::cout << "History for " << id << " " << getFullName() << ":" << std::endl;
+  displayHistory(std::cout, HistoryQuery());
+}
+
+// Writes the page of the customer's history selected by the query.
+void Customer::displayHistory(std::ostream &out, const HistoryQuery &query,
+                              const HistorySpill *spill) const {
+  FormatBuffer buffer;
+  displayHistory(buffer, query, spill);
+  buffer.flushTo(out);
+}
 
-  if (history.empty()) {
-    std::cout << "No history for " << getFullName() << std::endl;
+// Appends the page of the customer's history selected by the query.
+void Customer::displayHistory(FormatBuffer &out, const HistoryQuery &query,
+                              const HistorySpill *spill) const {
+  std::vector<Transaction> page;
+  size_t total = historyPage(query, spill, page);
+  size_t count = pageCount(query, total);
+
+  out << "History for " << id << " ";
+  formatTo(out);
+  if (!query.isDefault() && count > 0) {
+    out << " (" << query.offset + 1 << "-" << query.offset + count
+        << " of " << total << ")";
+  }
+  out << ":\n";
+
+  if (total == 0) {
+    out << "No history for ";
+    formatTo(out);
+    out << '\n';
     return;
   }
+  for (const Transaction &txn : page) {
+    printEntry(out, txn);
+  }
+  out << '\n';
+}
+
+// Copies the page of the customer's history selected by the query. Only
+// the entries on the page are visited, so the cost depends on the page
+// size rather than on the length of the history; a filtered page of
+// spilled entries is the exception, since the spilled segments are
+// scanned for matches from the end the query starts at.
+size_t Customer::historyPage(const HistoryQuery &query,
+                             const HistorySpill *spill,
+                             std::vector<Transaction> &page) const {
+  page.clear();
+  bool filtered = query.type != 0 || query.genre != 0;
+  std::vector<const HistoryBucket *> matching;
+  size_t total = getHistorySize();
+  // Matching entries still in memory, which follow the spilled ones.
+  size_t recent = history ? history->entries.size() : 0;
+  if (filtered && total > 0) {
+    total = 0;
+    recent = 0;
+    for (const auto &bucket : history->buckets) {
+      char type = (bucket.type == Transaction::BORROW) ? 'B' : 'R';
+      if ((query.type == 0 || query.type == type) &&
+          (query.genre == 0 || query.genre == bucket.genre)) {
+        matching.push_back(&bucket);
+        total += bucket.total;
+        recent += bucket.positions.size();
+      }
+    }
+  }
+
+  size_t count = pageCount(query, total);
+  if (count == 0) {
+    return total;
+  }
+  page.reserve(count);
 
-  for (const auto &txn : history) {
-    std::string action =
-        (txn.getType() == Transaction::BORROW) ? "Borrow" : "Return";
-    const Movie *movie = txn.getMovie();
-    if (movie != nullptr) {
-      std::cout << action << " " << getFullName() << " " << movie->getTitle()
-                << std::endl;
+  // Rank of the first entry to copy, counted from the oldest entry.
+  size_t first = query.newestFirst ? total - 1 - query.offset : query.offset;
+  if (!filtered) {
+    SegmentCache cache;
+    for (size_t i = 0; i < count; i++) {
+      const Transaction *txn =
+          entryAt(query.newestFirst ? first - i : first + i, spill, cache);
+      if (txn != nullptr) {
+        page.push_back(*txn);
+      }
     }
+    return total;
   }
-  std::cout << std::endl;
-}
\ No newline at end of file
+
+  // Matching entries of rank below `spilled` are in the spill file.
+  size_t spilled = total - recent;
+  if (query.newestFirst) {
+    size_t fromMemory = 0;
+    if (first >= spilled) {
+      fromMemory = std::min(count, first - spilled + 1);
+      copyRecent(page, matching, true, first - spilled, fromMemory);
+    }
+    if (fromMemory < count) {
+      size_t next = first - fromMemory;
+      copySpilled(page, query, spill, spilled - 1 - next, count - fromMemory);
+    }
+  } else {
+    size_t fromSpill = 0;
+    if (first < spilled) {
+      fromSpill = std::min(count, spilled - first);
+      copySpilled(page, query, spill, first, fromSpill);
+    }
+    if (fromSpill < count) {
+      copyRecent(page, matching, false, first + fromSpill - spilled,
+                 count - fromSpill);
+    }
+  }
+  return total;
+}
+
+// Returns the number of entries on the page the query selects out of
+// `total` matching ones.
+size_t Customer::pageCount(const HistoryQuery &query, size_t total) {
+  if (query.offset >= total) {
+    return 0;
+  }
+  size_t count = total - query.offset;
+  return query.limit != 0 && query.limit < count ? query.limit : count;
+}
+
+// Returns the entry at a position, from memory or from the cached segment,
+// reading the segment that holds it into the cache when needed.
+const Transaction *Customer::entryAt(size_t position,
+                                     const HistorySpill *spill,
+                                     SegmentCache &cache) const {
+  if (position >= history->spilled) {
+    return &history->entries[position - history->spilled];
+  }
+  if (position >= cache.first &&
+      position - cache.first < cache.entries.size()) {
+    return &cache.entries[position - cache.first];
+  }
+  if (spill == nullptr) {
+    return nullptr;
+  }
+
+  size_t start = 0;
+  for (const auto &segment : history->segments) {
+    if (position < start + segment.count) {
+      cache.first = start;
+      if (!spill->read(segment, cache.entries)) {
+        return nullptr;
+      }
+      return &cache.entries[position - start];
+    }
+    start += segment.count;
+  }
+  return nullptr;
+}
+
+// Returns true if the entry has the type and genre the query selects.
+bool Customer::matches(const HistoryQuery &query, const Transaction &txn) {
+  char type = (txn.getType() == Transaction::BORROW) ? 'B' : 'R';
+  return (query.type == 0 || query.type == type) &&
+         (query.genre == 0 || query.genre == txn.getMovie()->getGenre());
+}
+
+// Copies matching entries in memory, merging the matching buckets from
+// the entry of the given rank.
+void Customer::copyRecent(std::vector<Transaction> &page,
+                          const std::vector<const HistoryBucket *> &matching,
+                          bool newestFirst, size_t rank, size_t count) const {
+  size_t start = positionOfRank(matching, rank);
+  std::vector<const uint32_t *> cursors;
+  for (const auto *bucket : matching) {
+    const auto &positions = bucket->positions;
+    auto it = newestFirst
+                  ? std::upper_bound(positions.begin(), positions.end(), start)
+                  : std::lower_bound(positions.begin(), positions.end(), start);
+    cursors.push_back(positions.data() + (it - positions.begin()));
+  }
+
+  const auto &entries = history->entries;
+  size_t spilled = history->spilled;
+  for (size_t i = 0; i < count; i++) {
+    size_t best = matching.size();
+    for (size_t b = 0; b < matching.size(); b++) {
+      const auto &positions = matching[b]->positions;
+      if (newestFirst) {
+        if (cursors[b] == positions.data()) {
+          continue;
+        }
+        if (best == matching.size() ||
+            *(cursors[b] - 1) > *(cursors[best] - 1)) {
+          best = b;
+        }
+      } else {
+        if (cursors[b] == positions.data() + positions.size()) {
+          continue;
+        }
+        if (best == matching.size() || *cursors[b] < *cursors[best]) {
+          best = b;
+        }
+      }
+    }
+    if (newestFirst) {
+      page.push_back(entries[*--cursors[best] - spilled]);
+    } else {
+      page.push_back(entries[*cursors[best]++ - spilled]);
+    }
+  }
+}
+
+// Copies matching spilled entries, reading the segments one at a time in
+// the query's order.
+void Customer::copySpilled(std::vector<Transaction> &page,
+                           const HistoryQuery &query, const HistorySpill *spill,
+                           size_t skip, size_t count) const {
+  if (spill == nullptr) {
+    return;
+  }
+  const auto &segments = history->segments;
+  std::vector<Transaction> entries;
+  for (size_t s = 0; s < segments.size() && count > 0; s++) {
+    const auto &segment =
+        segments[query.newestFirst ? segments.size() - 1 - s : s];
+    if (!spill->read(segment, entries)) {
+      return;
+    }
+    for (size_t i = 0; i < entries.size() && count > 0; i++) {
+      const Transaction &txn =
+          entries[query.newestFirst ? entries.size() - 1 - i : i];
+      if (!matches(query, txn)) {
+        continue;
+      }
+      if (skip > 0) {
+        skip--;
+        continue;
+      }
+      page.push_back(txn);
+      count--;
+    }
+  }
+}
+
+// Appends a single history entry.
+void Customer::printEntry(FormatBuffer &out, const Transaction &txn) const {
+  const Movie *movie = txn.getMovie();
+  if (movie != nullptr) {
+    out << ((txn.getType() == Transaction::BORROW) ? "Borrow " : "Return ");
+    formatTo(out);
+    out << " " << movie->getTitle();
+    appendMediaFormat(out, txn.getFormat());
+    out << '\n';
+  }
+}
+
+// Returns the history position of the entry with the given rank (counted
+// from zero, oldest first) in the merged order of the matching buckets'
+// entries in memory. Binary searches the position, so it never walks the
+// skipped entries.
+size_t
+Customer::positionOfRank(const std::vector<const HistoryBucket *> &matching,
+                         size_t rank) const {
+  size_t low = history->spilled;
+  size_t high = history->spilled + history->entries.size() - 1;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    size_t upTo = 0;
+    for (const auto *bucket : matching) {
+      const auto &positions = bucket->positions;
+      upTo += std::upper_bound(positions.begin(), positions.end(), mid) -
+              positions.begin();
+    }
+    if (upTo > rank) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
@@ -1,59 +1,231 @@
 #ifndef CUSTOMER_H
 #define CUSTOMER_H
 
+#include "format_buffer.h"
+#include "history_spill.h"
+#include "media_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Movie;
 
+// Selects which part of a customer's history to display.
+struct HistoryQuery {
+  // Number of matching entries to skip.
+  size_t offset = 0;
+  // Maximum number of entries to display; 0 means no limit.
+  size_t limit = 0;
+  // Lists the most recent transactions first.
+  bool newestFirst = false;
+  // Transaction type filter: 'B' or 'R', 0 matches both.
+  char type = 0;
+  // Movie genre filter, 0 matches every genre.
+  char genre = 0;
+
+  // Returns true if the query selects the whole history in order.
+  bool isDefault() const {
+    return offset == 0 && limit == 0 && !newestFirst && type == 0 &&
+           genre == 0;
+  }
+};
+
 // Represents a single customer transaction (borrow or return).
 class Transaction {
 public:
   enum Type { BORROW, RETURN };
 
-  // Constructs a new Transaction.
-  Transaction(Type type, Movie *movie);
+  // Constructs a new Transaction of a copy in the given format, made at
+  // the given logical time.
+  Transaction(Type type, Movie *movie, MediaFormat format, uint64_t time);
   ~Transaction() = default;
 
   // Gets the type of the transaction.
   Type getType() const { return type; }
   // Gets the movie associated with the transaction.
   const Movie *getMovie() const { return movie; }
+  // Gets the format of the copy borrowed or returned.
+  MediaFormat getFormat() const { return format; }
+  // Gets the store's logical time when the transaction was made.
+  uint64_t getTime() const { return time; }
   // Returns a string representation of the transaction.
   std::string toString() const;
+  // Appends the string representation of the transaction to a buffer.
+  void formatTo(FormatBuffer &buffer) const;
 
 private:
   Type type;
+  // Fits in the padding after `type`, so entries take no more space.
+  MediaFormat format;
   Movie *movie;
+  uint64_t time;
 };
 
-// Represents a customer of the store.
+// Position of a customer in the store's CustomerTable. Handles stay valid
+// for the life of the table and take half the space of a pointer.
+using CustomerHandle = uint32_t;
+
+// Represents a customer of the store. The record is compact: the names
+// are stored inline when they are short, and the transaction history is
+// allocated with the first transaction, so a customer who never borrows
+// costs only the record.
 class Customer {
 public:
-  // Constructs a new Customer.
-  Customer(int id, const std::string &lastName, const std::string &firstName);
-  ~Customer() = default;
+  // Bytes of the inline names: the first and last name, each
+  // NUL-terminated, plus a tag byte.
+  static constexpr size_t INLINE_NAMES = 32;
 
-  // Adds a new transaction to the customer's record.
-  void addTransaction(Transaction::Type type, Movie *movie);
+  // Returns the bytes the names take stored together, terminators
+  // included.
+  static size_t namesSize(std::string_view lastName,
+                          std::string_view firstName) {
+    return firstName.size() + lastName.size() + 2;
+  }
+  // Constructs a new Customer. Names too long to store inline are copied
+  // to `longNames`, which must hold namesSize() bytes and outlive the
+  // customer; it may be nullptr when they fit. Names must not contain NUL
+  // characters.
+  Customer(CustomerHandle handle, int id, std::string_view lastName,
+           std::string_view firstName, char *longNames = nullptr);
+
+  // Adds a new transaction of a copy in the given format, made at the
+  // given logical time, to the customer's record. With a spill file, the
+  // oldest entries are written to it once its budget of entries are in
+  // memory.
+  void addTransaction(Transaction::Type type, Movie *movie, MediaFormat format,
+                      uint64_t time, HistorySpill *spill = nullptr);
   // Displays the transaction history for the customer.
   void displayHistory() const;
+  // Writes the page of the transaction history selected by the query,
+  // reading spilled entries back from the spill file they were written to.
+  void displayHistory(std::ostream &out, const HistoryQuery &query,
+                      const HistorySpill *spill = nullptr) const;
+  // Appends the page of the transaction history selected by the query.
+  void displayHistory(FormatBuffer &buffer, const HistoryQuery &query,
+                      const HistorySpill *spill = nullptr) const;
+  // Copies the entries on the page of the transaction history selected
+  // by the query into `page`, in the query's order. Returns how many
+  // entries match the query's filters on all pages.
+  size_t historyPage(const HistoryQuery &query, const HistorySpill *spill,
+                     std::vector<Transaction> &page) const;
 
+  // Gets the customer's handle in its table.
+  CustomerHandle getHandle() const { return handle; }
   // Gets the customer's ID.
   int getId() const { return id; }
   // Gets the customer's last name.
-  const std::string &getLastName() const { return lastName; }
+  std::string_view getLastName() const {
+    const char *first = getNames();
+    return first + std::char_traits<char>::length(first) + 1;
+  }
   // Gets the customer's first name.
-  const std::string &getFirstName() const { return firstName; }
+  std::string_view getFirstName() const { return getNames(); }
+  // Gets the number of transactions in the customer's history.
+  size_t getHistorySize() const {
+    return history ? history->spilled + history->entries.size() : 0;
+  }
+  // Gets the number of transactions written to the spill file.
+  size_t getSpilledCount() const { return history ? history->spilled : 0; }
+  // Returns the bytes the transaction history holds in memory.
+  size_t historyMemoryUsage() const;
+  // Calls `visit` on every transaction, oldest first, reading spilled
+  // segments back one at a time. Returns false if a segment cannot be
+  // read.
+  template <typename Visit>
+  bool forEachTransaction(const HistorySpill *spill, Visit visit) const {
+    if (!history) {
+      return true;
+    }
+    std::vector<Transaction> segmentEntries;
+    for (const auto &segment : history->segments) {
+      if (spill == nullptr || !spill->read(segment, segmentEntries)) {
+        return false;
+      }
+      for (const Transaction &txn : segmentEntries) {
+        visit(txn);
+      }
+    }
+    for (const Transaction &txn : history->entries) {
+      visit(txn);
+    }
+    return true;
+  }
   // Gets the customer's full name.
-  std::string getFullName() const { return firstName + " " + lastName; }
+  std::string getFullName() const {
+    return std::string(getFirstName()) + " " + std::string(getLastName());
+  }
+  // Appends the customer's full name to a buffer.
+  void formatTo(FormatBuffer &buffer) const {
+    buffer << getFirstName() << ' ' << getLastName();
+  }
 
 private:
   int id;
-  std::string lastName;
-  std::string firstName;
-  std::vector<Transaction> history;
+  CustomerHandle handle;
+  // The first and last name, each NUL-terminated. When they do not fit,
+  // the buffer holds a pointer to them instead and its last byte is
+  // LONG_NAMES.
+  static constexpr char LONG_NAMES = 1;
+  char names[INLINE_NAMES];
+
+  // The transactions of one type and genre: how many there are, and the
+  // positions of those still in memory, so a filtered page can be located
+  // without walking the entries before it.
+  struct HistoryBucket {
+    Transaction::Type type;
+    char genre;
+    size_t total;
+    std::vector<uint32_t> positions;
+  };
+  struct History {
+    // The entries still in memory, from position `spilled` on.
+    std::vector<Transaction> entries;
+    std::vector<HistoryBucket> buckets;
+    // Runs of the oldest entries written to the spill file, oldest first.
+    std::vector<HistorySpill::Segment> segments;
+    size_t spilled = 0;
+  };
+  std::unique_ptr<History> history;
+
+  // The spilled segment last read back while displaying a page.
+  struct SegmentCache {
+    size_t first = 0;
+    std::vector<Transaction> entries;
+  };
+
+  // Returns the first name, followed by the last name.
+  const char *getNames() const;
+  // Writes the oldest entries in memory to the spill file, keeping half
+  // its budget.
+  void spillOldest(HistorySpill &spill);
+  // Returns the entry at a position, reading its segment back if it was
+  // spilled. Returns nullptr if the segment cannot be read.
+  const Transaction *entryAt(size_t position, const HistorySpill *spill,
+                             SegmentCache &cache) const;
+  // Returns true if the entry is selected by the query's filters.
+  static bool matches(const HistoryQuery &query, const Transaction &txn);
+  // Copies `count` matching entries from memory, starting at the given
+  // rank among the matching entries in memory, counted from the oldest.
+  void copyRecent(std::vector<Transaction> &page,
+                  const std::vector<const HistoryBucket *> &matching,
+                  bool newestFirst, size_t rank, size_t count) const;
+  // Copies up to `count` matching spilled entries, scanning the segments
+  // in the query's order and skipping the first `skip` matches.
+  void copySpilled(std::vector<Transaction> &page, const HistoryQuery &query,
+                   const HistorySpill *spill, size_t skip,
+                   size_t count) const;
+  // Returns the number of entries on the page the query selects.
+  static size_t pageCount(const HistoryQuery &query, size_t total);
+  // Prints a single history entry.
+  void printEntry(FormatBuffer &buffer, const Transaction &txn) const;
+  // Finds the position of the entry with the given rank among the entries
+  // of the buckets in memory.
+  size_t positionOfRank(const std::vector<const HistoryBucket *> &matching,
+                        size_t rank) const;
 };
 
 #endif // CUSTOMER_H
\ No newline at end of file
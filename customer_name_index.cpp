@@ -0,0 +1,205 @@
+#include "customer_name_index.h"
+#include "memory_usage.h"
+#include <algorithm>
+
+namespace {
+
+// Folds an ASCII letter to lower case.
+unsigned char fold(char c) {
+  auto byte = static_cast<unsigned char>(c);
+  return byte >= 'A' && byte <= 'Z' ? byte + ('a' - 'A') : byte;
+}
+
+// Compares two names by their folded bytes. Returns <0, 0 or >0.
+int compareFolded(std::string_view a, std::string_view b) {
+  size_t common = std::min(a.size(), b.size());
+  for (size_t i = 0; i < common; i++) {
+    unsigned char x = fold(a[i]);
+    unsigned char y = fold(b[i]);
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+// Digits of the radix sort, and the runs shorter than which a comparison
+// sort is faster.
+constexpr int DIGIT_BITS = 8;
+constexpr size_t DIGITS = size_t{1} << DIGIT_BITS;
+constexpr size_t RADIX_MIN = 4096;
+
+// Compares two integers. Returns <0, 0 or >0.
+template <typename T> int compareValues(T a, T b) {
+  return a == b ? 0 : (a < b ? -1 : 1);
+}
+
+} // namespace
+
+// Keys the customer by its last name.
+void CustomerNameIndex::add(const Customer &customer) {
+  entries.push_back(keyOf(customer.getLastName(), customer.getHandle()));
+}
+
+// Sorts the new entries on their own and merges them in, so a load after
+// the first costs a sort of what it added. Stale entries are only looked
+// for when the table reports replaced records since the last time.
+void CustomerNameIndex::sort() {
+  if (hasPending()) {
+    auto middle = entries.begin() + static_cast<std::ptrdiff_t>(sorted);
+    sortEntries(middle, entries.end());
+    std::inplace_merge(
+        entries.begin(), middle, entries.end(),
+        [this](const Entry &a, const Entry &b) { return before(a, b); });
+  }
+  size_t nowReplaced = table.size() - table.idCount();
+  if (nowReplaced != replaced) {
+    auto stale = [this](const Entry &entry) {
+      Customer &customer = table[entry.handle];
+      return table.find(customer.getId()) != &customer;
+    };
+    entries.erase(std::remove_if(entries.begin(), entries.end(), stale),
+                  entries.end());
+    replaced = nowReplaced;
+  }
+  sorted = entries.size();
+}
+
+// Returns the bytes of the entry array.
+size_t CustomerNameIndex::memoryUsage() const { return heapBytes(entries); }
+
+// Folds the first bytes of the name. A name has no NUL, so the padding
+// sorts a shorter name first.
+CustomerNameIndex::Entry CustomerNameIndex::keyOf(std::string_view name,
+                                                 CustomerHandle handle) {
+  Entry key{0, 0, handle};
+  for (size_t i = 0; i < KEY_BYTES; i++) {
+    unsigned char byte = i < name.size() ? fold(name[i]) : 0;
+    if (i < sizeof(key.high)) {
+      key.high = (key.high << 8) | byte;
+    } else {
+      key.low = (key.low << 8) | byte;
+    }
+  }
+  return key;
+}
+
+// Compares keys first and reads the records only when they tie.
+bool CustomerNameIndex::before(const Entry &a, const Entry &b) const {
+  if (a.high != b.high) {
+    return a.high < b.high;
+  }
+  if (a.low != b.low) {
+    return a.low < b.low;
+  }
+  const CustomerTable &records = table;
+  const Customer &x = records[a.handle];
+  const Customer &y = records[b.handle];
+  int order = compareFolded(x.getLastName(), y.getLastName());
+  if (order == 0) {
+    order = compareFolded(x.getFirstName(), y.getFirstName());
+  }
+  return order != 0 ? order < 0 : x.getId() < y.getId();
+}
+
+// Sorts a large run by key with a least significant digit radix sort,
+// skipping the digits every entry shares, then sorts each run of equal
+// keys by the records. Comparison sorting millions of entries costs
+// several times more, most of it in mispredicted branches.
+void CustomerNameIndex::sortEntries(std::vector<Entry>::iterator first,
+                                    std::vector<Entry>::iterator last) const {
+  auto order = [this](const Entry &a, const Entry &b) { return before(a, b); };
+  auto count = static_cast<size_t>(last - first);
+  if (count < RADIX_MIN) {
+    std::sort(first, last, order);
+    return;
+  }
+
+  const int passes = KEY_BYTES * 8 / DIGIT_BITS;
+  const int lowDigits = 32 / DIGIT_BITS;
+  auto digit = [](const Entry &entry, int pass) {
+    uint64_t word = pass < lowDigits ? entry.low : entry.high;
+    int shift = DIGIT_BITS * (pass < lowDigits ? pass : pass - lowDigits);
+    return static_cast<size_t>((word >> shift) & (DIGITS - 1));
+  };
+  std::vector<size_t> offsets(passes * DIGITS);
+  for (auto entry = first; entry != last; ++entry) {
+    for (int pass = 0; pass < passes; pass++) {
+      offsets[pass * DIGITS + digit(*entry, pass)]++;
+    }
+  }
+
+  std::vector<Entry> buffer(count);
+  Entry *from = &*first;
+  Entry *to = buffer.data();
+  for (int pass = 0; pass < passes; pass++) {
+    size_t *passOffsets = &offsets[pass * DIGITS];
+    if (passOffsets[digit(*from, pass)] == count) {
+      continue;
+    }
+    size_t start = 0;
+    for (size_t i = 0; i < DIGITS; i++) {
+      size_t digitCount = passOffsets[i];
+      passOffsets[i] = start;
+      start += digitCount;
+    }
+    for (size_t i = 0; i < count; i++) {
+      to[passOffsets[digit(from[i], pass)]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+  if (from != &*first) {
+    std::copy(from, from + count, first);
+  }
+
+  while (first != last) {
+    auto run = std::find_if(first + 1, last, [&first](const Entry &entry) {
+      return entry.high != first->high || entry.low != first->low;
+    });
+    if (run - first > 1) {
+      std::sort(first, run, order);
+    }
+    first = run;
+  }
+}
+
+// Compares the key bytes the prefix covers, masking off the rest, then
+// the rest of a prefix longer than the key against the record.
+int CustomerNameIndex::comparePrefix(const Entry &entry,
+                                     std::string_view prefix,
+                                     const Entry &prefixKey) const {
+  const size_t highBytes = sizeof(prefixKey.high);
+  const size_t lowBytes = sizeof(prefixKey.low);
+  size_t covered = std::min(prefix.size(), KEY_BYTES);
+  uint64_t highMask = 0;
+  if (covered > 0) {
+    highMask = ~uint64_t{0}
+               << (8 * (highBytes - std::min(covered, highBytes)));
+  }
+  uint32_t lowMask = 0;
+  if (covered > highBytes) {
+    lowMask = ~uint32_t{0} << (8 * (lowBytes - (covered - highBytes)));
+  }
+  int order = compareValues(entry.high & highMask, prefixKey.high);
+  if (order == 0) {
+    order = compareValues(entry.low & lowMask, prefixKey.low);
+  }
+  if (order != 0 || prefix.size() <= KEY_BYTES) {
+    return order;
+  }
+  const CustomerTable &records = table;
+  std::string_view lastName = records[entry.handle].getLastName();
+  return compareFolded(lastName.substr(0, prefix.size()), prefix);
+}
+
+// Binary searches the sorted entries.
+size_t CustomerNameIndex::bound(std::string_view prefix, const Entry &prefixKey,
+                                bool after) const {
+  auto end = entries.begin() + static_cast<std::ptrdiff_t>(sorted);
+  auto position = std::partition_point(
+      entries.begin(), end, [&](const Entry &entry) {
+        int order = comparePrefix(entry, prefix, prefixKey);
+        return after ? order <= 0 : order < 0;
+      });
+  return static_cast<size_t>(position - entries.begin());
+}
@@ -0,0 +1,83 @@
+#ifndef CUSTOMER_NAME_INDEX_H
+#define CUSTOMER_NAME_INDEX_H
+
+#include "customer_table.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// The customers of a table ordered by last name, then first name and id,
+// for finding them by the start of their last name. Names compare without
+// regard to ASCII case. Each entry keeps the first 12 bytes of the last
+// name beside the customer's handle, so sorting and searching rarely read
+// the records.
+class CustomerNameIndex {
+public:
+  explicit CustomerNameIndex(CustomerTable &table) : table(table) {}
+  CustomerNameIndex(const CustomerNameIndex &) = delete;
+  CustomerNameIndex &operator=(const CustomerNameIndex &) = delete;
+
+  // Adds a customer of the table. It can be found once the index is
+  // sorted.
+  void add(const Customer &customer);
+  // Sorts the customers added since the last call into the index, and
+  // drops those the table has since replaced with a record of the same id.
+  void sort();
+  // Returns true if customers were added since the index was last sorted.
+  bool hasPending() const { return sorted < entries.size(); }
+
+  // Calls `visit` on the first `limit` sorted customers, in name order,
+  // whose last name starts with `prefix`, and returns how many there are
+  // in all. Counting takes two binary searches, however many match.
+  template <typename Visit>
+  size_t find(std::string_view prefix, size_t limit, Visit visit) const {
+    Entry prefixKey = keyOf(prefix);
+    size_t first = bound(prefix, prefixKey, false);
+    size_t last = bound(prefix, prefixKey, true);
+    for (size_t i = first; i < last && i - first < limit; i++) {
+      visit(static_cast<const CustomerTable &>(table)[entries[i].handle]);
+    }
+    return last - first;
+  }
+  // Returns the bytes held by the entries.
+  size_t memoryUsage() const;
+
+private:
+  static constexpr size_t KEY_BYTES = 12;
+  // A customer keyed by the first bytes of its folded last name, split in
+  // two big-endian integers and padded with zeros, so that comparing the
+  // keys as integers orders names by their start.
+  struct Entry {
+    uint64_t high;
+    uint32_t low;
+    CustomerHandle handle;
+  };
+
+  CustomerTable &table;
+  // Sorted entries, followed by those added since the last sort.
+  std::vector<Entry> entries;
+  size_t sorted = 0;
+  // Replaced records in the table when stale entries were last dropped.
+  size_t replaced = 0;
+
+  // Returns the entry of a customer's last name, or with no handle, the
+  // key of a prefix to search for.
+  static Entry keyOf(std::string_view name, CustomerHandle handle = 0);
+  // Orders entries by last name, first name, then id.
+  bool before(const Entry &a, const Entry &b) const;
+  // Sorts entries into that order.
+  void sortEntries(std::vector<Entry>::iterator first,
+                   std::vector<Entry>::iterator last) const;
+  // Compares the start of an entry's last name, as long as the prefix,
+  // with the prefix. Returns <0, 0 or >0.
+  int comparePrefix(const Entry &entry, std::string_view prefix,
+                    const Entry &prefixKey) const;
+  // Returns the position of the first sorted entry whose last name does
+  // not come before `prefix`, or with `after`, the first past those that
+  // start with it.
+  size_t bound(std::string_view prefix, const Entry &prefixKey,
+               bool after) const;
+};
+
+#endif // CUSTOMER_NAME_INDEX_H
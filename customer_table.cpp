@@ -0,0 +1,85 @@
+#include "customer_table.h"
+#include "memory_usage.h"
+
+// Appends a customer record, copying its names aside if they are too long
+// to store inline, and points the id's table entry at it.
+Customer &CustomerTable::add(int id, std::string_view lastName,
+                             std::string_view firstName) {
+  if (count == chunks.size() * CHUNK_SIZE) {
+    chunks.emplace_back();
+    chunks.back().reserve(CHUNK_SIZE);
+  }
+  lastName = lastName.substr(0, lastName.find('\0'));
+  firstName = firstName.substr(0, firstName.find('\0'));
+  char *names = nullptr;
+  size_t size = Customer::namesSize(lastName, firstName);
+  if (size >= Customer::INLINE_NAMES) {
+    longNames.push_back(std::make_unique<char[]>(size));
+    longNameBytes += size;
+    names = longNames.back().get();
+  }
+  auto handle = static_cast<CustomerHandle>(count);
+  Customer &customer = chunks.back().emplace_back(handle, id, lastName,
+                                                  firstName, names);
+  count++;
+
+  if ((indexed + 1) * 2 > slots.size()) {
+    grow();
+  }
+  size_t mask = slots.size() - 1;
+  size_t position = home(id);
+  while (slots[position].handle != EMPTY && slots[position].id != id) {
+    position = (position + 1) & mask;
+  }
+  if (slots[position].handle == EMPTY) {
+    indexed++;
+  }
+  slots[position] = {id, handle};
+  return customer;
+}
+
+// Finds a customer by linear probing from the id's home position.
+Customer *CustomerTable::find(int id) {
+  if (slots.empty()) {
+    return nullptr;
+  }
+  size_t mask = slots.size() - 1;
+  for (size_t position = home(id);; position = (position + 1) & mask) {
+    const Slot &slot = slots[position];
+    if (slot.handle == EMPTY) {
+      return nullptr;
+    }
+    if (slot.id == id) {
+      return &(*this)[slot.handle];
+    }
+  }
+}
+
+// Returns the bytes of the chunks, the id table and the long names.
+size_t CustomerTable::memoryUsage() const {
+  return chunks.size() * CHUNK_SIZE * sizeof(Customer) + heapBytes(chunks) +
+         heapBytes(slots) + heapBytes(longNames) + longNameBytes;
+}
+
+// Hashes the id to its home position in the table.
+size_t CustomerTable::home(int id) const {
+  auto key = static_cast<uint32_t>(id);
+  return (key * 0x9E3779B97F4A7C15ULL >> 17) & (slots.size() - 1);
+}
+
+// Moves every entry into a table twice the size.
+void CustomerTable::grow() {
+  std::vector<Slot> old(slots.empty() ? 64 : slots.size() * 2, {0, EMPTY});
+  old.swap(slots);
+  size_t mask = slots.size() - 1;
+  for (const Slot &slot : old) {
+    if (slot.handle == EMPTY) {
+      continue;
+    }
+    size_t position = home(slot.id);
+    while (slots[position].handle != EMPTY) {
+      position = (position + 1) & mask;
+    }
+    slots[position] = slot;
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef CUSTOMER_TABLE_H
+#define CUSTOMER_TABLE_H
+
+#include "customer.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// The store's customers, stored contiguously in fixed-size chunks and
+// found by id through an open-addressed table of handles. A customer's
+// handle is its position in the table. Records never move, so handles and
+// pointers stay valid as customers are added.
+class CustomerTable {
+public:
+  CustomerTable() = default;
+  CustomerTable(const CustomerTable &) = delete;
+  CustomerTable &operator=(const CustomerTable &) = delete;
+
+  // Adds a customer. It replaces any customer with the same id in lookups;
+  // the replaced record stays in the table for the handles that name it.
+  // A name ends at its first NUL character.
+  Customer &add(int id, std::string_view lastName, std::string_view firstName);
+  // Finds a customer by id. Returns nullptr if there is none.
+  Customer *find(int id);
+
+  // Gets the customer with the given handle.
+  Customer &operator[](CustomerHandle handle) {
+    return chunks[handle >> CHUNK_BITS][handle & (CHUNK_SIZE - 1)];
+  }
+  const Customer &operator[](CustomerHandle handle) const {
+    return chunks[handle >> CHUNK_BITS][handle & (CHUNK_SIZE - 1)];
+  }
+  // Returns the number of records, replaced ones included.
+  size_t size() const { return count; }
+  // Returns the number of distinct ids, each naming its current record.
+  size_t idCount() const { return indexed; }
+  // Calls `visit` on every record, in the order they were added.
+  template <typename Visit> void forEach(Visit visit) const {
+    for (const auto &chunk : chunks) {
+      for (const Customer &customer : chunk) {
+        visit(customer);
+      }
+    }
+  }
+  // Returns the bytes held by the records, the id table and the names too
+  // long to store inline, not counting the customers' histories.
+  size_t memoryUsage() const;
+
+private:
+  static constexpr int CHUNK_BITS = 10;
+  static constexpr size_t CHUNK_SIZE = size_t{1} << CHUNK_BITS;
+  static constexpr CustomerHandle EMPTY = UINT32_MAX;
+
+  // Chunks of CHUNK_SIZE records, each allocated in full up front.
+  std::vector<std::vector<Customer>> chunks;
+  size_t count = 0;
+  // The current customer of each id, by hash of the id. Keeping the id
+  // beside the handle lets probes and rehashing skip the records.
+  struct Slot {
+    int id;
+    CustomerHandle handle;
+  };
+  std::vector<Slot> slots;
+  size_t indexed = 0;
+  // Copies of the names too long for their records.
+  std::vector<std::unique_ptr<char[]>> longNames;
+  size_t longNameBytes = 0;
+
+  // Returns the home position of an id in the table.
+  size_t home(int id) const;
+  // Doubles the table.
+  void grow();
+};
+
+#endif // CUSTOMER_TABLE_H
@@ -0,0 +1,163 @@
+#include "error_reporter.h"
+
+// Returns the number of errors of every kind.
+uint64_t ErrorReporter::Counts::total() const {
+  uint64_t sum = 0;
+  for (uint64_t count : seen) {
+    sum += count;
+  }
+  return sum;
+}
+
+// Constructs an ErrorReporter.
+ErrorReporter::ErrorReporter(size_t detailLimit) : detailLimit(detailLimit) {}
+
+// Opens the sidecar file errors are recorded in.
+bool ErrorReporter::openSidecar(const std::string &path) {
+  sidecar.open(path, std::ios::out | std::ios::trunc);
+  return sidecar.is_open();
+}
+
+// Remembers the input line being processed.
+void ErrorReporter::setPosition(std::string_view source, size_t line,
+                                std::string_view text) {
+  if (this->source != source) {
+    this->source.assign(source.data(), source.size());
+  }
+  this->line = line;
+  this->text = text;
+}
+
+// Counts an error and decides whether it gets a detail line: always up to
+// the detail limit, then at exponentially growing intervals.
+bool ErrorReporter::admit(InputError kind) {
+  auto index = static_cast<size_t>(kind);
+  uint64_t seen = ++counts.seen[index];
+
+  if (sidecar.is_open()) {
+    record << "{\"source\":";
+    appendJson(source);
+    record << ",\"line\":" << line << ",\"kind\":\"" << identifier(kind)
+           << "\",\"input\":";
+    appendJson(text);
+    record << "}\n";
+    sidecar.write(record.view().data(),
+                  static_cast<std::streamsize>(record.size()));
+    record.clear();
+  }
+
+  if (seen > detailLimit && (seen & (seen - 1)) != 0) {
+    return false;
+  }
+  counts.detailed[index]++;
+  return true;
+}
+
+// Adds the counts of another reporter to this one.
+void ErrorReporter::add(const Counts &other) {
+  for (size_t i = 0; i < KIND_COUNT; i++) {
+    counts.seen[i] += other.seen[i];
+    counts.detailed[i] += other.detailed[i];
+  }
+}
+
+// Writes how many errors of each kind were seen and how many of them had
+// no detail line, then resets the counts.
+void ErrorReporter::printSummary(std::ostream &out) {
+  if (sidecar.is_open()) {
+    sidecar.flush();
+  }
+  uint64_t total = counts.total();
+  if (total == 0) {
+    return;
+  }
+
+  FormatBuffer summary;
+  summary << "Rejected " << total << " input lines:\n";
+  for (size_t i = 0; i < KIND_COUNT; i++) {
+    if (counts.seen[i] == 0) {
+      continue;
+    }
+    summary << "  " << describe(static_cast<InputError>(i)) << ": "
+            << counts.seen[i];
+    uint64_t suppressed = counts.seen[i] - counts.detailed[i];
+    if (suppressed > 0) {
+      summary << " (" << suppressed << " not shown)";
+    }
+    summary << '\n';
+  }
+  summary.flushTo(out);
+  counts = Counts();
+}
+
+// Returns the description of an error kind.
+const char *ErrorReporter::describe(InputError kind) {
+  switch (kind) {
+  case InputError::UnknownCommand:
+    return "unknown command type";
+  case InputError::MalformedCommand:
+    return "malformed command";
+  case InputError::InvalidMediaType:
+    return "invalid media type";
+  case InputError::InvalidCustomer:
+    return "invalid customer ID";
+  case InputError::InvalidMovie:
+    return "invalid movie";
+  case InputError::InvalidMovieLine:
+    return "invalid movie format";
+  case InputError::InvalidStock:
+    return "invalid stock number";
+  case InputError::UnknownMovieType:
+    return "unknown movie type";
+  case InputError::InvalidCustomerLine:
+    return "invalid customer line";
+  }
+  return "unknown error";
+}
+
+// Returns the identifier of an error kind.
+const char *ErrorReporter::identifier(InputError kind) {
+  switch (kind) {
+  case InputError::UnknownCommand:
+    return "unknown_command";
+  case InputError::MalformedCommand:
+    return "malformed_command";
+  case InputError::InvalidMediaType:
+    return "invalid_media_type";
+  case InputError::InvalidCustomer:
+    return "invalid_customer";
+  case InputError::InvalidMovie:
+    return "invalid_movie";
+  case InputError::InvalidMovieLine:
+    return "invalid_movie_line";
+  case InputError::InvalidStock:
+    return "invalid_stock";
+  case InputError::UnknownMovieType:
+    return "unknown_movie_type";
+  case InputError::InvalidCustomerLine:
+    return "invalid_customer_line";
+  }
+  return "unknown";
+}
+
+// Appends a value as a JSON string, escaping quotes, backslashes and
+// control characters. Runs of plain characters are appended at once.
+void ErrorReporter::appendJson(std::string_view value) {
+  static const char HEX[] = "0123456789abcdef";
+  record << '"';
+  size_t plain = 0;
+  for (size_t i = 0; i < value.size(); i++) {
+    auto byte = static_cast<unsigned char>(value[i]);
+    if (byte >= 0x20 && byte != '"' && byte != '\\') {
+      continue;
+    }
+    record << value.substr(plain, i - plain);
+    if (byte < 0x20) {
+      record << "\\u00" << HEX[byte >> 4] << HEX[byte & 0xf];
+    } else {
+      record << '\\' << value[i];
+    }
+    plain = i + 1;
+  }
+  record << value.substr(plain) << '"';
+}
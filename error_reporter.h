@@ -0,0 +1,92 @@
+#ifndef ERROR_REPORTER_H
+#define ERROR_REPORTER_H
+
+#include "format_buffer.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Kinds of malformed or rejected input lines.
+enum class InputError {
+  UnknownCommand,
+  MalformedCommand,
+  InvalidMediaType,
+  InvalidCustomer,
+  InvalidMovie,
+  InvalidMovieLine,
+  InvalidStock,
+  UnknownMovieType,
+  InvalidCustomerLine,
+};
+
+// Counts malformed and rejected input by kind and decides which of them
+// get a detail line, so a corrupt feed cannot flood the output. The first
+// `detailLimit` errors of each kind are detailed; after that only the
+// errors whose count is a power of two are, and the rest are only
+// counted. Every error can also be recorded, with its source line, in a
+// sidecar file of JSON lines.
+class ErrorReporter {
+public:
+  static constexpr size_t KIND_COUNT =
+      static_cast<size_t>(InputError::InvalidCustomerLine) + 1;
+  static constexpr size_t DEFAULT_DETAIL_LIMIT = 10;
+  static constexpr size_t UNLIMITED = SIZE_MAX;
+
+  // Number of errors of each kind, and how many of them were detailed.
+  struct Counts {
+    std::array<uint64_t, KIND_COUNT> seen{};
+    std::array<uint64_t, KIND_COUNT> detailed{};
+
+    // Returns the number of errors of every kind.
+    uint64_t total() const;
+  };
+
+  // Constructs a reporter that details `detailLimit` errors of each kind.
+  explicit ErrorReporter(size_t detailLimit = DEFAULT_DETAIL_LIMIT);
+
+  // Sets how many errors of each kind are detailed before sampling.
+  void setDetailLimit(size_t limit) { detailLimit = limit; }
+  // Gets how many errors of each kind are detailed before sampling.
+  size_t getDetailLimit() const { return detailLimit; }
+  // Records every error in the given file from now on. Returns false if
+  // the file cannot be opened.
+  bool openSidecar(const std::string &path);
+  // Sets the input line subsequent errors belong to. The text must stay
+  // valid until the next call.
+  void setPosition(std::string_view source, size_t line,
+                   std::string_view text);
+
+  // Counts an error of the given kind. Returns true if the caller should
+  // write its detail line.
+  bool admit(InputError kind);
+  // Adds counts gathered by another reporter.
+  void add(const Counts &other);
+  // Gets the counts since the last summary.
+  const Counts &getCounts() const { return counts; }
+  // Writes a summary of the counts, if there were any errors, and starts
+  // counting afresh.
+  void printSummary(std::ostream &out);
+
+  // Returns the description of an error kind used in summaries.
+  static const char *describe(InputError kind);
+  // Returns the identifier of an error kind used in the sidecar file.
+  static const char *identifier(InputError kind);
+
+private:
+  size_t detailLimit;
+  Counts counts;
+  std::string source;
+  size_t line = 0;
+  std::string_view text;
+  std::ofstream sidecar;
+  FormatBuffer record;
+
+  // Appends a string to the record as a JSON string literal.
+  void appendJson(std::string_view value);
+};
+
+#endif // ERROR_REPORTER_H
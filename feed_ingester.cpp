@@ -0,0 +1,217 @@
+#include "feed_ingester.h"
+#include "Store.h"
+#include "arg_parse.h"
+#include "mpsc_queue.h"
+#include "trace.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Returns the seconds elapsed since start.
+double elapsedSeconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// A line as its reader parsed it; the command is null if it did not
+// parse.
+struct ParsedLine {
+  std::string line;
+  std::unique_ptr<Command> command;
+  size_t lineNumber;
+};
+
+// Consecutive lines of one feed. The last chunk of a feed tells the store
+// the feed has ended, so it is queued even when empty.
+struct Chunk {
+  size_t feed = 0;
+  bool last = false;
+  std::vector<ParsedLine> lines;
+};
+
+using ChunkQueue = MpscQueue<std::unique_ptr<Chunk>>;
+
+// Queues a chunk, yielding while the queue is full, and counts the time
+// spent waiting.
+void pushChunk(ChunkQueue &queue, std::unique_ptr<Chunk> &chunk,
+               FeedIngester::FeedStats &stats) {
+  if (queue.tryPush(chunk)) {
+    return;
+  }
+  auto start = Clock::now();
+  while (!queue.tryPush(chunk)) {
+    std::this_thread::yield();
+  }
+  stats.stalledSeconds += elapsedSeconds(start);
+}
+
+// Reads and parses a feed on its own thread. Only the feed's stats are
+// written, and the store is never touched.
+void readFeed(size_t feed, std::ifstream &file, size_t chunkLines,
+              ChunkQueue &queue, FeedIngester::FeedStats &stats) {
+  Tracer::nameThread("feed " + std::to_string(feed));
+  TraceSpan span("readFeed");
+  auto start = Clock::now();
+  const CommandFactory &factory = CommandFactory::getInstance();
+  auto chunk = std::make_unique<Chunk>();
+  chunk->feed = feed;
+  chunk->lines.reserve(chunkLines);
+
+  std::string line;
+  while (std::getline(file, line)) {
+    stats.lines++;
+    stats.bytes += line.size() + 1;
+    if (line.empty()) {
+      continue;
+    }
+    std::unique_ptr<Command> command(factory.parseCommand(line));
+    if (command != nullptr) {
+      stats.commands++;
+    } else {
+      stats.rejected++;
+    }
+    chunk->lines.push_back({std::move(line), std::move(command), stats.lines});
+    if (chunk->lines.size() == chunkLines) {
+      pushChunk(queue, chunk, stats);
+      chunk = std::make_unique<Chunk>();
+      chunk->feed = feed;
+      chunk->lines.reserve(chunkLines);
+    }
+  }
+  chunk->last = true;
+  pushChunk(queue, chunk, stats);
+  stats.parseSeconds = elapsedSeconds(start) - stats.stalledSeconds;
+}
+
+} // namespace
+
+// Constructs an ingester for the store.
+FeedIngester::FeedIngester(Store &store, const Options &options)
+    : store(store), options(options) {
+  if (this->options.chunkLines == 0) {
+    this->options.chunkLines = 1;
+  }
+}
+
+// Opens every file first, so a missing one fails the run before any line
+// of another has run. The filenames double as the sources the store's
+// error reports name, and outlive the stream.
+bool FeedIngester::run(const std::vector<std::string> &filenames,
+                       Report &report) {
+  TraceSpan span("ingest");
+  std::vector<std::ifstream> files;
+  for (const std::string &filename : filenames) {
+    files.emplace_back(filename);
+    if (!files.back().is_open()) {
+      std::cerr << "Error: Cannot open " << filename << std::endl;
+      return false;
+    }
+  }
+
+  report = Report();
+  report.feeds.resize(filenames.size());
+  for (size_t feed = 0; feed < filenames.size(); feed++) {
+    report.feeds[feed].source = filenames[feed];
+  }
+  auto start = Clock::now();
+  ChunkQueue queue(options.queueChunks);
+  std::vector<std::thread> readers;
+  for (size_t feed = 0; feed < filenames.size(); feed++) {
+    readers.emplace_back(readFeed, feed, std::ref(files[feed]),
+                         options.chunkLines, std::ref(queue),
+                         std::ref(report.feeds[feed]));
+  }
+
+  size_t open = filenames.size();
+  std::unique_ptr<Chunk> chunk;
+  while (open > 0) {
+    if (!queue.tryPop(chunk)) {
+      auto waitStart = Clock::now();
+      while (!queue.tryPop(chunk)) {
+        std::this_thread::yield();
+      }
+      report.idleSeconds += elapsedSeconds(waitStart);
+    }
+    const std::string &source = filenames[chunk->feed];
+    for (ParsedLine &parsed : chunk->lines) {
+      store.processParsedLine(source, parsed.lineNumber,
+                              std::move(parsed.line),
+                              std::move(parsed.command));
+    }
+    if (chunk->last) {
+      open--;
+    }
+  }
+  store.finishCommands();
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  report.seconds = elapsedSeconds(start);
+  for (const FeedStats &stats : report.feeds) {
+    report.lines += stats.lines;
+  }
+  return true;
+}
+
+// Prints a line per feed, then the totals.
+void FeedIngester::print(const Report &report, std::ostream &out) {
+  out << "FEEDS:\n";
+  for (const FeedStats &stats : report.feeds) {
+    out << stats.source << ": " << stats.lines << " lines, " << stats.commands
+        << " commands, " << stats.rejected << " rejected, " << stats.bytes
+        << " bytes; parsed in " << stats.parseSeconds * 1000 << " ms, "
+        << stats.stalledSeconds * 1000 << " ms waiting for the queue\n";
+  }
+  double rate = report.seconds > 0 ? report.lines / report.seconds : 0.0;
+  out << "All feeds: " << report.lines << " lines in " << report.seconds
+      << " s (" << static_cast<uint64_t>(rate) << " lines/s), store idle "
+      << report.idleSeconds * 1000 << " ms\n";
+}
+
+/**
+ * Ingest mode: "ingest [--chunk N] movies customers feed..." loads the
+ * store, runs the feeds at once and prints each feed's statistics after
+ * the store's output.
+ */
+int runIngest(int argc, char *argv[]) {
+  // Chunks are reserved up front, so their size is capped.
+  const unsigned long maxChunkLines = 1000000;
+  FeedIngester::Options options;
+  std::vector<std::string> files;
+  bool valid = true;
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--chunk") {
+      unsigned long lines = 0;
+      valid = parseNumber(argv[++i], maxChunkLines, lines) && lines > 0 &&
+              valid;
+      options.chunkLines = lines;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (!valid || files.size() < 3) {
+    std::cerr << "Usage: ingest [--chunk N] movies customers feed..."
+              << std::endl;
+    return 1;
+  }
+
+  Store store;
+  if (!store.loadMovies(files[0]) || !store.loadCustomers(files[1])) {
+    return 1;
+  }
+  FeedIngester ingester(store, options);
+  FeedIngester::Report report;
+  if (!ingester.run(std::vector<std::string>(files.begin() + 2, files.end()),
+                    report)) {
+    return 1;
+  }
+  FeedIngester::print(report, std::cout);
+  return 0;
+}
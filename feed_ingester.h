@@ -0,0 +1,66 @@
+#ifndef FEED_INGESTER_H
+#define FEED_INGESTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Store;
+
+// Runs several command files against one Store at once, such as the logs
+// of different branches. Each file gets a reader thread that reads and
+// parses its lines and pushes them, a chunk at a time, onto a lock-free
+// queue (see mpsc_queue.h); the calling thread pops the chunks and
+// executes them on the store, which stays single-threaded. Each file's
+// lines run in file order, so commands about a customer served by one
+// branch keep their order; the files' chunks interleave in the order they
+// arrive.
+class FeedIngester {
+public:
+  // How the feeds are read.
+  struct Options {
+    // Lines parsed into one chunk before it is queued.
+    size_t chunkLines = 256;
+    // Chunks the queue holds. A reader that finds it full waits.
+    size_t queueChunks = 64;
+  };
+
+  // What one feed's reader did.
+  struct FeedStats {
+    std::string source;
+    // Lines read, blank ones included.
+    uint64_t lines = 0;
+    uint64_t bytes = 0;
+    // Lines that parsed, and the other non-blank lines.
+    uint64_t commands = 0;
+    uint64_t rejected = 0;
+    // Time spent reading and parsing, and waiting for room in the queue.
+    double parseSeconds = 0.0;
+    double stalledSeconds = 0.0;
+  };
+
+  // Results of a run.
+  struct Report {
+    std::vector<FeedStats> feeds;
+    uint64_t lines = 0;
+    double seconds = 0.0;
+    // Time the store waited for the readers with the queue empty.
+    double idleSeconds = 0.0;
+  };
+
+  FeedIngester(Store &store, const Options &options);
+
+  // Processes the files, then ends the stream as processCommands does.
+  // Returns false, before running anything, if a file cannot be opened.
+  bool run(const std::vector<std::string> &filenames, Report &report);
+  // Prints each feed's statistics and the totals.
+  static void print(const Report &report, std::ostream &out);
+
+private:
+  Store &store;
+  Options options;
+};
+
+#endif // FEED_INGESTER_H
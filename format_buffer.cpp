@@ -0,0 +1,10 @@
+#include "format_buffer.h"
+#include "trace.h"
+
+// Writes the formatted text to a stream and starts a new report.
+void FormatBuffer::flushTo(std::ostream &out) {
+  TraceSpan span("output");
+  out.write(chars.data(), static_cast<std::streamsize>(chars.size()));
+  out.flush();
+  chars.clear();
+}
@@ -0,0 +1,74 @@
+#ifndef FORMAT_BUFFER_H
+#define FORMAT_BUFFER_H
+
+#include <charconv>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Growable character buffer that report lines are formatted into. The
+// buffer keeps its capacity when cleared, so once it has grown to the
+// longest report, formatting into it allocates nothing.
+class FormatBuffer {
+public:
+  // Appends text.
+  FormatBuffer &operator<<(std::string_view text) {
+    chars.append(text.data(), text.size());
+    return *this;
+  }
+  // Appends a NUL-terminated string.
+  FormatBuffer &operator<<(const char *text) {
+    return *this << std::string_view(text);
+  }
+  // Appends a string.
+  FormatBuffer &operator<<(const std::string &text) {
+    return *this << std::string_view(text);
+  }
+  // Appends one character.
+  FormatBuffer &operator<<(char ch) {
+    chars.push_back(ch);
+    return *this;
+  }
+  // Appends an integer in decimal.
+  FormatBuffer &operator<<(int value) { return appendInteger(value); }
+  FormatBuffer &operator<<(long value) { return appendInteger(value); }
+  FormatBuffer &operator<<(long long value) { return appendInteger(value); }
+  FormatBuffer &operator<<(unsigned value) { return appendInteger(value); }
+  FormatBuffer &operator<<(unsigned long value) {
+    return appendInteger(value);
+  }
+  FormatBuffer &operator<<(unsigned long long value) {
+    return appendInteger(value);
+  }
+
+  // Gets the formatted text.
+  std::string_view view() const { return chars; }
+  // Gets the formatted text as a new string.
+  std::string str() const { return chars; }
+  // Gets the number of characters formatted.
+  size_t size() const { return chars.size(); }
+  // Returns true if nothing has been formatted.
+  bool empty() const { return chars.empty(); }
+  // Discards the text, keeping the capacity.
+  void clear() { chars.clear(); }
+  // Reserves room for at least the given number of characters.
+  void reserve(size_t capacity) { chars.reserve(capacity); }
+
+  // Writes the text to a stream, flushes the stream and clears the buffer.
+  void flushTo(std::ostream &out);
+
+private:
+  std::string chars;
+
+  // Appends an integer without going through a temporary string.
+  template <typename T> FormatBuffer &appendInteger(T value) {
+    char digits[24];
+    std::to_chars_result result =
+        std::to_chars(digits, digits + sizeof(digits), value);
+    chars.append(digits, result.ptr);
+    return *this;
+  }
+};
+
+#endif // FORMAT_BUFFER_H
@@ -0,0 +1,79 @@
+#include "history_spill.h"
+#include "customer.h"
+#include "trace.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+#include <unistd.h>
+
+static_assert(std::is_trivially_copyable_v<Transaction>,
+              "transactions are spilled as raw bytes");
+
+// Creates and unlinks a temporary file in the directory.
+HistorySpill::HistorySpill(size_t budget, const std::string &directory)
+    : budget(0) {
+  setBudget(budget);
+  std::string path = directory + "/history-XXXXXX";
+  fd = mkstemp(path.data());
+  if (fd < 0) {
+    std::cerr << "Error: history spill file in " << directory << ": "
+              << std::strerror(errno) << std::endl;
+    return;
+  }
+  unlink(path.c_str());
+}
+
+// Closes, and so deletes, the spill file.
+HistorySpill::~HistorySpill() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+// Writes the entries at the end of the file.
+bool HistorySpill::write(const Transaction *entries, size_t count,
+                         Segment &segment) {
+  TraceSpan span("spillWrite");
+  const char *data = reinterpret_cast<const char *>(entries);
+  size_t bytes = count * sizeof(Transaction);
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t written = pwrite(fd, data + done, bytes - done, size + done);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(written);
+  }
+
+  segment = {size, static_cast<uint32_t>(count)};
+  size += bytes;
+  entryCount += count;
+  return true;
+}
+
+// Reads the entries of a segment with one positioned read.
+bool HistorySpill::read(const Segment &segment,
+                        std::vector<Transaction> &entries) const {
+  TraceSpan span("spillRead");
+  entries.resize(segment.count,
+                 Transaction(Transaction::BORROW, nullptr, DVD, 0));
+  char *data = reinterpret_cast<char *>(entries.data());
+  size_t bytes = segment.count * sizeof(Transaction);
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t got = pread(fd, data + done, bytes - done, segment.offset + done);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      entries.clear();
+      return false;
+    }
+    done += static_cast<size_t>(got);
+  }
+  return true;
+}
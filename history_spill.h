@@ -0,0 +1,69 @@
+#ifndef HISTORY_SPILL_H
+#define HISTORY_SPILL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Transaction;
+
+// Append-only file holding the older transactions of customer histories,
+// so each customer keeps only its recent entries in memory. A customer
+// whose in-memory entries reach the budget writes all but the newest half
+// budget of them as one segment and keeps the segment's place in the file.
+//
+// Entries are written as they are held in memory, movie address included.
+// The store keeps every movie alive for its lifetime, so the file is only
+// meaningful to the process that wrote it: it is unlinked once created and
+// disappears when closed.
+class HistorySpill {
+public:
+  // Smallest budget other than 0.
+  static constexpr size_t MIN_BUDGET = 16;
+
+  // A run of consecutive entries of one history written to the file.
+  struct Segment {
+    uint64_t offset;
+    uint32_t count;
+  };
+
+  // Creates the spill file in the given directory. Check isOpen() for
+  // failure.
+  HistorySpill(size_t budget, const std::string &directory);
+  ~HistorySpill();
+  HistorySpill(const HistorySpill &) = delete;
+  HistorySpill &operator=(const HistorySpill &) = delete;
+
+  // Returns true if the file was created.
+  bool isOpen() const { return fd >= 0; }
+  // Gets the most entries of each history kept in memory; 0 keeps them
+  // all.
+  size_t getBudget() const { return budget; }
+  // Sets the most entries of each history kept in memory. A budget below
+  // MIN_BUDGET is raised to it, so every segment holds at least half of
+  // MIN_BUDGET entries and the segment list stays small beside them.
+  void setBudget(size_t entries) {
+    budget = entries == 0 ? 0 : std::max(entries, MIN_BUDGET);
+  }
+
+  // Appends entries to the file. Returns false, writing nothing usable, if
+  // the write fails.
+  bool write(const Transaction *entries, size_t count, Segment &segment);
+  // Reads a segment back. Returns false if the read fails.
+  bool read(const Segment &segment, std::vector<Transaction> &entries) const;
+
+  // Returns the number of entries written.
+  size_t getEntryCount() const { return entryCount; }
+  // Returns the number of bytes written.
+  uint64_t getSize() const { return size; }
+
+private:
+  int fd = -1;
+  size_t budget;
+  uint64_t size = 0;
+  size_t entryCount = 0;
+};
+
+#endif // HISTORY_SPILL_H
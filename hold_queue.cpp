@@ -0,0 +1,22 @@
+#include "hold_queue.h"
+
+// Adds a customer to the back of the queue.
+void HoldQueue::push(int customerId) {
+  // Drop the consumed prefix once it dominates, keeping pops O(1)
+  // amortized without letting the vector grow forever.
+  if (head > 0 && head * 2 >= ids.size()) {
+    ids.erase(ids.begin(), ids.begin() + static_cast<std::ptrdiff_t>(head));
+    head = 0;
+  }
+  ids.push_back(customerId);
+}
+
+// Removes and returns the customer at the front of the queue.
+int HoldQueue::pop() {
+  int customerId = ids[head++];
+  if (head == ids.size()) {
+    ids.clear();
+    head = 0;
+  }
+  return customerId;
+}
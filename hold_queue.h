@@ -0,0 +1,27 @@
+#ifndef HOLD_QUEUE_H
+#define HOLD_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// FIFO of the ids of customers waiting for one movie. Ids are stored as
+// packed 32-bit integers and the consumed prefix is reclaimed in bulk, so
+// each hold costs four bytes.
+class HoldQueue {
+public:
+  // Adds a customer to the back of the queue.
+  void push(int customerId);
+  // Removes and returns the customer at the front of the queue.
+  int pop();
+  // Returns true if nobody is waiting.
+  bool empty() const { return head == ids.size(); }
+  // Returns the number of waiting customers.
+  size_t size() const { return ids.size() - head; }
+
+private:
+  std::vector<int32_t> ids;
+  size_t head = 0;
+};
+
+#endif // HOLD_QUEUE_H
@@ -0,0 +1,137 @@
+#include "inventory_snapshot.h"
+#include "movie.h"
+#include <thread>
+
+// Constructs an empty version store with every reader slot free.
+InventoryVersions::InventoryVersions() {
+  for (auto &reader : readers) {
+    reader.store(FREE_SLOT);
+  }
+}
+
+// Publishes a new version of the movie's counters, retiring the previous
+// one, then advances the clock so new snapshots see it.
+void InventoryVersions::publish(Movie &movie) {
+  uint64_t version = clock.load(std::memory_order_relaxed) + 1;
+  StockVersion *node = allocate();
+  const StockVersion *previous = movie.getPublishedStock();
+  *node = {version, movie.getStock(), movie.getBorrowed(), previous};
+  movie.setPublishedStock(node);
+  clock.store(version);
+
+  if (previous != nullptr) {
+    // Only snapshots pinned before `version` can still reach it.
+    retired.push_back({const_cast<StockVersion *>(previous), version});
+  }
+  reclaim();
+}
+
+// Publishes the list of movies snapshots iterate over.
+void InventoryVersions::publishCatalog(std::vector<const Movie *> movies) {
+  std::atomic_store(&catalog,
+                    std::shared_ptr<const std::vector<const Movie *>>(
+                        std::make_shared<std::vector<const Movie *>>(
+                            std::move(movies))));
+}
+
+// Pins the current version in a free reader slot, making sure the slot is
+// below `readerSlots` before the clock is read again: if the clock did not
+// move, any writer that later reclaims scans the slot and sees the pin,
+// and versions reclaimed earlier were already replaced by versions this
+// snapshot reads instead.
+InventorySnapshot InventoryVersions::snapshot() const {
+  std::shared_ptr<const std::vector<const Movie *>> movies =
+      std::atomic_load(&catalog);
+
+  while (true) {
+    for (size_t slot = 0; slot < MAX_READERS; slot++) {
+      uint64_t expected = FREE_SLOT;
+      uint64_t version = clock.load();
+      if (!readers[slot].compare_exchange_strong(expected, version)) {
+        continue;
+      }
+      size_t used = readerSlots.load();
+      while (used < slot + 1 &&
+             !readerSlots.compare_exchange_weak(used, slot + 1)) {
+      }
+      while (clock.load() != version) {
+        version = clock.load();
+        readers[slot].store(version);
+      }
+      return InventorySnapshot(this, slot, version, std::move(movies));
+    }
+    // Every slot is taken: wait for a report to finish.
+    std::this_thread::yield();
+  }
+}
+
+// Takes a node from the free list, allocating a new chunk when empty.
+StockVersion *InventoryVersions::allocate() {
+  if (freeNodes.empty()) {
+    chunks.push_back(std::make_unique<StockVersion[]>(NODES_PER_CHUNK));
+    StockVersion *chunk = chunks.back().get();
+    for (size_t i = 0; i < NODES_PER_CHUNK; i++) {
+      freeNodes.push_back(&chunk[i]);
+    }
+  }
+  StockVersion *node = freeNodes.back();
+  freeNodes.pop_back();
+  return node;
+}
+
+// Recycles retired versions older than every pinned snapshot. Retirement
+// order follows the clock, so only the front of the queue is examined.
+void InventoryVersions::reclaim() {
+  if (retired.empty()) {
+    return;
+  }
+
+  uint64_t oldestPinned = FREE_SLOT;
+  size_t used = readerSlots.load();
+  for (size_t slot = 0; slot < used; slot++) {
+    uint64_t pinned = readers[slot].load();
+    if (pinned < oldestPinned) {
+      oldestPinned = pinned;
+    }
+  }
+
+  while (!retired.empty() && retired.front().replacedAt <= oldestPinned) {
+    freeNodes.push_back(retired.front().node);
+    retired.pop_front();
+  }
+}
+
+// Constructs a snapshot pinned at a version.
+InventorySnapshot::InventorySnapshot(
+    const InventoryVersions *owner, size_t slot, uint64_t version,
+    std::shared_ptr<const std::vector<const Movie *>> catalog)
+    : owner(owner), slot(slot), version(version), catalog(std::move(catalog)) {
+}
+
+// Transfers the pin to a new snapshot object.
+InventorySnapshot::InventorySnapshot(InventorySnapshot &&other) noexcept
+    : owner(other.owner), slot(other.slot), version(other.version),
+      catalog(std::move(other.catalog)) {
+  other.owner = nullptr;
+}
+
+// Releases the reader slot so the writer can recycle pinned versions.
+InventorySnapshot::~InventorySnapshot() {
+  if (owner != nullptr) {
+    owner->readers[slot].store(InventoryVersions::FREE_SLOT);
+  }
+}
+
+// Returns a movie's counters as of the snapshot's version.
+InventorySnapshot::Row InventorySnapshot::row(size_t index) const {
+  const Movie *movie = (*catalog)[index];
+  const StockVersion *state = movie->getPublishedStock();
+  while (state != nullptr && state->version > version &&
+         state->older != nullptr) {
+    state = state->older;
+  }
+  if (state == nullptr) {
+    return {movie, movie->getStock(), movie->getBorrowed()};
+  }
+  return {movie, state->stock, state->borrowed};
+}
@@ -0,0 +1,123 @@
+#ifndef INVENTORY_SNAPSHOT_H
+#define INVENTORY_SNAPSHOT_H
+
+#include "media_format.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+class Movie;
+
+// One published state of a movie's stock counters. Never modified once
+// published; `older` links to the state it replaced.
+struct StockVersion {
+  uint64_t version;
+  FormatCounts stock;
+  FormatCounts borrowed;
+  const StockVersion *older;
+};
+
+class InventorySnapshot;
+
+// Multi-version store of the inventory counters, so reports can read a
+// consistent point-in-time view while borrows and returns continue.
+//
+// The store's command thread is the only writer: after changing a movie
+// it publishes a new version of the movie's counters and advances the
+// version clock. Readers on any thread pin the clock value when they take
+// a snapshot and, for each movie, walk back to the newest version not
+// after it. A replaced version is recycled as soon as no pinned snapshot
+// can still need it, so with no readers active a write reuses the node it
+// just retired and never allocates.
+class InventoryVersions {
+public:
+  // Maximum number of snapshots alive at once.
+  static constexpr size_t MAX_READERS = 64;
+
+  InventoryVersions();
+  InventoryVersions(const InventoryVersions &) = delete;
+  InventoryVersions &operator=(const InventoryVersions &) = delete;
+
+  // Publishes the movie's current counters. Writer thread only.
+  void publish(Movie &movie);
+  // Publishes the catalog, in display order, that snapshots iterate.
+  // Every movie's counters must have been published. Writer thread only.
+  void publishCatalog(std::vector<const Movie *> catalog);
+
+  // Takes a snapshot of the current inventory. Safe from any thread.
+  InventorySnapshot snapshot() const;
+
+  // Returns the number of versions waiting to be recycled.
+  size_t retiredCount() const { return retired.size(); }
+
+private:
+  friend class InventorySnapshot;
+
+  static constexpr uint64_t FREE_SLOT = UINT64_MAX;
+  static constexpr size_t NODES_PER_CHUNK = 256;
+
+  struct Retired {
+    StockVersion *node;
+    uint64_t replacedAt;
+  };
+
+  std::atomic<uint64_t> clock{0};
+  // Version pinned by each live snapshot, or FREE_SLOT.
+  mutable std::atomic<uint64_t> readers[MAX_READERS];
+  // One past the highest reader slot ever used.
+  mutable std::atomic<size_t> readerSlots{0};
+  std::shared_ptr<const std::vector<const Movie *>> catalog;
+
+  std::deque<Retired> retired;
+  std::vector<StockVersion *> freeNodes;
+  std::vector<std::unique_ptr<StockVersion[]>> chunks;
+
+  // Returns an unused node, allocating a chunk if none is free.
+  StockVersion *allocate();
+  // Recycles retired versions no pinned snapshot can reach.
+  void reclaim();
+};
+
+// A consistent view of the inventory at one point in time. Holding it
+// never blocks the writer; releasing it lets the versions it pinned be
+// recycled.
+class InventorySnapshot {
+public:
+  // The state of one movie as of the snapshot.
+  struct Row {
+    const Movie *movie;
+    FormatCounts stock;
+    FormatCounts borrowed;
+  };
+
+  InventorySnapshot(InventorySnapshot &&other) noexcept;
+  InventorySnapshot &operator=(InventorySnapshot &&other) = delete;
+  InventorySnapshot(const InventorySnapshot &) = delete;
+  InventorySnapshot &operator=(const InventorySnapshot &) = delete;
+  // Unpins the snapshot's version.
+  ~InventorySnapshot();
+
+  // Returns the number of movies in the snapshot.
+  size_t size() const { return catalog ? catalog->size() : 0; }
+  // Returns the state of the i-th movie in display order.
+  Row row(size_t index) const;
+  // Returns the version the snapshot reads.
+  uint64_t getVersion() const { return version; }
+
+private:
+  friend class InventoryVersions;
+
+  InventorySnapshot(const InventoryVersions *owner, size_t slot,
+                    uint64_t version,
+                    std::shared_ptr<const std::vector<const Movie *>> catalog);
+
+  const InventoryVersions *owner;
+  size_t slot;
+  uint64_t version;
+  std::shared_ptr<const std::vector<const Movie *>> catalog;
+};
+
+#endif // INVENTORY_SNAPSHOT_H
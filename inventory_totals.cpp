@@ -0,0 +1,35 @@
+#include "inventory_totals.h"
+#include "memory_usage.h"
+
+// Finds or creates the genre and director groups.
+StockTally InventoryTotals::tally(char genre, const std::string &director) {
+  return StockTally{&genres[genre], &directors[director]};
+}
+
+// Returns one genre's totals, or sums every genre's.
+StockTotals InventoryTotals::genre(char genre) const {
+  StockTotals totals;
+  for (const auto &entry : genres) {
+    if (genre == 0 || entry.first == genre) {
+      totals += entry.second;
+    }
+  }
+  return totals;
+}
+
+// Looks up a director's totals.
+StockTotals InventoryTotals::director(const std::string &name) const {
+  auto it = directors.find(name);
+  return it == directors.end() ? StockTotals() : it->second;
+}
+
+// Returns the bytes of the tree and hash nodes and the director names.
+size_t InventoryTotals::memoryUsage() const {
+  size_t bytes = genres.size() * (4 * sizeof(void *) + sizeof(char) +
+                                  sizeof(StockTotals)) +
+                 hashNodeBytes(directors);
+  for (const auto &entry : directors) {
+    bytes += heapBytes(entry.first);
+  }
+  return bytes;
+}
@@ -0,0 +1,98 @@
+#ifndef INVENTORY_TOTALS_H
+#define INVENTORY_TOTALS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+// Stock counters summed over a group of titles.
+struct StockTotals {
+  int64_t titles = 0;
+  int64_t copies = 0;
+  int64_t out = 0;
+  // Titles that have copies and none of them on the shelf.
+  int64_t fullyOut = 0;
+
+  // Adds one title's counters, or removes them when `sign` is -1.
+  void add(int stock, int borrowed, int sign) {
+    titles += sign;
+    copies += sign * stock;
+    out += sign * borrowed;
+    fullyOut += sign * isFullyOut(stock, borrowed);
+  }
+  // Replaces one title's counters with new ones.
+  void change(int oldStock, int oldBorrowed, int stock, int borrowed) {
+    copies += stock - oldStock;
+    out += borrowed - oldBorrowed;
+    fullyOut += isFullyOut(stock, borrowed) - isFullyOut(oldStock, oldBorrowed);
+  }
+  // Adds the counters of another group.
+  StockTotals &operator+=(const StockTotals &other) {
+    titles += other.titles;
+    copies += other.copies;
+    out += other.out;
+    fullyOut += other.fullyOut;
+    return *this;
+  }
+  // Returns whether a title with these counters is fully checked out.
+  static int isFullyOut(int stock, int borrowed) {
+    return stock > 0 && borrowed >= stock ? 1 : 0;
+  }
+};
+
+// The groups one title is counted in. Empty for a title outside the
+// catalog, such as a retired one, whose counters then go uncounted.
+struct StockTally {
+  StockTotals *genre = nullptr;
+  StockTotals *director = nullptr;
+
+  // Adds a title's counters to its groups, or removes them for -1.
+  void add(int stock, int borrowed, int sign) const {
+    if (genre != nullptr) {
+      genre->add(stock, borrowed, sign);
+      director->add(stock, borrowed, sign);
+    }
+  }
+  // Replaces a title's counters in its groups with new ones.
+  void change(int oldStock, int oldBorrowed, int stock, int borrowed) const {
+    if (genre != nullptr) {
+      genre->change(oldStock, oldBorrowed, stock, borrowed);
+      director->change(oldStock, oldBorrowed, stock, borrowed);
+    }
+  }
+};
+
+// Stock totals of the catalog per genre and per director. The titles
+// keep them current themselves: each movie holds its tally and adjusts it
+// whenever a borrow, return or restock changes its counters, so a summary
+// costs the same however large the catalog is.
+class InventoryTotals {
+public:
+  // Returns the groups of a title of the genre and director, creating
+  // them if needed. Groups never move, so the tally stays valid.
+  StockTally tally(char genre, const std::string &director);
+
+  // Returns the totals of a genre, or of the whole catalog for genre 0.
+  StockTotals genre(char genre) const;
+  // Returns the totals of a director's titles.
+  StockTotals director(const std::string &name) const;
+  // Calls `visit` with each genre that has titles and its totals, in
+  // genre order.
+  template <typename Visit> void forEachGenre(Visit visit) const {
+    for (const auto &entry : genres) {
+      if (entry.second.titles > 0) {
+        visit(entry.first, entry.second);
+      }
+    }
+  }
+  // Returns the bytes held by the groups.
+  size_t memoryUsage() const;
+
+private:
+  std::map<char, StockTotals> genres;
+  std::unordered_map<std::string, StockTotals> directors;
+};
+
+#endif // INVENTORY_TOTALS_H
@@ -0,0 +1,243 @@
+#include "loadgen.h"
+#include "arg_parse.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// State of one client connection.
+struct Client {
+  int fd = -1;
+  size_t next = 0;
+  Clock::time_point sentAt;
+  std::string input;
+  std::string output;
+};
+
+// Sends as much of the client's queued output as the socket accepts.
+bool sendPending(Client &client) {
+  while (!client.output.empty()) {
+    ssize_t count = send(client.fd, client.output.data(),
+                         client.output.size(), MSG_NOSIGNAL);
+    if (count < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    client.output.erase(0, static_cast<size_t>(count));
+  }
+  return true;
+}
+
+// Returns the value at the given fraction of sorted samples.
+double percentile(std::vector<double> &samples, double fraction) {
+  if (samples.empty()) {
+    return 0.0;
+  }
+  auto index = static_cast<size_t>(fraction * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+} // namespace
+
+// Constructs a load generator.
+LoadGenerator::LoadGenerator(const Options &options,
+                             std::vector<std::string> commands)
+    : options(options), commands(std::move(commands)) {}
+
+// Opens the connections and keeps one command in flight on each until the
+// time is up.
+LoadGenerator::Report LoadGenerator::run() {
+  Report report;
+  if (commands.empty()) {
+    return report;
+  }
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options.port);
+  inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Client> clients(options.connections);
+  for (size_t i = 0; i < clients.size(); i++) {
+    Client &client = clients[i];
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address),
+                          sizeof(address)) < 0) {
+      std::cerr << "Error: connect: " << std::strerror(errno) << std::endl;
+      if (fd >= 0) {
+        close(fd);
+      }
+      break;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    client.fd = fd;
+    // Spread the connections over the command stream.
+    client.next = (i * commands.size()) / clients.size();
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = i;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    report.connected++;
+  }
+
+  std::vector<double> latencies;
+  auto sendNext = [&](Client &client) {
+    client.output += commands[client.next];
+    client.output += '\n';
+    client.next = (client.next + 1) % commands.size();
+    client.sentAt = Clock::now();
+    return sendPending(client);
+  };
+
+  auto start = Clock::now();
+  auto deadline =
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(options.seconds));
+  for (auto &client : clients) {
+    if (client.fd >= 0) {
+      sendNext(client);
+    }
+  }
+
+  epoll_event events[256];
+  while (Clock::now() < deadline) {
+    int ready = epoll_wait(epollFd, events, 256, 10);
+    for (int e = 0; e < ready; e++) {
+      Client &client = clients[events[e].data.u64];
+      if (client.fd < 0) {
+        continue;
+      }
+      char chunk[16 * 1024];
+      ssize_t count = read(client.fd, chunk, sizeof(chunk));
+      if (count <= 0) {
+        if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
+          continue;
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+        close(client.fd);
+        client.fd = -1;
+        continue;
+      }
+      client.input.append(chunk, static_cast<size_t>(count));
+
+      // A response ends with its status line.
+      size_t lineStart = 0;
+      size_t newline;
+      while ((newline = client.input.find('\n', lineStart)) !=
+             std::string::npos) {
+        std::string_view line(client.input.data() + lineStart,
+                              newline - lineStart);
+        lineStart = newline + 1;
+        if (line != "OK" && line != "ERR") {
+          continue;
+        }
+        auto now = Clock::now();
+        latencies.push_back(
+            std::chrono::duration<double, std::micro>(now - client.sentAt)
+                .count());
+        report.completed++;
+        if (line == "ERR") {
+          report.failed++;
+        }
+        client.input.erase(0, lineStart);
+        lineStart = 0;
+        if (now < deadline) {
+          sendNext(client);
+        }
+      }
+    }
+  }
+  report.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  for (auto &client : clients) {
+    if (client.fd >= 0) {
+      close(client.fd);
+    }
+  }
+  close(epollFd);
+
+  report.throughput = static_cast<double>(report.completed) / report.seconds;
+  report.p50Micros = percentile(latencies, 0.50);
+  report.p99Micros = percentile(latencies, 0.99);
+  report.maxMicros =
+      latencies.empty() ? 0.0
+                        : *std::max_element(latencies.begin(), latencies.end());
+  return report;
+}
+
+// Prints a load report.
+void LoadGenerator::print(const Report &report) {
+  std::cout << report.connected << " connections, " << report.completed
+            << " commands (" << report.failed << " ERR) in " << report.seconds
+            << " s: " << report.throughput << " commands/s, p50 "
+            << report.p50Micros << " us, p99 " << report.p99Micros
+            << " us, max " << report.maxMicros << " us" << std::endl;
+}
+
+/**
+ * Runs the load generator against a server on the loopback interface.
+ * Replays the lines of the given command file, data4commands.txt by
+ * default, over the given number of connections.
+ */
+int runLoadGenerator(int argc, char *argv[]) {
+  // Each connection holds a socket, so their number is capped.
+  const unsigned long maxConnections = 100000;
+  LoadGenerator::Options options;
+  unsigned long port = options.port;
+  auto connections = static_cast<unsigned long>(options.connections);
+  bool valid = argc <= 4;
+  if (argc > 0) {
+    valid = parseNumber(argv[0], 65535, port) && port > 0 && valid;
+  }
+  if (argc > 1) {
+    valid = parseNumber(argv[1], maxConnections, connections) &&
+            connections > 0 && valid;
+  }
+  if (argc > 2) {
+    valid = parsePositive(argv[2], options.seconds) && valid;
+  }
+  if (!valid) {
+    std::cerr << "Usage: loadgen [port] [connections] [seconds] [commands]"
+              << std::endl;
+    return 1;
+  }
+  options.port = static_cast<uint16_t>(port);
+  options.connections = static_cast<int>(connections);
+  std::string commandsFile = argc > 3 ? argv[3] : "data4commands.txt";
+
+  std::ifstream file(commandsFile);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << commandsFile << std::endl;
+    return 1;
+  }
+  std::vector<std::string> commands;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      commands.push_back(line);
+    }
+  }
+
+  LoadGenerator generator(options, commands);
+  LoadGenerator::print(generator.run());
+  return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Drives a CommandServer over many concurrent TCP connections. Each
+// connection sends one command at a time, waits for its status line and
+// records the round-trip latency.
+class LoadGenerator {
+public:
+  // Shape of the load.
+  struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 7070;
+    int connections = 1000;
+    double seconds = 5.0;
+  };
+
+  // Results of a run.
+  struct Report {
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    int connected = 0;
+    double seconds = 0.0;
+    double throughput = 0.0;
+    double p50Micros = 0.0;
+    double p99Micros = 0.0;
+    double maxMicros = 0.0;
+  };
+
+  // Constructs a generator that cycles through the given command lines.
+  LoadGenerator(const Options &options, std::vector<std::string> commands);
+
+  // Connects, runs the load for the configured time and reports.
+  Report run();
+  // Prints a report.
+  static void print(const Report &report);
+
+private:
+  Options options;
+  std::vector<std::string> commands;
+};
+
+// Command line entry point:
+// "loadgen [port] [connections] [seconds] [commands]".
+int runLoadGenerator(int argc, char *argv[]);
+
+#endif // LOADGEN_H
@@ -0,0 +1,221 @@
+#include "loan_tracker.h"
+#include "memory_usage.h"
+
+// Constructs a tracker with no loans at time 0.
+LoanTracker::LoanTracker() : lists(new Loan[OVERDUE + 1]) {
+  for (uint32_t i = 0; i <= OVERDUE; i++) {
+    lists[i].prev = &lists[i];
+    lists[i].next = &lists[i];
+  }
+}
+
+// Records a loan, appending it to the customer's open loans.
+void LoanTracker::open(CustomerHandle customer, const Movie *movie,
+                       MediaFormat format, uint64_t borrowedAt, uint64_t due) {
+  Loan *loan = allocate();
+  loan->customer = customer;
+  loan->format = format;
+  loan->movie = movie;
+  loan->borrowedAt = borrowedAt;
+  loan->due = due;
+  loan->newer = nullptr;
+
+  auto inserted = byCustomer.try_emplace(customer, CustomerLoans{loan, loan});
+  if (inserted.second) {
+    loan->older = nullptr;
+  } else {
+    CustomerLoans &loans = inserted.first->second;
+    loan->older = loans.newest;
+    loans.newest->newer = loan;
+    loans.newest = loan;
+  }
+
+  schedule(loan);
+  openLoans++;
+}
+
+// Closes the oldest loan of the movie in the format among the customer's
+// open loans.
+bool LoanTracker::close(CustomerHandle customer, const Movie *movie,
+                        MediaFormat format) {
+  auto it = byCustomer.find(customer);
+  if (it == byCustomer.end()) {
+    return false;
+  }
+  CustomerLoans &loans = it->second;
+  Loan *loan = loans.oldest;
+  while (loan != nullptr && (loan->movie != movie || loan->format != format)) {
+    loan = loan->newer;
+  }
+  if (loan == nullptr) {
+    return false;
+  }
+
+  if (loan->older != nullptr) {
+    loan->older->newer = loan->newer;
+  } else {
+    loans.oldest = loan->newer;
+  }
+  if (loan->newer != nullptr) {
+    loan->newer->older = loan->older;
+  } else {
+    loans.newest = loan->older;
+  }
+  if (loans.oldest == nullptr) {
+    byCustomer.erase(it);
+  }
+
+  unlink(loan);
+  freeLoans.push_back(loan);
+  openLoans--;
+  return true;
+}
+
+// Steps the clock from one non-empty slot to the next. At each step the
+// slots that start then are cascaded, highest level first, so a loan can
+// move down several levels and fall due within the same step.
+void LoanTracker::advance(uint64_t now) {
+  while (true) {
+    uint64_t next = nextEvent();
+    if (next > now) {
+      break;
+    }
+    current = next;
+
+    if ((current >> (LEVELS * SLOT_BITS) << (LEVELS * SLOT_BITS)) ==
+        current) {
+      cascade(FAR);
+    }
+    for (int level = LEVELS - 1; level >= 0; level--) {
+      int shift = level * SLOT_BITS;
+      if ((current >> shift << shift) != current) {
+        continue;
+      }
+      uint32_t slot = (current >> shift) & (SLOTS - 1);
+      if ((occupied[level] >> slot & 1) != 0) {
+        cascade(level * SLOTS + slot);
+      }
+    }
+  }
+  if (now > current) {
+    current = now;
+  }
+}
+
+// Returns the bytes of the loan chunks, the list heads, the free list and
+// the customer index.
+size_t LoanTracker::memoryUsage() const {
+  return (chunks.size() * LOANS_PER_CHUNK + OVERDUE + 1) * sizeof(Loan) +
+         heapBytes(chunks) + heapBytes(freeLoans) + hashNodeBytes(byCustomer);
+}
+
+// Takes a loan from the free list, allocating a new chunk when empty.
+Loan *LoanTracker::allocate() {
+  if (freeLoans.empty()) {
+    chunks.push_back(std::make_unique<Loan[]>(LOANS_PER_CHUNK));
+    Loan *chunk = chunks.back().get();
+    for (size_t i = LOANS_PER_CHUNK; i > 0; i--) {
+      freeLoans.push_back(&chunk[i - 1]);
+    }
+  }
+  Loan *loan = freeLoans.back();
+  freeLoans.pop_back();
+  return loan;
+}
+
+// Files a loan at the lowest level whose window, shared with the current
+// time, contains its due date. Its slot there is always ahead of the
+// current time's slot, so it is reached before the window ends.
+void LoanTracker::schedule(Loan *loan) {
+  if (loan->due <= current) {
+    link(loan, OVERDUE);
+    return;
+  }
+  for (int level = 0; level < LEVELS; level++) {
+    int windowShift = (level + 1) * SLOT_BITS;
+    if ((loan->due >> windowShift) == (current >> windowShift)) {
+      uint32_t slot = (loan->due >> (level * SLOT_BITS)) & (SLOTS - 1);
+      link(loan, level * SLOTS + slot);
+      return;
+    }
+  }
+  link(loan, FAR);
+}
+
+// Appends a loan to a list, marking a wheel slot occupied.
+void LoanTracker::link(Loan *loan, uint32_t list) {
+  Loan &head = lists[list];
+  loan->prev = head.prev;
+  loan->next = &head;
+  head.prev->next = loan;
+  head.prev = loan;
+  loan->list = list;
+  if (list < FAR) {
+    occupied[list / SLOTS] |= uint64_t{1} << (list % SLOTS);
+  } else if (list == OVERDUE) {
+    overdueLoans++;
+  }
+}
+
+// Removes a loan from its list, marking a wheel slot free once empty.
+void LoanTracker::unlink(Loan *loan) {
+  loan->prev->next = loan->next;
+  loan->next->prev = loan->prev;
+  uint32_t list = loan->list;
+  if (list < FAR) {
+    if (lists[list].next == &lists[list]) {
+      occupied[list / SLOTS] &= ~(uint64_t{1} << (list % SLOTS));
+    }
+  } else if (list == OVERDUE) {
+    overdueLoans--;
+  }
+}
+
+// Empties a list, then files each of its loans again against the current
+// time, in their order in the list.
+void LoanTracker::cascade(uint32_t list) {
+  Loan &head = lists[list];
+  if (head.next == &head) {
+    return;
+  }
+  Loan *loan = head.next;
+  head.prev->next = nullptr;
+  head.prev = &head;
+  head.next = &head;
+  if (list < FAR) {
+    occupied[list / SLOTS] &= ~(uint64_t{1} << (list % SLOTS));
+  }
+
+  while (loan != nullptr) {
+    Loan *next = loan->next;
+    schedule(loan);
+    loan = next;
+  }
+}
+
+// Finds the earliest slot start among the non-empty slots. Every occupied
+// slot lies ahead of the current time's slot in the current window of its
+// level, so its lowest occupied slot is the level's next event.
+uint64_t LoanTracker::nextEvent() const {
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < LEVELS; level++) {
+    if (occupied[level] == 0) {
+      continue;
+    }
+    int shift = level * SLOT_BITS;
+    int windowShift = shift + SLOT_BITS;
+    uint64_t window = current >> windowShift << windowShift;
+    uint64_t slot = __builtin_ctzll(occupied[level]);
+    if (window + (slot << shift) < next) {
+      next = window + (slot << shift);
+    }
+  }
+  if (lists[FAR].next != &lists[FAR]) {
+    int topShift = LEVELS * SLOT_BITS;
+    uint64_t topWindow = ((current >> topShift) + 1) << topShift;
+    if (topWindow < next) {
+      next = topWindow;
+    }
+  }
+  return next;
+}
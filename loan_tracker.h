@@ -0,0 +1,122 @@
+#ifndef LOAN_TRACKER_H
+#define LOAN_TRACKER_H
+
+#include "customer.h"
+#include "media_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class Movie;
+
+// One borrowed copy that has not been returned yet. Times are in the
+// store's logical clock.
+struct Loan {
+  CustomerHandle customer;
+  MediaFormat format;
+  const Movie *movie;
+  uint64_t borrowedAt;
+  uint64_t due;
+
+private:
+  friend class LoanTracker;
+
+  // Links in the wheel slot, or the overdue list, holding the loan.
+  Loan *prev;
+  Loan *next;
+  uint32_t list;
+  // Links in the customer's open loans, oldest first.
+  Loan *older;
+  Loan *newer;
+};
+
+// Open loans ordered by due date in a hierarchical timer wheel, so finding
+// the loans that fell due costs time proportional to their number rather
+// than to the number of open loans.
+//
+// Level 0 has one slot per tick and each higher level one slot per span
+// of the level below. A loan sits at the lowest level whose span covers
+// its due date, in the same window as the current time; when the clock
+// reaches the start of its slot it moves down a level, and when it
+// reaches its due date it moves to the overdue list. Occupancy bitmaps
+// let the clock jump straight to the next non-empty slot.
+class LoanTracker {
+public:
+  LoanTracker();
+  LoanTracker(const LoanTracker &) = delete;
+  LoanTracker &operator=(const LoanTracker &) = delete;
+
+  // Records a loan of a copy in the format due at the given time.
+  void open(CustomerHandle customer, const Movie *movie, MediaFormat format,
+            uint64_t borrowedAt, uint64_t due);
+  // Closes the customer's oldest open loan of the movie in the format.
+  // Returns false if there is none.
+  bool close(CustomerHandle customer, const Movie *movie, MediaFormat format);
+
+  // Moves the clock forward, moving the loans that fall due by then to
+  // the overdue list.
+  void advance(uint64_t now);
+  // Returns the time the tracker has advanced to.
+  uint64_t getTime() const { return current; }
+
+  // Calls `visit` on each overdue loan, in the order they fell due.
+  template <typename Visit> void forEachOverdue(Visit visit) const {
+    for (const Loan *loan = lists[OVERDUE].next; loan != &lists[OVERDUE];
+         loan = loan->next) {
+      visit(*loan);
+    }
+  }
+  // Returns the number of open loans, overdue or not.
+  size_t openCount() const { return openLoans; }
+  // Returns the number of overdue loans.
+  size_t overdueCount() const { return overdueLoans; }
+  // Returns the bytes held by the loans, the lists and the customer index.
+  size_t memoryUsage() const;
+
+private:
+  static constexpr int SLOT_BITS = 6;
+  static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+  static constexpr int LEVELS = 6;
+  // Lists after the wheel slots: loans due beyond the top level's window,
+  // and loans already due.
+  static constexpr uint32_t FAR = LEVELS * SLOTS;
+  static constexpr uint32_t OVERDUE = FAR + 1;
+  static constexpr size_t LOANS_PER_CHUNK = 4096;
+
+  uint64_t current = 0;
+  size_t openLoans = 0;
+  size_t overdueLoans = 0;
+  // Circular list heads: the wheel slots, FAR and OVERDUE.
+  std::unique_ptr<Loan[]> lists;
+  // Bit s of occupied[l] is set if slot s of level l is non-empty.
+  uint64_t occupied[LEVELS] = {};
+
+  // Oldest and newest open loan of each customer with any.
+  struct CustomerLoans {
+    Loan *oldest;
+    Loan *newest;
+  };
+  std::unordered_map<CustomerHandle, CustomerLoans> byCustomer;
+
+  std::vector<Loan *> freeLoans;
+  std::vector<std::unique_ptr<Loan[]>> chunks;
+
+  // Returns an unused loan, allocating a chunk if none is free.
+  Loan *allocate();
+  // Files a loan in the slot its due date falls in, relative to the
+  // current time.
+  void schedule(Loan *loan);
+  // Appends a loan to a list.
+  void link(Loan *loan, uint32_t list);
+  // Removes a loan from its list.
+  void unlink(Loan *loan);
+  // Reschedules every loan of a list.
+  void cascade(uint32_t list);
+  // Returns the next time after the current one at which a non-empty
+  // slot must be cascaded or expired, or UINT64_MAX if there is none.
+  uint64_t nextEvent() const;
+};
+
+#endif // LOAN_TRACKER_H
@@ -1,15 +1,64 @@
+#include "trace.h"
 #include <iostream>
+#include <string>
 using namespace std;
 
-void testAll();
+bool testAll();
+int runBenchmarks(int argc, char *argv[]);
+int runServer(int argc, char *argv[]);
+int runLoadGenerator(int argc, char *argv[]);
+int runReplay(int argc, char *argv[]);
+int runSimulation(int argc, char *argv[]);
+int runIngest(int argc, char *argv[]);
+
+// Runs the mode selected by the arguments.
+int runMode(int argc, char *argv[]) {
+  if (argc > 1 && string(argv[1]) == "bench") {
+    return runBenchmarks(argc - 2, argv + 2);
+  }
+  if (argc > 1 && string(argv[1]) == "serve") {
+    return runServer(argc - 2, argv + 2);
+  }
+  if (argc > 1 && string(argv[1]) == "loadgen") {
+    return runLoadGenerator(argc - 2, argv + 2);
+  }
+  if (argc > 1 && string(argv[1]) == "replay") {
+    return runReplay(argc - 2, argv + 2);
+  }
+  if (argc > 1 && string(argv[1]) == "simulate") {
+    return runSimulation(argc - 2, argv + 2);
+  }
+  if (argc > 1 && string(argv[1]) == "ingest") {
+    return runIngest(argc - 2, argv + 2);
+  }
 
-// Main function to run the movie store simulation.
-int main() {
   std::cout
       << ">>>>>> HELLO! THIS IS THE NEW, UPDATED VERSION OF THE PROGRAM! <<<<<<"
       << std::endl;
 
-  testAll();
+  bool passed = testAll();
   cout << "Done." << endl;
-  return 0;
-}
\ No newline at end of file
+  return passed ? 0 : 1;
+}
+
+// Main function to run the movie store simulation.
+// "bench [name...]" runs the benchmarks, "serve ..." the command server,
+// "loadgen ..." a load generator for it, "replay ..." a timed replay of a
+// command file, "simulate ..." what-if stock scenarios and "ingest ..."
+// several command files at once instead. A leading "--trace file" records
+// trace spans while the mode runs and writes them to the file as Chrome
+// trace-event JSON.
+int main(int argc, char *argv[]) {
+  if (argc > 2 && string(argv[1]) == "--trace") {
+    string path = argv[2];
+    argv[2] = argv[0];
+    Tracer::nameThread("main");
+    Tracer::start();
+    int status = runMode(argc - 2, argv + 2);
+    if (!Tracer::stop(path)) {
+      status = 1;
+    }
+    return status;
+  }
+  return runMode(argc, argv);
+}
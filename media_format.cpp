@@ -0,0 +1,23 @@
+#include "media_format.h"
+#include <algorithm>
+#include <string>
+
+// Reads each count the way the single stock number always was, with
+// std::stoi, so existing files parse exactly as before.
+bool parseFormatCounts(std::string_view text, FormatCounts &counts) {
+  counts.fill(0);
+  size_t start = 0;
+  for (int format = 0; format < MEDIA_FORMATS; format++) {
+    size_t end = std::min(text.find('/', start), text.size());
+    try {
+      counts[format] = std::stoi(std::string(text.substr(start, end - start)));
+    } catch (...) {
+      return false;
+    }
+    if (end == text.size()) {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
@@ -0,0 +1,64 @@
+#ifndef MEDIA_FORMAT_H
+#define MEDIA_FORMAT_H
+
+#include "format_buffer.h"
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Media formats a title is carried in. The values index per-format
+// counters, so they stay dense and start at 0.
+enum MediaFormat : uint8_t { DVD, BLU_RAY, DIGITAL };
+constexpr int MEDIA_FORMATS = 3;
+
+// Copies of a title in each format.
+using FormatCounts = std::array<int, MEDIA_FORMATS>;
+
+// Returns the format of a command's media type: 'D' for DVD, 'B' for
+// Blu-ray and 'L' for a digital license. Returns -1 for any other code.
+inline int mediaFormat(char code) {
+  switch (code) {
+  case 'D':
+    return DVD;
+  case 'B':
+    return BLU_RAY;
+  case 'L':
+    return DIGITAL;
+  default:
+    return -1;
+  }
+}
+
+// Returns the media type code of a format.
+inline char mediaCode(MediaFormat format) { return "DBL"[format]; }
+
+// Returns the name of a format as reports show it.
+inline const char *mediaName(MediaFormat format) {
+  static const char *const names[MEDIA_FORMATS] = {"DVD", "Blu-ray",
+                                                   "Digital"};
+  return names[format];
+}
+
+// Appends " (format)" after a title for any format but DVD, so output
+// about DVDs reads as it did before there were other formats.
+inline void appendMediaFormat(FormatBuffer &buffer, MediaFormat format) {
+  if (format != DVD) {
+    buffer << " (" << mediaName(format) << ')';
+  }
+}
+
+// Returns the copies summed over every format.
+inline int totalCount(const FormatCounts &counts) {
+  int total = 0;
+  for (int count : counts) {
+    total += count;
+  }
+  return total;
+}
+
+// Parses the stock field of a movie file line: "dvd[/bluray[/digital]]",
+// formats left out having no copies. Returns false if a count is not a
+// number or there are more than MEDIA_FORMATS of them.
+bool parseFormatCounts(std::string_view text, FormatCounts &counts);
+
+#endif // MEDIA_FORMAT_H
@@ -0,0 +1,36 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Helpers for the store's memory accounting. Estimates count objects and
+// the buffers they own at their capacity, but not allocator overhead.
+
+// Returns the bytes a string holds outside the object, 0 if its characters
+// fit in the object's inline buffer.
+inline size_t heapBytes(const std::string &text) {
+  const char *data = text.data();
+  const char *object = reinterpret_cast<const char *>(&text);
+  if (data >= object && data < object + sizeof(text)) {
+    return 0;
+  }
+  return text.capacity() + 1;
+}
+
+// Returns the bytes a vector holds outside the object, not counting what
+// its elements own.
+template <typename T> size_t heapBytes(const std::vector<T> &items) {
+  return items.capacity() * sizeof(T);
+}
+
+// Returns the bytes a node-based unordered container holds outside the
+// object: its bucket array and one node per element, not counting what
+// the elements own.
+template <typename Map> size_t hashNodeBytes(const Map &map) {
+  return map.bucket_count() * sizeof(void *) +
+         map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void *));
+}
+
+#endif // MEMORY_USAGE_H
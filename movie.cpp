@@ -1,7 +1,64 @@
 #include "movie.h"
+#include "memory_usage.h"
 #include "movie_factory.h"
-#include <iostream>
-#include <sstream>
+#include <cctype>
+#include <climits>
+
+namespace {
+
+// Returns true for the characters that separate the fields of a Classic
+// record.
+bool isSeparator(char ch) {
+  return ch == ',' || std::isspace(static_cast<unsigned char>(ch));
+}
+
+// Skips separators.
+void skipSeparators(std::string_view text, size_t &pos) {
+  while (pos < text.size() && isSeparator(text[pos])) {
+    pos++;
+  }
+}
+
+// Reads the next run of characters up to a separator.
+bool readWord(std::string_view text, size_t &pos, std::string_view &word) {
+  skipSeparators(text, pos);
+  size_t start = pos;
+  while (pos < text.size() && !isSeparator(text[pos])) {
+    pos++;
+  }
+  word = text.substr(start, pos - start);
+  return pos > start;
+}
+
+// Reads an optional sign and decimal digits, stopping at the first other
+// character. Fails if there are no digits or the value overflows an int.
+bool readInt(std::string_view text, size_t &pos, int &value) {
+  skipSeparators(text, pos);
+  bool negative = false;
+  if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+    negative = text[pos] == '-';
+    pos++;
+  }
+  size_t start = pos;
+  long long magnitude = 0;
+  bool overflow = false;
+  while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+    magnitude = magnitude * 10 + (text[pos] - '0');
+    if (magnitude > static_cast<long long>(INT_MAX) + 1) {
+      overflow = true;
+      magnitude = 0;
+    }
+    pos++;
+  }
+  long long signedValue = negative ? -magnitude : magnitude;
+  if (pos == start || overflow || signedValue > INT_MAX) {
+    return false;
+  }
+  value = static_cast<int>(signedValue);
+  return true;
+}
+
+} // namespace
 
 bool Comedy::registered = Comedy::registerSelf();
 bool Drama::registered = Drama::registerSelf();
@@ -9,26 +66,54 @@ bool Classic::registered = Classic::registerSelf();
 
 // Constructs a Movie object.
 Movie::Movie(int stock, const std::string &director, const std::string &title)
-    : stock(stock), borrowed(0), director(director), title(title) {}
-
-// Decrements stock and increments borrowed count.
-bool Movie::borrowMovie() {
-  if (stock > borrowed) {
-    borrowed++;
+    : stock{stock}, borrowed{}, director(director), title(title) {}
+
+// Increments the format's borrowed count if a copy is on the shelf,
+// updating the catalog totals.
+bool Movie::borrowMovie(MediaFormat format) {
+  if (stock[format] > borrowed[format]) {
+    int out = totalCount(borrowed);
+    tally.change(totalCount(stock), out, totalCount(stock), out + 1);
+    borrowed[format]++;
     return true;
   }
   return false;
 }
 
-// Increments stock and decrements borrowed count.
-bool Movie::returnMovie() {
-  if (borrowed > 0) {
-    borrowed--;
+// Decrements the format's borrowed count, updating the catalog totals.
+bool Movie::returnMovie(MediaFormat format) {
+  if (borrowed[format] > 0) {
+    int out = totalCount(borrowed);
+    tally.change(totalCount(stock), out, totalCount(stock), out - 1);
+    borrowed[format]--;
     return true;
   }
   return false;
 }
 
+// Returns a string representation of a movie with given counters.
+std::string Movie::toString(const FormatCounts &stockCounts,
+                            const FormatCounts &borrowedCounts) const {
+  FormatBuffer buffer;
+  formatTo(buffer, stockCounts, borrowedCounts);
+  return buffer.str();
+}
+
+// Appends " Stock: N Out: M" for the DVDs, then the same after the name
+// of each other format with copies owned or out.
+void Movie::formatCounts(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                         const FormatCounts &borrowedCounts) {
+  buffer << " Stock: " << stockCounts[DVD] - borrowedCounts[DVD]
+         << " Out: " << borrowedCounts[DVD];
+  for (int format = BLU_RAY; format < MEDIA_FORMATS; format++) {
+    if (stockCounts[format] != 0 || borrowedCounts[format] != 0) {
+      buffer << ' ' << mediaName(static_cast<MediaFormat>(format))
+             << " Stock: " << stockCounts[format] - borrowedCounts[format]
+             << " Out: " << borrowedCounts[format];
+    }
+  }
+}
+
 // Constructs a Comedy movie.
 Comedy::Comedy(int stock, const std::string &director, const std::string &title,
                int year)
@@ -57,16 +142,36 @@ bool Comedy::operator==(const Movie &other) const {
   return title == otherComedy->title && year == otherComedy->year;
 }
 
-// Returns a string representation of a Comedy movie.
-std::string Comedy::toString() const {
-  return "Comedy: " + title + " (" + std::to_string(year) +
-         ") Dir: " + director + " Stock: " + std::to_string(stock - borrowed) +
-         " Out: " + std::to_string(borrowed);
+// Appends the inventory line of a Comedy movie with given counters.
+void Comedy::formatTo(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                      const FormatCounts &borrowedCounts) const {
+  buffer << "Comedy: " << title << " (" << year << ") Dir: " << director;
+  formatCounts(buffer, stockCounts, borrowedCounts);
 }
 
 // Creates a clone of a Comedy movie.
 Movie *Comedy::clone() const {
-  return new Comedy(stock, director, title, year);
+  Comedy *copy = new Comedy(0, director, title, year);
+  copy->stock = stock;
+  return copy;
+}
+
+// Returns the catalog key of a Comedy movie.
+std::string Comedy::getKey() const { return makeKey(title, year); }
+
+// Returns the bytes of a Comedy movie and its strings.
+size_t Comedy::memoryUsage() const {
+  return sizeof(Comedy) + heapBytes(director) + heapBytes(title);
+}
+
+// Builds a Comedy key from its title and year.
+std::string Comedy::makeKey(std::string_view title, int year) {
+  std::string key(1, 'F');
+  key += KEY_SEPARATOR;
+  key += title;
+  key += KEY_SEPARATOR;
+  key += std::to_string(year);
+  return key;
 }
 
 // Factory method to create a Comedy movie.
@@ -76,14 +181,24 @@ Movie *Comedy::create(int stock, const std::string &director,
     int year = std::stoi(extra);
     return new Comedy(stock, director, title, year);
   } catch (...) {
-    std::cerr << "Error: Invalid year for comedy: " << extra << std::endl;
     return nullptr;
   }
 }
 
+// Builds the key of a Comedy record without creating the movie.
+std::string Comedy::recordKey(std::string_view /*director*/,
+                              std::string_view title, std::string_view extra) {
+  try {
+    return makeKey(title, std::stoi(std::string(extra)));
+  } catch (...) {
+    return "";
+  }
+}
+
 // Registers the Comedy movie type with the factory.
 bool Comedy::registerSelf() {
-  return MovieFactory::getInstance().registerMovie('F', Comedy::create);
+  return MovieFactory::getInstance().registerMovie('F', Comedy::create,
+                                                   Comedy::recordKey);
 }
 
 // Constructs a Drama movie.
@@ -114,15 +229,38 @@ bool Drama::operator==(const Movie &other) const {
   return director == otherDrama->director && title == otherDrama->title;
 }
 
-// Returns a string representation of a Drama movie.
-std::string Drama::toString() const {
-  return "Drama: " + director + ", " + title + " (" + std::to_string(year) +
-         ") Stock: " + std::to_string(stock - borrowed) +
-         " Out: " + std::to_string(borrowed);
+// Appends the inventory line of a Drama movie with given counters.
+void Drama::formatTo(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                     const FormatCounts &borrowedCounts) const {
+  buffer << "Drama: " << director << ", " << title << " (" << year << ")";
+  formatCounts(buffer, stockCounts, borrowedCounts);
 }
 
 // Creates a clone of a Drama movie.
-Movie *Drama::clone() const { return new Drama(stock, director, title, year); }
+Movie *Drama::clone() const {
+  Drama *copy = new Drama(0, director, title, year);
+  copy->stock = stock;
+  return copy;
+}
+
+// Returns the catalog key of a Drama movie.
+std::string Drama::getKey() const { return makeKey(director, title); }
+
+// Returns the bytes of a Drama movie and its strings.
+size_t Drama::memoryUsage() const {
+  return sizeof(Drama) + heapBytes(director) + heapBytes(title);
+}
+
+// Builds a Drama key from its director and title.
+std::string Drama::makeKey(std::string_view director,
+                           std::string_view title) {
+  std::string key(1, 'D');
+  key += KEY_SEPARATOR;
+  key += director;
+  key += KEY_SEPARATOR;
+  key += title;
+  return key;
+}
 
 // Factory method to create a Drama movie.
 Movie *Drama::create(int stock, const std::string &director,
@@ -131,14 +269,26 @@ Movie *Drama::create(int stock, const std::string &director,
     int year = std::stoi(extra);
     return new Drama(stock, director, title, year);
   } catch (...) {
-    std::cerr << "Error: Invalid year for drama: " << extra << std::endl;
     return nullptr;
   }
 }
 
+// Builds the key of a Drama record without creating the movie. The year
+// is not part of the key but must still be valid.
+std::string Drama::recordKey(std::string_view director,
+                             std::string_view title, std::string_view extra) {
+  try {
+    std::stoi(std::string(extra));
+  } catch (...) {
+    return "";
+  }
+  return makeKey(director, title);
+}
+
 // Registers the Drama movie type with the factory.
 bool Drama::registerSelf() {
-  return MovieFactory::getInstance().registerMovie('D', Drama::create);
+  return MovieFactory::getInstance().registerMovie('D', Drama::create,
+                                                   Drama::recordKey);
 }
 
 // Constructs a Classic movie.
@@ -174,48 +324,90 @@ bool Classic::operator==(const Movie &other) const {
          actor == otherClassic->actor;
 }
 
-// Returns a string representation of a Classic movie.
-std::string Classic::toString() const {
-  return "Classic: " + std::to_string(month) + " " + std::to_string(year) +
-         " " + actor + " - " + title + " Dir: " + director +
-         " Stock: " + std::to_string(stock - borrowed) +
-         " Out: " + std::to_string(borrowed);
+// Appends the inventory line of a Classic movie with given counters.
+void Classic::formatTo(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                       const FormatCounts &borrowedCounts) const {
+  buffer << "Classic: " << month << " " << year << " " << actor << " - "
+         << title << " Dir: " << director;
+  formatCounts(buffer, stockCounts, borrowedCounts);
 }
 
 // Creates a clone of a Classic movie.
 Movie *Classic::clone() const {
-  return new Classic(stock, director, title, actor, month, year);
+  Classic *copy = new Classic(0, director, title, actor, month, year);
+  copy->stock = stock;
+  return copy;
+}
+
+// Returns the catalog key of a Classic movie.
+std::string Classic::getKey() const { return makeKey(month, year, actor); }
+
+// Returns the bytes of a Classic movie and its strings.
+size_t Classic::memoryUsage() const {
+  return sizeof(Classic) + heapBytes(director) + heapBytes(title) +
+         heapBytes(actor);
+}
+
+// Builds a Classic key from its release month, year and major actor.
+std::string Classic::makeKey(int month, int year, std::string_view actor) {
+  std::string key(1, 'C');
+  key += KEY_SEPARATOR;
+  key += std::to_string(month);
+  key += KEY_SEPARATOR;
+  key += std::to_string(year);
+  key += KEY_SEPARATOR;
+  key += actor;
+  return key;
 }
 
 // Factory method to create a Classic movie.
 Movie *Classic::create(int stock, const std::string &director,
                        const std::string &title, const std::string &extra) {
-  std::string parseStr = extra;
-
-  for (char &c : parseStr) {
-    if (c == ',') {
-      c = ' ';
-    }
+  std::string actor;
+  int month;
+  int year;
+  if (!parseExtra(extra, actor, month, year)) {
+    return nullptr;
   }
+  return new Classic(stock, director, title, actor, month, year);
+}
 
-  std::istringstream iss(parseStr);
-  std::string firstName;
-  std::string lastName;
+// Builds the key of a Classic record without creating the movie.
+std::string Classic::recordKey(std::string_view /*director*/,
+                               std::string_view /*title*/,
+                               std::string_view extra) {
+  std::string actor;
   int month;
   int year;
+  if (!parseExtra(extra, actor, month, year)) {
+    return "";
+  }
+  return makeKey(month, year, actor);
+}
 
-  if (!(iss >> firstName >> lastName >> month >> year)) {
-    std::cerr << "Error: Invalid classic movie format: " << extra << std::endl;
-    return nullptr;
+// Parses the actor and release date of a Classic record, reading it the
+// way stream extraction of two words and two ints would, with commas
+// counting as spaces.
+bool Classic::parseExtra(std::string_view extra, std::string &actor,
+                         int &month, int &year) {
+  size_t pos = 0;
+  std::string_view firstName;
+  std::string_view lastName;
+  if (!readWord(extra, pos, firstName) || !readWord(extra, pos, lastName) ||
+      !readInt(extra, pos, month) || !readInt(extra, pos, year)) {
+    return false;
   }
 
-  std::string actor = firstName + " " + lastName;
-  return new Classic(stock, director, title, actor, month, year);
+  actor.assign(firstName);
+  actor += ' ';
+  actor += lastName;
+  return true;
 }
 
 // Registers the Classic movie type with the factory.
 bool Classic::registerSelf() {
-  return MovieFactory::getInstance().registerMovie('C', Classic::create);
+  return MovieFactory::getInstance().registerMovie('C', Classic::create,
+                                                   Classic::recordKey);
 }
 
 // Returns the singleton instance of the MovieFactory.
@@ -224,9 +416,11 @@ MovieFactory &MovieFactory::getInstance() {
   return instance;
 }
 
-// Registers a new movie type with its creation function.
-bool MovieFactory::registerMovie(char genre, CreateFunction func) {
+// Registers a new movie type with its creation and key functions.
+bool MovieFactory::registerMovie(char genre, CreateFunction func,
+                                 KeyFunction key) {
   creators[genre] = func;
+  keys[genre] = key;
   return true;
 }
 
@@ -240,4 +434,20 @@ Movie *MovieFactory::createMovie(char genre, int stock,
     return it->second(stock, director, title, extra);
   }
   return nullptr;
-}
\ No newline at end of file
+}
+
+// Checks whether a movie type is registered for the genre.
+bool MovieFactory::hasGenre(char genre) const {
+  return creators.find(genre) != creators.end();
+}
+
+// Builds the key of a movie record based on its genre and data.
+std::string MovieFactory::recordKey(char genre, std::string_view director,
+                                    std::string_view title,
+                                    std::string_view extra) const {
+  auto it = keys.find(genre);
+  if (it != keys.end()) {
+    return it->second(director, title, extra);
+  }
+  return "";
+}
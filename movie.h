@@ -1,13 +1,22 @@
 #ifndef MOVIE_H
 #define MOVIE_H
 
+#include "format_buffer.h"
+#include "inventory_totals.h"
+#include "media_format.h"
+#include <atomic>
+#include <cstddef>
 #include <iostream>
 #include <string>
+#include <string_view>
+
+struct StockVersion;
 
 // Abstract base class for all movie types.
 class Movie {
 public:
-  // Constructs a new Movie object.
+  // Constructs a new Movie object with `stock` DVDs and no copies in
+  // other formats.
   Movie(int stock, const std::string &director, const std::string &title);
   virtual ~Movie() = default;
 
@@ -16,31 +25,93 @@ public:
   // Defines the equality comparison.
   virtual bool operator==(const Movie &other) const = 0;
   // Returns a string representation of the movie.
-  virtual std::string toString() const = 0;
+  std::string toString() const { return toString(stock, borrowed); }
+  // Returns a string representation of the movie with the given counters.
+  std::string toString(const FormatCounts &stockCounts,
+                       const FormatCounts &borrowedCounts) const;
+  // Appends the inventory line of the movie to a buffer.
+  void formatTo(FormatBuffer &buffer) const {
+    formatTo(buffer, stock, borrowed);
+  }
+  // Appends the inventory line of the movie with the given counters.
+  virtual void formatTo(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                        const FormatCounts &borrowedCounts) const = 0;
   // Returns the genre character of the movie.
   virtual char getGenre() const = 0;
+  // Returns the release year of the movie.
+  virtual int getYear() const = 0;
   // Creates a copy of the movie object.
   virtual Movie *clone() const = 0;
+  // Returns the key that identifies the movie within the catalog. Two
+  // movies have the same key exactly when they compare equal.
+  virtual std::string getKey() const = 0;
+  // Returns the bytes held by the movie object and its strings.
+  virtual size_t memoryUsage() const = 0;
 
-  // Processes a borrow transaction for this movie.
-  bool borrowMovie();
-  // Processes a return transaction for this movie.
-  bool returnMovie();
-  // Gets the current stock of the movie.
-  int getStock() const { return stock; }
-  // Gets the number of borrowed copies.
-  int getBorrowed() const { return borrowed; }
+  // Processes a borrow transaction for a copy in the given format.
+  bool borrowMovie(MediaFormat format);
+  // Processes a return transaction for a copy in the given format.
+  bool returnMovie(MediaFormat format);
+  // Gets the number of copies owned in a format.
+  int getStock(MediaFormat format) const { return stock[format]; }
+  // Gets the number of copies owned in each format.
+  const FormatCounts &getStock() const { return stock; }
+  // Sets the number of copies owned in each format; borrowed copies stay
+  // borrowed.
+  void setStock(const FormatCounts &counts) {
+    tally.change(totalCount(stock), totalCount(borrowed), totalCount(counts),
+                 totalCount(borrowed));
+    stock = counts;
+  }
+  // Gets the number of borrowed copies in a format.
+  int getBorrowed(MediaFormat format) const { return borrowed[format]; }
+  // Gets the number of borrowed copies in each format.
+  const FormatCounts &getBorrowed() const { return borrowed; }
+  // Adds the movie's counters, summed over the formats, to the groups of
+  // the tally and keeps them current from then on.
+  void attachTotals(StockTally groups) {
+    tally = groups;
+    tally.add(totalCount(stock), totalCount(borrowed), 1);
+  }
+  // Removes the movie's counters from its groups and stops updating them.
+  void detachTotals() {
+    tally.add(totalCount(stock), totalCount(borrowed), -1);
+    tally = StockTally();
+  }
+  // Gets the latest published version of the stock counters.
+  const StockVersion *getPublishedStock() const {
+    return publishedStock.load(std::memory_order_acquire);
+  }
+  // Sets the latest published version of the stock counters.
+  void setPublishedStock(const StockVersion *version) {
+    publishedStock.store(version, std::memory_order_release);
+  }
 
   // Gets the director of the movie.
   const std::string &getDirector() const { return director; }
   // Gets the title of the movie.
   const std::string &getTitle() const { return title; }
 
+  // Separates the fields of a movie key.
+  static constexpr char KEY_SEPARATOR = '\x1f';
+
 protected:
-  int stock;
-  int borrowed;
+  // Copies owned and copies out, indexed by MediaFormat.
+  FormatCounts stock;
+  FormatCounts borrowed;
   std::string director;
   std::string title;
+
+  // Appends the stock and out counts of an inventory line: those of the
+  // DVDs, then those of each other format the title has copies in.
+  static void formatCounts(FormatBuffer &buffer,
+                           const FormatCounts &stockCounts,
+                           const FormatCounts &borrowedCounts);
+
+private:
+  std::atomic<const StockVersion *> publishedStock{nullptr};
+  // Catalog totals the movie is counted in.
+  StockTally tally;
 };
 
 // Represents a Comedy movie (genre 'F').
@@ -54,19 +125,30 @@ public:
   bool operator<(const Movie &other) const override;
   // Checks if this Comedy movie is equal to another movie.
   bool operator==(const Movie &other) const override;
-  // Returns a string representation of the Comedy movie.
-  std::string toString() const override;
+  // Appends the inventory line of the Comedy movie to a buffer.
+  void formatTo(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                const FormatCounts &borrowedCounts) const override;
   // Returns the genre character for Comedy movies.
   char getGenre() const override { return 'F'; }
   // Creates a clone of this Comedy movie object.
   Movie *clone() const override;
+  // Returns the catalog key of this Comedy movie.
+  std::string getKey() const override;
+  // Returns the bytes held by this Comedy movie.
+  size_t memoryUsage() const override;
+  // Returns the catalog key of the Comedy movie with the given title and year.
+  static std::string makeKey(std::string_view title, int year);
 
   // Gets the release year of the comedy.
-  int getYear() const { return year; }
+  int getYear() const override { return year; }
 
   // Factory method to create a Comedy movie from a string.
   static Movie *create(int stock, const std::string &director,
                        const std::string &title, const std::string &extra);
+  // Returns the catalog key of the Comedy movie create would build from
+  // the same fields, or an empty string if it would fail.
+  static std::string recordKey(std::string_view director,
+                               std::string_view title, std::string_view extra);
   // Registers the Comedy movie type with the factory.
   static bool registerSelf();
 
@@ -86,19 +168,32 @@ public:
   bool operator<(const Movie &other) const override;
   // Checks if this Drama movie is equal to another movie.
   bool operator==(const Movie &other) const override;
-  // Returns a string representation of the Drama movie.
-  std::string toString() const override;
+  // Appends the inventory line of the Drama movie to a buffer.
+  void formatTo(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                const FormatCounts &borrowedCounts) const override;
   // Returns the genre character for Drama movies.
   char getGenre() const override { return 'D'; }
   // Creates a clone of this Drama movie object.
   Movie *clone() const override;
+  // Returns the catalog key of this Drama movie.
+  std::string getKey() const override;
+  // Returns the bytes held by this Drama movie.
+  size_t memoryUsage() const override;
+  // Returns the catalog key of the Drama movie with the given director and
+  // title.
+  static std::string makeKey(std::string_view director,
+                             std::string_view title);
 
   // Gets the release year of the drama.
-  int getYear() const { return year; }
+  int getYear() const override { return year; }
 
   // Factory method to create a Drama movie from a string.
   static Movie *create(int stock, const std::string &director,
                        const std::string &title, const std::string &extra);
+  // Returns the catalog key of the Drama movie create would build from
+  // the same fields, or an empty string if it would fail.
+  static std::string recordKey(std::string_view director,
+                               std::string_view title, std::string_view extra);
   // Registers the Drama movie type with the factory.
   static bool registerSelf();
 
@@ -118,23 +213,35 @@ public:
   bool operator<(const Movie &other) const override;
   // Checks if this Classic movie is equal to another movie.
   bool operator==(const Movie &other) const override;
-  // Returns a string representation of the Classic movie.
-  std::string toString() const override;
+  // Appends the inventory line of the Classic movie to a buffer.
+  void formatTo(FormatBuffer &buffer, const FormatCounts &stockCounts,
+                const FormatCounts &borrowedCounts) const override;
   // Returns the genre character for Classic movies.
   char getGenre() const override { return 'C'; }
   // Creates a clone of this Classic movie object.
   Movie *clone() const override;
+  // Returns the catalog key of this Classic movie.
+  std::string getKey() const override;
+  // Returns the bytes held by this Classic movie.
+  size_t memoryUsage() const override;
+  // Returns the catalog key of the Classic movie with the given release date
+  // and actor.
+  static std::string makeKey(int month, int year, std::string_view actor);
 
   // Gets the major actor of the classic movie.
   const std::string &getActor() const { return actor; }
   // Gets the release month of the classic movie.
   int getMonth() const { return month; }
   // Gets the release year of the classic movie.
-  int getYear() const { return year; }
+  int getYear() const override { return year; }
 
   // Factory method to create a Classic movie from a string.
   static Movie *create(int stock, const std::string &director,
                        const std::string &title, const std::string &extra);
+  // Returns the catalog key of the Classic movie create would build from
+  // the same fields, or an empty string if it would fail.
+  static std::string recordKey(std::string_view director,
+                               std::string_view title, std::string_view extra);
   // Registers the Classic movie type with the factory.
   static bool registerSelf();
 
@@ -143,6 +250,10 @@ private:
   int month;
   int year;
   static bool registered;
+
+  // Parses the "First Last Month Year" field of a catalog record.
+  static bool parseExtra(std::string_view extra, std::string &actor,
+                         int &month, int &year);
 };
 
 #endif // MOVIE_H
\ No newline at end of file
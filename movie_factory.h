@@ -1,9 +1,14 @@
 #ifndef MOVIE_FACTORY_H
 #define MOVIE_FACTORY_H
 
+#include "memory_usage.h"
 #include <functional>
 #include <map>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 class Movie;
 
@@ -12,105 +17,124 @@ class MovieFactory {
 public:
   using CreateFunction = std::function<Movie *(
       int, const std::string &, const std::string &, const std::string &)>;
+  using KeyFunction = std::function<std::string(
+      std::string_view, std::string_view, std::string_view)>;
 
   // Gets the singleton instance of the factory.
   static MovieFactory &getInstance();
 
-  // Registers a movie type with a creation function.
-  bool registerMovie(char genre, CreateFunction func);
+  // Registers a movie type with a creation function and a function that
+  // builds the key of the movie it would create.
+  bool registerMovie(char genre, CreateFunction func, KeyFunction key);
   // Creates a movie object from data.
   Movie *createMovie(char genre, int stock, const std::string &director,
                      const std::string &title, const std::string &extra);
+  // Returns true if a movie type is registered for the genre.
+  bool hasGenre(char genre) const;
+  // Returns the key of the movie createMovie would create from the same
+  // data, or an empty string if it would fail.
+  std::string recordKey(char genre, std::string_view director,
+                        std::string_view title, std::string_view extra) const;
 
 private:
   std::map<char, CreateFunction> creators;
+  std::map<char, KeyFunction> keys;
   MovieFactory() = default;
 };
 
-// A simple hash table implementation for customer lookups.
+// A simple hash table implementation for customer and movie lookups. The
+// bucket array doubles when the table holds more entries than buckets, so
+// chains stay short however many entries are inserted.
 template <typename K, typename V> class HashTable {
 private:
   struct Node {
     K key;
     V value;
     Node *next;
-    Node(const K &k, const V &v) : key(k), value(v), next(nullptr) {}
+    Node(K &&k, const V &v) : key(std::move(k)), value(v), next(nullptr) {}
   };
 
-  static const int TABLE_SIZE = 101;
-  Node *table[TABLE_SIZE];
+  static const int INITIAL_SIZE = 101;
+  std::vector<Node *> table;
+  size_t count = 0;
 
   // Hashes a key to an index in the table.
-  int hash(const K &key) const {
+  size_t hash(const K &key) const {
+    size_t hash = 0;
     if constexpr (std::is_same_v<K, int>) {
-      return key % TABLE_SIZE;
+      hash = static_cast<unsigned int>(key);
     } else if constexpr (std::is_same_v<K, std::string>) {
-      int hash = 0;
       for (char c : key) {
-        hash = (hash * 31 + c) % TABLE_SIZE;
+        hash = hash * 31 + static_cast<unsigned char>(c);
       }
-      return hash;
     }
-    return 0;
+    return hash % table.size();
   }
 
-public:
-  // Constructs a new HashTable.
-  HashTable() {
-    for (int i = 0; i < TABLE_SIZE; i++) {
-      table[i] = nullptr;
+  // Moves every node into a bucket array of the given size.
+  void rehash(size_t buckets) {
+    std::vector<Node *> old(buckets, nullptr);
+    old.swap(table);
+    for (Node *current : old) {
+      while (current) {
+        Node *next = current->next;
+        size_t index = hash(current->key);
+        current->next = table[index];
+        table[index] = current;
+        current = next;
+      }
     }
   }
 
+public:
+  // Constructs a new HashTable.
+  HashTable() : table(INITIAL_SIZE, nullptr) {}
+  HashTable(const HashTable &) = delete;
+  HashTable &operator=(const HashTable &) = delete;
+
   // Destroys the HashTable and frees memory.
-  ~HashTable() {
-    for (int i = 0; i < TABLE_SIZE; i++) {
-      Node *current = table[i];
+  ~HashTable() { clear(); }
+
+  // Removes every entry.
+  void clear() {
+    for (Node *&current : table) {
       while (current) {
         Node *next = current->next;
         delete current;
         current = next;
       }
     }
+    count = 0;
   }
 
   // Inserts a key-value pair into the hash table.
-  void insert(const K &key, const V &value) {
-    int index = hash(key);
-    Node *newNode = new Node(key, value);
-
-    if (table[index] == nullptr) {
-      table[index] = newNode;
-    } else {
-      Node *current = table[index];
-      while (current->next) {
-        if (current->key == key) {
-          current->value = value;
-          delete newNode;
-          return;
-        }
-        current = current->next;
-      }
+  void insert(const K &key, const V &value) { insert(K(key), value); }
+  void insert(K &&key, const V &value) {
+    size_t index = hash(key);
+    for (Node *current = table[index]; current; current = current->next) {
       if (current->key == key) {
         current->value = value;
-        delete newNode;
-      } else {
-        current->next = newNode;
+        return;
       }
     }
+
+    if (count >= table.size()) {
+      rehash(table.size() * 2 + 1);
+      index = hash(key);
+    }
+    Node *newNode = new Node(std::move(key), value);
+    newNode->next = table[index];
+    table[index] = newNode;
+    count++;
   }
 
   // Finds a value by its key.
   bool find(const K &key, V &value) const {
-    int index = hash(key);
-    Node *current = table[index];
-
-    while (current) {
+    for (Node *current = table[hash(key)]; current; current = current->next) {
       if (current->key == key) {
         value = current->value;
         return true;
       }
-      current = current->next;
     }
     return false;
   }
@@ -120,6 +144,39 @@ public:
     V dummy;
     return find(key, dummy);
   }
+
+  // Removes a key. Returns false if it was not present.
+  bool remove(const K &key) {
+    Node **link = &table[hash(key)];
+    while (*link) {
+      Node *current = *link;
+      if (current->key == key) {
+        *link = current->next;
+        delete current;
+        count--;
+        return true;
+      }
+      link = &current->next;
+    }
+    return false;
+  }
+
+  // Returns the number of entries.
+  size_t size() const { return count; }
+
+  // Returns the bytes held by the bucket array, the nodes and the heap
+  // buffers of string keys.
+  size_t memoryUsage() const {
+    size_t bytes = heapBytes(table) + count * sizeof(Node);
+    if constexpr (std::is_same_v<K, std::string>) {
+      for (const Node *current : table) {
+        for (; current; current = current->next) {
+          bytes += heapBytes(current->key);
+        }
+      }
+    }
+    return bytes;
+  }
 };
 
 #endif // MOVIE_FACTORY_H
\ No newline at end of file
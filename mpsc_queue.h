@@ -0,0 +1,84 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// A bounded lock-free queue for several producer threads and one consumer
+// thread. Each cell carries a sequence number that says whose turn it is:
+// a producer claims the next cell with one compare-and-swap on the tail,
+// fills it and publishes it by advancing its sequence; the consumer takes
+// cells in order and hands them back the same way, so it never writes a
+// shared counter. Values pushed by one producer are popped in the order
+// it pushed them.
+template <typename T> class MpscQueue {
+public:
+  // Constructs a queue of at least `capacity` cells, rounded up to a power
+  // of two.
+  explicit MpscQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    cells = std::make_unique<Cell[]>(size);
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // Moves a value into the queue. Returns false, leaving the value alone,
+  // if the queue is full. Any thread may push.
+  bool tryPush(T &value) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[position & mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      auto lag = static_cast<intptr_t>(sequence - position);
+      if (lag == 0) {
+        if (tail.compare_exchange_weak(position, position + 1,
+                                       std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  // Moves the oldest value out of the queue. Returns false if there is
+  // none yet. Only the consumer thread may pop.
+  bool tryPop(T &value) {
+    Cell &cell = cells[head & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+      return false;
+    }
+    value = std::move(cell.value);
+    cell.sequence.store(head + mask + 1, std::memory_order_release);
+    head++;
+    return true;
+  }
+
+private:
+  // Cells sit on their own cache lines so producers filling neighbouring
+  // cells do not contend.
+  struct alignas(64) Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask = 0;
+  alignas(64) std::atomic<size_t> tail{0};
+  alignas(64) size_t head = 0;
+};
+
+#endif // MPSC_QUEUE_H
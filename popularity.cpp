@@ -0,0 +1,184 @@
+#include "popularity.h"
+#include "movie.h"
+#include <algorithm>
+
+// Constructs a space-saving tracker with a fixed number of counters.
+TopTitles::TopTitles(size_t capacity) : capacity(capacity) {
+  size_t tableSize = 1;
+  while (tableSize < capacity * 2) {
+    tableSize <<= 1;
+  }
+  heap.reserve(capacity);
+  slotOf.reserve(capacity);
+  slots.assign(tableSize, EMPTY);
+  mask = tableSize - 1;
+}
+
+// Records one borrow, replacing the least counted title when full.
+void TopTitles::record(const Movie *movie) {
+  if (capacity == 0) {
+    return;
+  }
+
+  uint32_t position = findSlot(movie);
+  if (position != EMPTY) {
+    uint32_t index = slots[position];
+    heap[index].count++;
+    siftDown(index);
+    return;
+  }
+
+  if (heap.size() < capacity) {
+    auto index = static_cast<uint32_t>(heap.size());
+    heap.push_back({movie, 1, 0});
+    slotOf.push_back(EMPTY);
+    insertSlot(movie, index);
+    siftUp(index);
+    return;
+  }
+
+  // Evict the minimum: the newcomer may have been borrowed up to that many
+  // times while it was not being counted.
+  eraseSlot(slotOf[0]);
+  uint64_t floor = heap[0].count;
+  heap[0] = {movie, floor + 1, floor};
+  insertSlot(movie, 0);
+  siftDown(0);
+}
+
+// Returns up to n counted titles ordered by decreasing count.
+std::vector<TopTitles::Entry> TopTitles::top(size_t n) const {
+  std::vector<Entry> result(heap);
+  n = std::min(n, result.size());
+  std::partial_sort(result.begin(), result.begin() + n, result.end(),
+                    [](const Entry &a, const Entry &b) {
+                      return a.count > b.count;
+                    });
+  result.resize(n);
+  return result;
+}
+
+// Hashes the movie address to its home position in the slot table.
+size_t TopTitles::home(const Movie *movie) const {
+  auto key = reinterpret_cast<uintptr_t>(movie) >> 4;
+  return (key * 0x9E3779B97F4A7C15ULL >> 17) & mask;
+}
+
+// Finds the slot table position holding the movie by linear probing.
+uint32_t TopTitles::findSlot(const Movie *movie) const {
+  for (size_t position = home(movie);; position = (position + 1) & mask) {
+    uint32_t index = slots[position];
+    if (index == EMPTY) {
+      return EMPTY;
+    }
+    if (heap[index].movie == movie) {
+      return static_cast<uint32_t>(position);
+    }
+  }
+}
+
+// Stores the heap index of a movie in its first free probe position.
+void TopTitles::insertSlot(const Movie *movie, uint32_t heapIndex) {
+  size_t position = home(movie);
+  while (slots[position] != EMPTY) {
+    position = (position + 1) & mask;
+  }
+  slots[position] = heapIndex;
+  slotOf[heapIndex] = static_cast<uint32_t>(position);
+}
+
+// Removes an entry from the slot table. Later entries of the same probe
+// cluster are shifted back so lookups never need tombstones.
+void TopTitles::eraseSlot(uint32_t position) {
+  size_t hole = position;
+  size_t next = (hole + 1) & mask;
+  while (slots[next] != EMPTY) {
+    uint32_t index = slots[next];
+    size_t want = home(heap[index].movie);
+    // Move the entry into the hole unless its home lies after the hole
+    // within the cyclic range (hole, next].
+    if (((next - want) & mask) >= ((next - hole) & mask)) {
+      slots[hole] = index;
+      slotOf[index] = static_cast<uint32_t>(hole);
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  slots[hole] = EMPTY;
+}
+
+// Swaps two heap entries and repoints their slot table entries.
+void TopTitles::swapEntries(size_t a, size_t b) {
+  std::swap(heap[a], heap[b]);
+  std::swap(slotOf[a], slotOf[b]);
+  slots[slotOf[a]] = static_cast<uint32_t>(a);
+  slots[slotOf[b]] = static_cast<uint32_t>(b);
+}
+
+// Moves an entry down while a child has a smaller count.
+void TopTitles::siftDown(size_t index) {
+  size_t size = heap.size();
+  while (true) {
+    size_t smallest = index;
+    size_t left = index * 2 + 1;
+    size_t right = left + 1;
+    if (left < size && heap[left].count < heap[smallest].count) {
+      smallest = left;
+    }
+    if (right < size && heap[right].count < heap[smallest].count) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      return;
+    }
+    swapEntries(index, smallest);
+    index = smallest;
+  }
+}
+
+// Moves an entry up while its parent has a larger count.
+void TopTitles::siftUp(size_t index) {
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (heap[parent].count <= heap[index].count) {
+      return;
+    }
+    swapEntries(index, parent);
+    index = parent;
+  }
+}
+
+// Constructs a popularity tracker.
+PopularityTracker::PopularityTracker(size_t capacity)
+    : capacity(capacity), overall(capacity) {}
+
+// Counts a borrow overall and in the movie's genre.
+void PopularityTracker::record(const Movie *movie) {
+  overall.record(movie);
+
+  char genre = movie->getGenre();
+  for (auto &sketch : byGenre) {
+    if (sketch.first == genre) {
+      sketch.second.record(movie);
+      return;
+    }
+  }
+  byGenre.emplace_back(genre, TopTitles(capacity));
+  byGenre.back().second.record(movie);
+}
+
+// Returns the most borrowed titles overall.
+std::vector<TopTitles::Entry> PopularityTracker::top(size_t n) const {
+  return overall.top(n);
+}
+
+// Returns the most borrowed titles of one genre.
+std::vector<TopTitles::Entry> PopularityTracker::top(size_t n,
+                                                     char genre) const {
+  for (const auto &sketch : byGenre) {
+    if (sketch.first == genre) {
+      return sketch.second.top(n);
+    }
+  }
+  return {};
+}
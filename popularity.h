@@ -0,0 +1,82 @@
+#ifndef POPULARITY_H
+#define POPULARITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class Movie;
+
+// Tracks the most borrowed titles of a borrow stream in fixed memory using
+// the space-saving algorithm. At most `capacity` titles are counted; when a
+// new title arrives and the table is full, it replaces the least counted
+// title and inherits its count as an error bound.
+class TopTitles {
+public:
+  // A counted title. The true count lies in [count - error, count].
+  struct Entry {
+    const Movie *movie;
+    uint64_t count;
+    uint64_t error;
+  };
+
+  // Constructs a tracker that counts at most `capacity` titles.
+  explicit TopTitles(size_t capacity);
+
+  // Records one borrow of the movie.
+  void record(const Movie *movie);
+  // Returns up to n of the most borrowed titles, most borrowed first.
+  std::vector<Entry> top(size_t n) const;
+
+private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  size_t capacity;
+  // Min-heap of the counted titles ordered by count.
+  std::vector<Entry> heap;
+  // Open-addressed table mapping a movie to its heap slot.
+  std::vector<uint32_t> slots;
+  // Position in `slots` of the key of each heap entry.
+  std::vector<uint32_t> slotOf;
+  size_t mask;
+
+  // Returns the home position of a movie in the slot table.
+  size_t home(const Movie *movie) const;
+  // Returns the slot table position holding the movie, or EMPTY.
+  uint32_t findSlot(const Movie *movie) const;
+  // Stores the heap index of a movie in the slot table.
+  void insertSlot(const Movie *movie, uint32_t heapIndex);
+  // Removes a slot table entry, shifting later entries of its cluster back.
+  void eraseSlot(uint32_t position);
+  // Swaps two heap entries and updates the slot table.
+  void swapEntries(size_t a, size_t b);
+  // Restores the heap order below the given index.
+  void siftDown(size_t index);
+  // Restores the heap order above the given index.
+  void siftUp(size_t index);
+};
+
+// Keeps borrow counts for the most popular titles overall and per genre.
+class PopularityTracker {
+public:
+  // Default number of titles counted overall and in each genre.
+  static constexpr size_t DEFAULT_CAPACITY = 256;
+
+  // Constructs a tracker with the given per-sketch capacity.
+  explicit PopularityTracker(size_t capacity = DEFAULT_CAPACITY);
+
+  // Records one successful borrow of the movie.
+  void record(const Movie *movie);
+  // Returns up to n of the most borrowed titles overall.
+  std::vector<TopTitles::Entry> top(size_t n) const;
+  // Returns up to n of the most borrowed titles of one genre.
+  std::vector<TopTitles::Entry> top(size_t n, char genre) const;
+
+private:
+  size_t capacity;
+  TopTitles overall;
+  std::vector<std::pair<char, TopTitles>> byGenre;
+};
+
+#endif // POPULARITY_H
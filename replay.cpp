@@ -0,0 +1,296 @@
+#include "replay.h"
+#include "Store.h"
+#include "arg_parse.h"
+#include "command.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Returns the value at the given fraction of sorted samples.
+double percentile(std::vector<double> &samples, double fraction) {
+  if (samples.empty()) {
+    return 0.0;
+  }
+  auto index = static_cast<size_t>(fraction * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+// Returns the line of text that contains the given offset, or a marker if
+// the offset is past its end.
+std::string lineAt(const std::string &text, size_t offset) {
+  if (offset >= text.size()) {
+    return "<end of output>";
+  }
+  size_t start =
+      offset == 0 ? std::string::npos : text.rfind('\n', offset - 1);
+  start = start == std::string::npos ? 0 : start + 1;
+  size_t end = text.find('\n', offset);
+  return text.substr(start, end == std::string::npos ? end : end - start);
+}
+
+} // namespace
+
+// Constructs a replay driver.
+ReplayDriver::ReplayDriver(const Options &options) : options(options) {}
+
+// Loads a store, then runs the command lines in order, starting each at
+// its scheduled time when a rate is set. A command that starts late is
+// timed from its scheduled start, so time spent waiting behind a slow
+// command counts.
+bool ReplayDriver::run(Report &report) {
+  std::ifstream file(options.commandsFile);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << options.commandsFile << std::endl;
+    return false;
+  }
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+
+  // Loading is captured too, so a golden copy covers the bad lines of the
+  // input files.
+  Store store;
+  std::ostringstream output;
+  store.setOutput(output, output);
+  if (!store.loadMovies(options.moviesFile) ||
+      !store.loadCustomers(options.customersFile)) {
+    std::cerr << output.str();
+    return false;
+  }
+  if (options.schedule) {
+    runScheduled(store, lines, report);
+    report.output = output.str();
+    store.setOutput(std::cout, std::cerr);
+    return true;
+  }
+
+  struct Samples {
+    uint64_t failed = 0;
+    std::vector<double> micros;
+  };
+  std::map<char, Samples> byType;
+  auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.rate > 0 ? 1.0 / options.rate
+                                                     : 0.0));
+
+  auto start = Clock::now();
+  uint64_t sequence = 0;
+  for (int round = 0; round < options.repeat; round++) {
+    for (const std::string &command : lines) {
+      auto scheduled = Clock::now();
+      if (options.rate > 0 && scheduled < start + interval * sequence) {
+        std::this_thread::sleep_until(start + interval * sequence);
+        scheduled = Clock::now();
+      } else if (options.rate > 0) {
+        scheduled = start + interval * sequence;
+      }
+      sequence++;
+
+      bool succeeded = false;
+      std::unique_ptr<Command> cmd(
+          CommandFactory::getInstance().createCommand(command, output));
+      if (cmd != nullptr) {
+        succeeded = store.runCommand(*cmd);
+      }
+      auto finished = Clock::now();
+
+      Samples &samples = byType[command[0]];
+      samples.micros.push_back(
+          std::chrono::duration<double, std::micro>(finished - scheduled)
+              .count());
+      if (!succeeded) {
+        samples.failed++;
+      }
+    }
+  }
+  store.finishReload();
+  report.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  store.setOutput(std::cout, std::cerr);
+
+  report.commands = sequence;
+  report.throughput =
+      report.seconds > 0 ? static_cast<double>(sequence) / report.seconds : 0;
+  for (auto &entry : byType) {
+    TypeReport type;
+    type.type = entry.first;
+    type.count = entry.second.micros.size();
+    type.failed = entry.second.failed;
+    type.p50Micros = percentile(entry.second.micros, 0.50);
+    type.p99Micros = percentile(entry.second.micros, 0.99);
+    type.p999Micros = percentile(entry.second.micros, 0.999);
+    report.types.push_back(type);
+  }
+  report.output = output.str();
+  return true;
+}
+
+// Submits each line to a scheduler when it arrives, all at once without a
+// rate, and steps the scheduler while lines are queued.
+void ReplayDriver::runScheduled(Store &store,
+                                const std::vector<std::string> &lines,
+                                Report &report) {
+  CommandScheduler scheduler(store, CommandScheduler::Options());
+  auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.rate > 0 ? 1.0 / options.rate
+                                                     : 0.0));
+  uint64_t total = lines.size() * static_cast<uint64_t>(options.repeat);
+  uint64_t next = 0;
+  auto start = Clock::now();
+  while (next < total || scheduler.pending() > 0) {
+    auto now = Clock::now();
+    for (; next < total && start + interval * next <= now; next++) {
+      Clock::time_point arrival = start + interval * next;
+      scheduler.submit(lines[next % lines.size()],
+                       options.rate > 0 ? arrival : now);
+    }
+    if (!scheduler.step() && next < total) {
+      std::this_thread::sleep_until(start + interval * next);
+    }
+  }
+  store.finishReload();
+  report.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  report.commands = total;
+  report.throughput =
+      report.seconds > 0 ? static_cast<double>(total) / report.seconds : 0;
+  report.scheduled = true;
+  for (int kind = 0; kind < CommandScheduler::CLASSES; kind++) {
+    report.classes[kind] =
+        scheduler.report(static_cast<CommandScheduler::Class>(kind));
+  }
+}
+
+// Prints the throughput, then one latency line per command type.
+void ReplayDriver::print(const Report &report) {
+  std::cout << report.commands << " commands in " << report.seconds
+            << " s: " << report.throughput << " commands/s" << std::endl;
+  const char *classNames[] = {"interactive", "bulk"};
+  for (int kind = 0; report.scheduled && kind < CommandScheduler::CLASSES;
+       kind++) {
+    const CommandScheduler::ClassReport &stats = report.classes[kind];
+    std::cout << "  " << classNames[kind] << ": " << stats.completed
+              << " commands (" << stats.late << " late), p50 "
+              << stats.p50Micros << " us, p99 " << stats.p99Micros
+              << " us, max " << stats.maxMicros << " us" << std::endl;
+  }
+  for (const TypeReport &type : report.types) {
+    std::cout << "  " << type.type << ": " << type.count << " commands ("
+              << type.failed << " failed), p50 " << type.p50Micros
+              << " us, p99 " << type.p99Micros << " us, p999 "
+              << type.p999Micros << " us" << std::endl;
+  }
+}
+
+// Compares the output with the golden file and reports the first line
+// that differs.
+bool ReplayDriver::verify(const std::string &output,
+                          const std::string &golden) {
+  std::ifstream file(golden, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << golden << std::endl;
+    return false;
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  std::string expected = contents.str();
+  if (output == expected) {
+    return true;
+  }
+
+  auto mismatch = std::mismatch(output.begin(), output.end(), expected.begin(),
+                                expected.end());
+  auto offset = static_cast<size_t>(mismatch.first - output.begin());
+  size_t lineNumber = 1 + std::count(output.begin(), mismatch.first, '\n');
+  std::cerr << "Output differs from " << golden << " at byte " << offset
+            << ", line " << lineNumber << ":" << std::endl
+            << "  expected: " << lineAt(expected, offset) << std::endl
+            << "  actual:   " << lineAt(output, offset) << std::endl;
+  return false;
+}
+
+/**
+ * Replays a command file and prints throughput and per-type latencies.
+ * "--rate N" starts N commands per second instead of running them back to
+ * back and "--repeat N" replays the file N times. "--schedule" runs the
+ * lines through a CommandScheduler, reporting latency per priority class
+ * instead of per type. "--record file" saves
+ * the output as a golden copy; "--golden file" checks it against one and
+ * fails the run if it differs.
+ */
+int runReplay(int argc, char *argv[]) {
+  ReplayDriver::Options options;
+  std::string golden;
+  std::string record;
+  std::vector<std::string> files;
+  bool valid = true;
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--rate") {
+      valid = parsePositive(argv[++i], options.rate) && valid;
+    } else if (i + 1 < argc && arg == "--repeat") {
+      unsigned long repeat = 0;
+      valid = parseNumber(argv[++i], INT_MAX, repeat) && repeat > 0 && valid;
+      options.repeat = static_cast<int>(repeat);
+    } else if (arg == "--schedule") {
+      options.schedule = true;
+    } else if (i + 1 < argc && arg == "--golden") {
+      golden = argv[++i];
+    } else if (i + 1 < argc && arg == "--record") {
+      record = argv[++i];
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (!valid || (!files.empty() && files.size() != 3)) {
+    std::cerr << "Usage: replay [--rate N] [--repeat N] [--schedule] "
+                 "[--golden file] [--record file] [movies customers "
+                 "commands]"
+              << std::endl;
+    return 1;
+  }
+  if (files.size() == 3) {
+    options.moviesFile = files[0];
+    options.customersFile = files[1];
+    options.commandsFile = files[2];
+  }
+
+  ReplayDriver driver(options);
+  ReplayDriver::Report report;
+  if (!driver.run(report)) {
+    return 1;
+  }
+  ReplayDriver::print(report);
+
+  if (!record.empty()) {
+    std::ofstream file(record, std::ios::binary);
+    file << report.output;
+    if (!file) {
+      std::cerr << "Error: Cannot write " << record << std::endl;
+      return 1;
+    }
+  }
+  if (!golden.empty()) {
+    if (!ReplayDriver::verify(report.output, golden)) {
+      return 1;
+    }
+    std::cout << "Output matches " << golden << std::endl;
+  }
+  return 0;
+}
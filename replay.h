@@ -0,0 +1,77 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "scheduler.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Store;
+
+// Replays a command file against a Store in this process, one command at
+// a time, and times each command. The store's output is captured so a
+// run can be checked byte for byte against a golden copy recorded
+// earlier.
+class ReplayDriver {
+public:
+  // What to replay and how fast.
+  struct Options {
+    std::string moviesFile = "data4movies.txt";
+    std::string customersFile = "data4customers.txt";
+    std::string commandsFile = "data4commands.txt";
+    // Commands started per second, or 0 to run them back to back.
+    double rate = 0.0;
+    // Times the command file is replayed, against the same store.
+    int repeat = 1;
+    // Runs the lines through a CommandScheduler instead of in order.
+    bool schedule = false;
+  };
+
+  // Latencies of the commands of one type, by their first character.
+  struct TypeReport {
+    char type = 0;
+    uint64_t count = 0;
+    uint64_t failed = 0;
+    double p50Micros = 0.0;
+    double p99Micros = 0.0;
+    double p999Micros = 0.0;
+  };
+
+  // Results of a run.
+  struct Report {
+    uint64_t commands = 0;
+    double seconds = 0.0;
+    double throughput = 0.0;
+    std::vector<TypeReport> types;
+    // Set instead of `types` when the lines went through a scheduler.
+    bool scheduled = false;
+    CommandScheduler::ClassReport classes[CommandScheduler::CLASSES];
+    // Everything loading the files and running the commands wrote to the
+    // store's output and errors.
+    std::string output;
+  };
+
+  explicit ReplayDriver(const Options &options);
+
+  // Loads the store and replays the commands. Returns false if a file
+  // cannot be opened.
+  bool run(Report &report);
+  // Prints a report, without its output.
+  static void print(const Report &report);
+  // Compares output with the contents of a golden file, describing the
+  // first difference on standard error. Returns true if they are equal.
+  static bool verify(const std::string &output, const std::string &golden);
+
+private:
+  Options options;
+
+  // Replays the lines through a CommandScheduler.
+  void runScheduled(Store &store, const std::vector<std::string> &lines,
+                    Report &report);
+};
+
+// Command line entry point: "replay [--rate N] [--repeat N] [--schedule]
+// [--golden file] [--record file] [movies customers commands]".
+int runReplay(int argc, char *argv[]);
+
+#endif // REPLAY_H
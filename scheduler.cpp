@@ -0,0 +1,184 @@
+#include "scheduler.h"
+#include "Store.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+// Names scheduled lines in error reports.
+const std::string SOURCE = "scheduler";
+
+// Returns the value at the given fraction of sorted samples.
+double percentile(std::vector<double> &samples, double fraction) {
+  if (samples.empty()) {
+    return 0.0;
+  }
+  auto index = static_cast<size_t>(fraction * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+// Returns the number after the command type, which is the customer id of
+// the commands that have one, or -1 if there is none.
+int leadingNumber(const std::string &line) {
+  const char *start = line.c_str() + 1;
+  char *end = nullptr;
+  long value = std::strtol(start, &end, 10);
+  return end == start || value < 0 ? -1 : static_cast<int>(value);
+}
+
+} // namespace
+
+// Constructs a scheduler with empty queues.
+CommandScheduler::CommandScheduler(Store &store, const Options &options)
+    : store(store), options(options) {
+  for (char type : options.interactiveTypes) {
+    interactive[static_cast<unsigned char>(type)] = true;
+  }
+}
+
+// Queues a line in its class. The number after the command type is taken
+// as a customer id even for commands that have none, which can only make
+// a line wait for one it did not need to.
+void CommandScheduler::submit(const std::string &line,
+                              Clock::time_point arrival) {
+  if (line.empty()) {
+    return;
+  }
+  Class kind =
+      interactive[static_cast<unsigned char>(line[0])] ? INTERACTIVE : BULK;
+  Class other = kind == INTERACTIVE ? BULK : INTERACTIVE;
+  int customer = leadingNumber(line);
+  uint64_t waitsFor = 0;
+  auto last = lastOfCustomer[other].find(customer);
+  if (last != lastOfCustomer[other].end() && last->second > done[other]) {
+    waitsFor = last->second;
+  }
+  queued[kind]++;
+  if (customer >= 0) {
+    lastOfCustomer[kind][customer] = queued[kind];
+  }
+  queues[kind].push_back({line, arrival, waitsFor});
+}
+
+// Runs the interactive lines at the head unless the first waits for bulk
+// lines, or bulk is late and the last step was interactive; otherwise
+// runs a bulk slice, cut short where a waiting interactive line can run.
+// Either takes about half the interactive target at most.
+bool CommandScheduler::step() {
+  if (queues[INTERACTIVE].empty() && queues[BULK].empty()) {
+    return false;
+  }
+
+  auto budget = options.interactiveTarget / 2;
+  bool bulkLate = !queues[BULK].empty() &&
+                  Clock::now() - queues[BULK].front().arrival >
+                      options.bulkTarget;
+  if (canRun(INTERACTIVE) && !(bulkLate && ranInteractive)) {
+    runInteractive(Clock::now() + budget);
+    ranInteractive = true;
+    return true;
+  }
+
+  double budgetNs = std::chrono::duration<double, std::nano>(budget).count();
+  auto limit = static_cast<size_t>(budgetNs / bulkLineNs);
+  limit = std::min(std::max<size_t>(limit, 1), options.maxSlice);
+  if (!queues[INTERACTIVE].empty() && !canRun(INTERACTIVE)) {
+    limit = std::min<size_t>(limit, queues[INTERACTIVE].front().waitsFor -
+                                        done[BULK]);
+  }
+  // Lines of the two classes only wait for lines that arrived before
+  // them, so when the bulk head waits the interactive head can run.
+  if (!runBulk(limit)) {
+    runInteractive(Clock::now() + budget);
+  }
+  ranInteractive = false;
+  return true;
+}
+
+// Steps until both queues are empty.
+void CommandScheduler::drain() {
+  while (step()) {
+  }
+}
+
+// Summarizes the latencies of a class.
+CommandScheduler::ClassReport CommandScheduler::report(Class kind) const {
+  ClassReport report;
+  std::vector<double> samples = latencies[kind];
+  report.completed = samples.size();
+  report.late = late[kind];
+  report.p50Micros = percentile(samples, 0.50);
+  report.p99Micros = percentile(samples, 0.99);
+  report.maxMicros =
+      samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+  return report;
+}
+
+// Runs interactive lines one at a time while they can run.
+void CommandScheduler::runInteractive(Clock::time_point until) {
+  TraceSpan span("interactive");
+  auto now = Clock::now();
+  do {
+    Entry entry = std::move(queues[INTERACTIVE].front());
+    queues[INTERACTIVE].pop_front();
+    slice.clear();
+    slice.push_back(std::move(entry.line));
+    store.processLines(slice, SOURCE);
+    now = Clock::now();
+    done[INTERACTIVE]++;
+    complete(INTERACTIVE, entry.arrival, now);
+  } while (canRun(INTERACTIVE) && now < until);
+  if (queues[INTERACTIVE].empty()) {
+    lastOfCustomer[INTERACTIVE].clear();
+  }
+}
+
+// Runs the bulk lines that can run, up to the limit, as one batch and
+// updates the cost estimate the next slice is sized from.
+bool CommandScheduler::runBulk(size_t limit) {
+  TraceSpan span("bulkSlice");
+  limit = std::min(limit, queues[BULK].size());
+  slice.clear();
+  for (size_t i = 0; i < limit; i++) {
+    Entry &entry = queues[BULK][i];
+    if (entry.waitsFor > done[INTERACTIVE]) {
+      break;
+    }
+    slice.push_back(std::move(entry.line));
+  }
+  size_t count = slice.size();
+  if (count == 0) {
+    return false;
+  }
+
+  auto start = Clock::now();
+  store.processLines(slice, SOURCE);
+  auto now = Clock::now();
+  double lineNs =
+      std::chrono::duration<double, std::nano>(now - start).count() / count;
+  bulkLineNs = 0.8 * bulkLineNs + 0.2 * lineNs;
+  for (size_t i = 0; i < count; i++) {
+    complete(BULK, queues[BULK].front().arrival, now);
+    queues[BULK].pop_front();
+  }
+  done[BULK] += count;
+  if (queues[BULK].empty()) {
+    lastOfCustomer[BULK].clear();
+  }
+  return true;
+}
+
+// Records a latency and whether it missed the class target.
+void CommandScheduler::complete(Class kind, Clock::time_point arrival,
+                                Clock::time_point now) {
+  auto waited = now - arrival;
+  latencies[kind].push_back(
+      std::chrono::duration<double, std::micro>(waited).count());
+  auto target =
+      kind == INTERACTIVE ? options.interactiveTarget : options.bulkTarget;
+  if (waited > target) {
+    late[kind]++;
+  }
+}
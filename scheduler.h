@@ -0,0 +1,121 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Store;
+
+// Orders the command lines of a stream in front of a Store so interactive
+// queries do not wait behind bulk traffic.
+//
+// Lines fall in two classes by command type: interactive (history pages
+// and customer name searches by default) and bulk (everything else:
+// borrows, returns, holds, inventory and top title reports, reloads).
+// Interactive lines run first, in arrival order. Bulk lines run in
+// arrival order too, in slices batched the way processCommands batches
+// them; a slice is sized from the measured cost per line to take at most
+// half the interactive target, so an interactive line never waits long
+// for the slice ahead of it.
+//
+// Lines about the same customer keep their arrival order: an interactive
+// line waits for the bulk lines about its customer that arrived before
+// it, and a slice stops short of a bulk line about a customer with an
+// interactive line that arrived earlier still queued. A history page
+// therefore shows the same transactions as in arrival order.
+//
+// Once the oldest bulk line is past the bulk target, bulk slices
+// alternate with interactive lines, so bulk traffic is slowed but never
+// starved.
+class CommandScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // The two priority classes.
+  enum Class { INTERACTIVE, BULK, CLASSES };
+
+  // Which lines are interactive and how long each class should wait.
+  struct Options {
+    // Command types of interactive lines.
+    std::string interactiveTypes = "HN";
+    std::chrono::microseconds interactiveTarget{2000};
+    std::chrono::microseconds bulkTarget{200000};
+    // Most bulk lines run in one slice.
+    size_t maxSlice = 256;
+  };
+
+  // Latencies of a class, from arrival to completion.
+  struct ClassReport {
+    uint64_t completed = 0;
+    // Lines that took longer than the class target.
+    uint64_t late = 0;
+    double p50Micros = 0.0;
+    double p99Micros = 0.0;
+    double maxMicros = 0.0;
+  };
+
+  CommandScheduler(Store &store, const Options &options);
+
+  // Queues a command line that arrived at the given time.
+  void submit(const std::string &line, Clock::time_point arrival);
+  // Queues a command line arriving now.
+  void submit(const std::string &line) { submit(line, Clock::now()); }
+  // Runs the next interactive lines or bulk slice. Returns false if
+  // nothing is queued.
+  bool step();
+  // Runs queued lines until none is left.
+  void drain();
+  // Returns the number of queued lines.
+  size_t pending() const {
+    return queues[INTERACTIVE].size() + queues[BULK].size();
+  }
+  // Returns the latencies of the lines of a class completed so far.
+  ClassReport report(Class kind) const;
+
+private:
+  // A queued line, with the sequence number of the last line of the other
+  // class about the same customer queued before it, or 0.
+  struct Entry {
+    std::string line;
+    Clock::time_point arrival;
+    uint64_t waitsFor;
+  };
+
+  Store &store;
+  Options options;
+  bool interactive[256] = {};
+  std::deque<Entry> queues[CLASSES];
+  // Sequence numbers of each class: the last line queued and the last
+  // one run. A class runs in order, so every line up to `done` has run.
+  uint64_t queued[CLASSES] = {};
+  uint64_t done[CLASSES] = {};
+  // Sequence number of the last line of each class about a customer.
+  std::unordered_map<int, uint64_t> lastOfCustomer[CLASSES];
+  // Whether the last step ran an interactive line.
+  bool ranInteractive = false;
+  // Running estimate of the nanoseconds a bulk line takes.
+  double bulkLineNs = 1000.0;
+  std::vector<double> latencies[CLASSES];
+  uint64_t late[CLASSES] = {};
+  std::vector<std::string> slice;
+
+  // Runs the interactive lines at the head of their queue until one has
+  // to wait for bulk lines or the time is up.
+  void runInteractive(Clock::time_point until);
+  // Runs the bulk lines at the head of their queue, at most `limit`.
+  // Returns false if the first has to wait.
+  bool runBulk(size_t limit);
+  // Returns whether the line at the head of a class's queue can run.
+  bool canRun(Class kind) const {
+    return !queues[kind].empty() &&
+           queues[kind].front().waitsFor <= done[1 - kind];
+  }
+  // Records the latency of a completed line.
+  void complete(Class kind, Clock::time_point arrival, Clock::time_point now);
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,404 @@
+#include "server.h"
+#include "Store.h"
+#include "arg_parse.h"
+#include "command.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Largest amount of input read from one connection per readiness event, so
+// one busy client cannot starve the others.
+const size_t READ_CHUNK = 16 * 1024;
+const int MAX_EVENTS = 256;
+
+} // namespace
+
+// Constructs a server for the store.
+CommandServer::CommandServer(Store &store, const Options &options)
+    : store(store), options(options), port(options.port),
+      response(&responseBuffer) {}
+
+// Closes every socket the server owns.
+CommandServer::~CommandServer() {
+  for (auto &conn : connections) {
+    if (conn) {
+      close(conn->fd);
+    }
+  }
+  if (listenFd >= 0) {
+    close(listenFd);
+  }
+  if (stopFd >= 0) {
+    close(stopFd);
+  }
+  if (epollFd >= 0) {
+    close(epollFd);
+  }
+}
+
+// Creates the listening socket, the epoll set and the stop event.
+bool CommandServer::start() {
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) {
+    std::cerr << "Error: socket: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  int yes = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.bindAddress.c_str(), &address.sin_addr) !=
+      1) {
+    std::cerr << "Error: invalid bind address " << options.bindAddress
+              << std::endl;
+    return false;
+  }
+  if (bind(listenFd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listenFd, options.backlog) < 0) {
+    std::cerr << "Error: cannot listen on " << options.bindAddress << ":"
+              << options.port << ": "
+              << std::strerror(errno) << std::endl;
+    return false;
+  }
+  socklen_t length = sizeof(address);
+  getsockname(listenFd, reinterpret_cast<sockaddr *>(&address), &length);
+  port = ntohs(address.sin_port);
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollFd < 0 || stopFd < 0) {
+    std::cerr << "Error: epoll: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = listenFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+  event.data.fd = stopFd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event);
+  running = true;
+  return true;
+}
+
+// Waits for socket readiness and dispatches it until stopped.
+void CommandServer::run() {
+  store.setOutput(response, response);
+
+  epoll_event events[MAX_EVENTS];
+  while (running) {
+    int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Error: epoll_wait: " << std::strerror(errno) << std::endl;
+      break;
+    }
+
+    for (int i = 0; i < ready; i++) {
+      int fd = events[i].data.fd;
+      if (fd == stopFd) {
+        running = false;
+        continue;
+      }
+      if (fd == listenFd) {
+        acceptConnections();
+        continue;
+      }
+
+      Connection *conn = connections[fd].get();
+      if (conn == nullptr) {
+        continue;
+      }
+      uint32_t flags = events[i].events;
+      bool healthy =
+          (flags & EPOLLIN) != 0 || (flags & (EPOLLERR | EPOLLHUP)) == 0;
+      if (healthy && (flags & EPOLLOUT) != 0) {
+        healthy = flush(*conn);
+      }
+      if (healthy && (flags & EPOLLIN) != 0) {
+        healthy = readInput(*conn);
+      }
+      if (healthy) {
+        // Also runs lines held back by backpressure once output drains.
+        processInput(*conn);
+        healthy = flush(*conn);
+      }
+      if (!healthy) {
+        closeConnection(*conn);
+        continue;
+      }
+      updateInterest(*conn);
+    }
+  }
+
+  store.setOutput(std::cout, std::cerr);
+}
+
+// Asks the event loop to exit.
+void CommandServer::stop() {
+  uint64_t one = 1;
+  if (stopFd >= 0) {
+    ssize_t ignored = write(stopFd, &one, sizeof(one));
+    (void)ignored;
+  }
+}
+
+// Accepts pending connections, closing those over the limit.
+void CommandServer::acceptConnections() {
+  while (true) {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        std::cerr << "Error: accept: " << std::strerror(errno) << std::endl;
+      }
+      return;
+    }
+    if (openConnections >= options.maxConnections) {
+      stats.rejected++;
+      close(fd);
+      continue;
+    }
+
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    if (static_cast<size_t>(fd) >= connections.size()) {
+      connections.resize(static_cast<size_t>(fd) + 1);
+    }
+    connections[fd] = std::make_unique<Connection>();
+    Connection &conn = *connections[fd];
+    conn.fd = fd;
+    conn.events = EPOLLIN;
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    openConnections++;
+    stats.accepted++;
+  }
+}
+
+// Reads a chunk of input. Returns false if the connection failed or the
+// client sent an overlong line.
+bool CommandServer::readInput(Connection &conn) {
+  char chunk[READ_CHUNK];
+  ssize_t count = read(conn.fd, chunk, sizeof(chunk));
+  if (count > 0) {
+    conn.input.append(chunk, static_cast<size_t>(count));
+  } else if (count == 0) {
+    conn.peerClosed = true;
+  } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    return false;
+  }
+
+  // Input without a newline within the limit is not the protocol.
+  size_t lineStart = conn.input.rfind('\n');
+  lineStart = (lineStart == std::string::npos) ? 0 : lineStart + 1;
+  return conn.input.size() - lineStart <= options.maxLineLength;
+}
+
+// Runs complete input lines while the output stays below the high-water
+// mark, then drops the consumed input.
+void CommandServer::processInput(Connection &conn) {
+  size_t start = 0;
+  while (conn.pending() < options.outputHighWater) {
+    size_t newline = conn.input.find('\n', start);
+    if (newline == std::string::npos) {
+      break;
+    }
+    size_t end = newline;
+    if (end > start && conn.input[end - 1] == '\r') {
+      end--;
+    }
+    if (end > start) {
+      runCommand(conn, conn.input.substr(start, end - start));
+    }
+    start = newline + 1;
+  }
+  conn.input.erase(0, start);
+}
+
+// Runs one command line against the store, capturing its output. A
+// command naming a file would let any client read or overwrite what the
+// server's process can, so it is refused.
+void CommandServer::runCommand(Connection &conn, const std::string &line) {
+  if (conn.written > 0 && conn.written == conn.output.size()) {
+    conn.output.clear();
+    conn.written = 0;
+  }
+  responseBuffer.setTarget(&conn.output);
+
+  bool succeeded = false;
+  std::unique_ptr<Command> cmd(
+      CommandFactory::getInstance().createCommand(line, response));
+  if (cmd != nullptr && cmd->accessesFiles()) {
+    response << "Error: " << line[0] << " commands are not served remotely"
+             << std::endl;
+  } else if (cmd != nullptr) {
+    succeeded = store.runCommand(*cmd);
+  }
+  conn.output += succeeded ? "OK\n" : "ERR\n";
+  stats.commands++;
+}
+
+// Writes pending output. Returns false if the connection failed.
+bool CommandServer::flush(Connection &conn) {
+  while (conn.pending() > 0) {
+    ssize_t count = send(conn.fd, conn.output.data() + conn.written,
+                         conn.pending(), MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    conn.written += static_cast<size_t>(count);
+    stats.bytesOut += static_cast<uint64_t>(count);
+  }
+  if (conn.pending() == 0) {
+    conn.output.clear();
+    conn.written = 0;
+  } else if (conn.written > options.outputHighWater) {
+    conn.output.erase(0, conn.written);
+    conn.written = 0;
+  }
+  return true;
+}
+
+// Reads while output is below the high-water mark and waits for
+// writability while output or held back lines are pending.
+bool CommandServer::updateInterest(Connection &conn) {
+  if (conn.peerClosed && conn.pending() == 0 &&
+      conn.input.find('\n') == std::string::npos) {
+    closeConnection(conn);
+    return false;
+  }
+
+  uint32_t wanted = 0;
+  if (!conn.peerClosed && conn.pending() < options.outputHighWater) {
+    wanted |= EPOLLIN;
+  }
+  // Lines held back by backpressure are run on the next writable event,
+  // which also lets the other connections take their turn first.
+  if (conn.pending() > 0 || conn.input.find('\n') != std::string::npos) {
+    wanted |= EPOLLOUT;
+  }
+  if (wanted != conn.events) {
+    epoll_event event{};
+    event.events = wanted;
+    event.data.fd = conn.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+    conn.events = wanted;
+  }
+  return true;
+}
+
+// Closes a connection and releases it.
+void CommandServer::closeConnection(Connection &conn) {
+  int fd = conn.fd;
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  connections[fd].reset();
+  openConnections--;
+}
+
+namespace {
+
+CommandServer *activeServer = nullptr;
+
+// Stops the running server on SIGINT or SIGTERM.
+void handleSignal(int /*unused*/) {
+  if (activeServer != nullptr) {
+    activeServer->stop();
+  }
+}
+
+} // namespace
+
+/**
+ * Runs the command server until interrupted.
+ * Loads the given movie and customer files, data4movies.txt and
+ * data4customers.txt by default, and listens on the given port of the
+ * loopback interface, or of the interface given with --bind.
+ */
+int runServer(int argc, char *argv[]) {
+  CommandServer::Options options;
+  std::vector<std::string> args;
+  unsigned long historyBudget = 0;
+  std::string spillDirectory;
+  bool valid = true;
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--bind") {
+      options.bindAddress = argv[++i];
+    } else if (i + 1 < argc && arg == "--history-budget") {
+      valid = parseNumber(argv[++i], UINT32_MAX, historyBudget) &&
+              historyBudget > 0 && valid;
+    } else if (i + 1 < argc && arg == "--spill-dir") {
+      spillDirectory = argv[++i];
+    } else {
+      args.push_back(arg);
+    }
+  }
+  unsigned long port = options.port;
+  if (!valid || (!spillDirectory.empty() && historyBudget == 0) ||
+      args.size() == 2 || args.size() > 3 ||
+      (!args.empty() && !parseNumber(args[0], 65535, port))) {
+    std::cerr << "Usage: serve [--bind address] [--history-budget N "
+                 "[--spill-dir dir]] [port] [movies customers]"
+              << std::endl;
+    return 1;
+  }
+  options.port = static_cast<uint16_t>(port);
+  std::string moviesFile = args.size() > 2 ? args[1] : "data4movies.txt";
+  std::string customersFile = args.size() > 2 ? args[2] : "data4customers.txt";
+
+  Store store;
+  if (!store.loadMovies(moviesFile) || !store.loadCustomers(customersFile)) {
+    return 1;
+  }
+
+  // A long-running server would otherwise keep every history entry.
+  if (historyBudget > 0 &&
+      !store.setHistoryBudget(historyBudget, spillDirectory)) {
+    return 1;
+  }
+  // Every client sees the errors of its own commands, so none are sampled.
+  store.setErrorDetailLimit(ErrorReporter::UNLIMITED);
+  CommandServer server(store, options);
+  if (!server.start()) {
+    return 1;
+  }
+  activeServer = &server;
+  std::signal(SIGINT, handleSignal);
+  std::signal(SIGTERM, handleSignal);
+  std::cout << "Listening on " << options.bindAddress << " port "
+            << server.getPort() << std::endl;
+
+  server.run();
+  activeServer = nullptr;
+  const CommandServer::Stats &stats = server.getStats();
+  std::cout << "Served " << stats.commands << " commands on "
+            << stats.accepted << " connections (" << stats.rejected
+            << " rejected)" << std::endl;
+  return 0;
+}
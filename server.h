@@ -0,0 +1,118 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "append_buffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Store;
+
+// Serves the command protocol over TCP. Each line a client sends is run as
+// a command against the store; its output is sent back followed by a
+// status line, "OK" if the command succeeded and "ERR" otherwise. Commands
+// that read or write a file named by the client (L and E) are refused, and
+// the server listens on the loopback interface unless told otherwise.
+//
+// A single thread multiplexes every connection with epoll on non-blocking
+// sockets. A client whose unsent output exceeds the high-water mark is not
+// read from until it drains, so slow readers cannot grow memory without
+// bound, and connections beyond the limit are closed on accept.
+class CommandServer {
+public:
+  // Tunable limits of the server.
+  struct Options {
+    // Port to listen on; 0 picks a free port.
+    uint16_t port = 7070;
+    // IPv4 address of the interface to listen on; "0.0.0.0" means all.
+    std::string bindAddress = "127.0.0.1";
+    // Maximum number of simultaneously open client connections.
+    size_t maxConnections = 4096;
+    // Longest accepted command line; longer lines close the connection.
+    size_t maxLineLength = 4096;
+    // Unsent output at which a connection stops being read.
+    size_t outputHighWater = 64 * 1024;
+    // Listen backlog.
+    int backlog = 1024;
+  };
+
+  // Counters describing the server's activity.
+  struct Stats {
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+    uint64_t commands = 0;
+    uint64_t bytesOut = 0;
+  };
+
+  // Constructs a server that runs commands against the store.
+  CommandServer(Store &store, const Options &options);
+  // Closes the listening socket and all connections.
+  ~CommandServer();
+  CommandServer(const CommandServer &) = delete;
+  CommandServer &operator=(const CommandServer &) = delete;
+
+  // Binds and listens. Returns false and reports the error on failure.
+  bool start();
+  // Runs the event loop until stop() is called.
+  void run();
+  // Makes run() return. Safe to call from other threads and signal
+  // handlers.
+  void stop();
+
+  // Returns the port the server is listening on.
+  uint16_t getPort() const { return port; }
+  // Returns the server's activity counters.
+  const Stats &getStats() const { return stats; }
+
+private:
+  struct Connection {
+    int fd;
+    std::string input;
+    std::string output;
+    size_t written = 0;
+    uint32_t events = 0;
+    bool peerClosed = false;
+
+    // Returns the number of output bytes not yet sent.
+    size_t pending() const { return output.size() - written; }
+  };
+
+  Store &store;
+  Options options;
+  uint16_t port;
+  int listenFd = -1;
+  int epollFd = -1;
+  int stopFd = -1;
+  std::atomic<bool> running{false};
+  std::vector<std::unique_ptr<Connection>> connections;
+  size_t openConnections = 0;
+  AppendBuffer responseBuffer;
+  std::ostream response;
+  Stats stats;
+
+  // Accepts every pending connection.
+  void acceptConnections();
+  // Reads available input. Returns false if the connection failed.
+  bool readInput(Connection &conn);
+  // Runs buffered command lines until output backs up.
+  void processInput(Connection &conn);
+  // Runs one command line, appending its output and status.
+  void runCommand(Connection &conn, const std::string &line);
+  // Sends as much pending output as the socket accepts.
+  bool flush(Connection &conn);
+  // Updates the epoll interest set of a connection. Closes it and returns
+  // false once the peer is gone and all output has been sent.
+  bool updateInterest(Connection &conn);
+  // Closes a connection and frees its buffers.
+  void closeConnection(Connection &conn);
+};
+
+// Command line entry point: "serve [--bind address] [--history-budget N
+// [--spill-dir dir]] [port] [movies customers]".
+int runServer(int argc, char *argv[]);
+
+#endif // SERVER_H
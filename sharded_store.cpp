@@ -0,0 +1,284 @@
+#include "sharded_store.h"
+#include "command.h"
+#include "trace.h"
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+namespace {
+
+// Returns the CPU time the calling thread has used.
+double threadCpuSeconds() {
+  timespec now{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return static_cast<double>(now.tv_sec) + now.tv_nsec / 1e9;
+}
+
+// Displays the inventory summed over the shards, from snapshots taken
+// when the report was submitted.
+class MergedInventoryCommand : public Command {
+public:
+  explicit MergedInventoryCommand(std::vector<InventorySnapshot> snapshots)
+      : snapshots(std::move(snapshots)) {}
+
+  bool execute(Store &store) override {
+    store.displayInventory(snapshots);
+    return true;
+  }
+  std::string toString() const override { return "Inventory of all shards"; }
+
+private:
+  std::vector<InventorySnapshot> snapshots;
+};
+
+} // namespace
+
+// Creates the shards and starts one pinned worker per shard.
+ShardedStore::ShardedStore(size_t shardCount) {
+  if (shardCount == 0) {
+    shardCount = 1;
+  }
+  unsigned cores = std::thread::hardware_concurrency();
+  for (size_t i = 0; i < shardCount; i++) {
+    auto shard = std::make_unique<Shard>();
+    shard->outputBuffer.setTarget(&shard->output);
+    shard->outputStream = std::make_unique<std::ostream>(&shard->outputBuffer);
+    shard->store.setOutput(*shard->outputStream, *shard->outputStream);
+    shard->worker = std::thread(work, std::ref(*shard));
+
+    if (cores > 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(i % cores, &cpus);
+      pthread_setaffinity_np(shard->worker.native_handle(), sizeof(cpus),
+                             &cpus);
+    }
+    shards.push_back(std::move(shard));
+  }
+}
+
+// Drains the queues and joins the workers.
+ShardedStore::~ShardedStore() {
+  drain();
+  for (auto &shard : shards) {
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->stopping = true;
+    }
+    shard->ready.notify_one();
+    shard->worker.join();
+  }
+}
+
+// Loads the same catalog into every shard.
+bool ShardedStore::loadMovies(const std::string &filename) {
+  drain();
+  bool loaded = true;
+  for (auto &shard : shards) {
+    loaded = shard->store.loadMovies(filename) && loaded;
+  }
+  return loaded;
+}
+
+// Loads each customer only into the shard that owns it.
+bool ShardedStore::loadCustomers(const std::string &filename) {
+  drain();
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+
+  // The first shard reports malformed lines, so its error summary counts
+  // them once.
+  Store &reporter = shards[0]->store;
+  std::string line;
+  size_t lineNumber = 0;
+  Store::CustomerRecord record;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    if (!line.empty() &&
+        reporter.parseCustomerLine(filename, lineNumber, line, record)) {
+      shards[shardOf(record.id)]->store.addCustomer(
+          record.id, record.lastName, record.firstName);
+    }
+  }
+  for (auto &shard : shards) {
+    shard->store.sortCustomerNames();
+  }
+  return true;
+}
+
+// Routes a command line to the shards that must execute it.
+bool ShardedStore::submit(const std::string &line) {
+  // Parse errors are reported by the routing thread itself, since shard
+  // output may only be written by the shard's worker.
+  std::unique_ptr<Command> cmd(
+      CommandFactory::getInstance().createCommand(line));
+  if (cmd == nullptr) {
+    return false;
+  }
+
+  int customerId = cmd->getCustomerId();
+  if (customerId >= 0) {
+    enqueue(*shards[shardOf(customerId)], std::move(cmd));
+    return true;
+  }
+
+  switch (line[0]) {
+  case 'L':
+    enqueue(*shards[0], std::move(cmd));
+    for (size_t i = 1; i < shards.size(); i++) {
+      enqueue(*shards[i],
+              std::unique_ptr<Command>(
+                  CommandFactory::getInstance().createCommand(line)));
+    }
+    return true;
+  case 'I':
+    submitInventory();
+    return true;
+  default:
+    std::cerr << "Error: " << line[0]
+              << " commands are not supported by a sharded store, "
+                 "discarding line: "
+              << line << std::endl;
+    return false;
+  }
+}
+
+// Snapshots every shard once it has run the commands submitted so far.
+// Pending reloads are applied first, so the shards' catalogs match.
+void ShardedStore::submitInventory() {
+  drain();
+  std::vector<InventorySnapshot> snapshots;
+  for (auto &shard : shards) {
+    shard->store.finishReload();
+    shard->store.materializeCatalog();
+    snapshots.push_back(shard->store.snapshotInventory());
+  }
+  enqueue(*shards[0],
+          std::make_unique<MergedInventoryCommand>(std::move(snapshots)));
+}
+
+// Hands over the pending batches and waits for every queue to empty.
+void ShardedStore::drain() {
+  for (auto &shard : shards) {
+    flush(*shard);
+  }
+  for (auto &shard : shards) {
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    shard->idle.wait(lock, [&shard] {
+      return shard->completed == shard->submitted;
+    });
+  }
+}
+
+// Runs a command file across the shards and prints each shard's output.
+bool ShardedStore::processCommands(const std::string &filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      submit(line);
+    }
+  }
+  drain();
+  for (auto &shard : shards) {
+    shard->store.finishReload();
+    shard->store.printErrorSummary();
+  }
+
+  for (size_t i = 0; i < shards.size(); i++) {
+    std::cout << takeOutput(i);
+  }
+  return true;
+}
+
+// Maps a customer id to its shard.
+size_t ShardedStore::shardOf(int customerId) const {
+  auto count = static_cast<int>(shards.size());
+  return static_cast<size_t>(((customerId % count) + count) % count);
+}
+
+// Returns and clears the output collected from a shard.
+std::string ShardedStore::takeOutput(size_t shard) {
+  drain();
+  std::string output;
+  output.swap(shards[shard]->output);
+  return output;
+}
+
+// Returns a shard's busy time, read under its lock.
+double ShardedStore::busySeconds(size_t shard) {
+  std::lock_guard<std::mutex> lock(shards[shard]->mutex);
+  return shards[shard]->busySeconds;
+}
+
+// Adds a command to a shard's pending batch.
+void ShardedStore::enqueue(Shard &shard, std::unique_ptr<Command> cmd) {
+  if (cmd == nullptr) {
+    return;
+  }
+  shard.pending.push_back(std::move(cmd));
+  if (shard.pending.size() >= BATCH_SIZE) {
+    flush(shard);
+  }
+}
+
+// Moves a shard's pending batch onto its queue and wakes the worker.
+void ShardedStore::flush(Shard &shard) {
+  if (shard.pending.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.submitted += shard.pending.size();
+    shard.queue.push_back(std::move(shard.pending));
+  }
+  shard.pending.clear();
+  shard.ready.notify_one();
+}
+
+// Worker loop: takes every queued batch at once and executes it.
+void ShardedStore::work(Shard &shard) {
+  Tracer::nameThread("shard worker");
+  std::vector<Batch> batches;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      shard.ready.wait(lock, [&shard] {
+        return !shard.queue.empty() || shard.stopping;
+      });
+      if (shard.queue.empty()) {
+        return;
+      }
+      batches.swap(shard.queue);
+    }
+
+    TraceSpan span("shardBatches");
+    double start = threadCpuSeconds();
+    size_t executed = 0;
+    for (auto &batch : batches) {
+      for (auto &cmd : batch) {
+        shard.store.runCommand(*cmd);
+      }
+      executed += batch.size();
+    }
+    batches.clear();
+    double busy = threadCpuSeconds() - start;
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.completed += executed;
+      shard.busySeconds += busy;
+    }
+    shard.idle.notify_all();
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef SHARDED_STORE_H
+#define SHARDED_STORE_H
+
+#include "Store.h"
+#include "append_buffer.h"
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs commands on several independent Store shards in parallel. Customers
+// are partitioned across the shards by id and every shard holds its own
+// replica of the catalog, like the branches of a chain each stocking the
+// same titles. Each shard is owned by one worker thread, pinned to a core,
+// that executes the commands routed to its queue in arrival order, so
+// commands for one customer keep their order.
+//
+// Of the commands that concern the whole store, a catalog reload runs on
+// every shard, and an inventory report sums the shards' stock as of the
+// point in the stream it was submitted. The other store-wide reports (top
+// titles, overdue loans, summaries, name searches, memory) and exports
+// would each describe only one shard, so they are refused.
+class ShardedStore {
+public:
+  // Number of commands handed to a worker at a time.
+  static constexpr size_t BATCH_SIZE = 64;
+
+  // Constructs a store with the given number of shards and starts their
+  // workers.
+  explicit ShardedStore(size_t shardCount);
+  // Finishes the queued commands and stops the workers.
+  ~ShardedStore();
+  ShardedStore(const ShardedStore &) = delete;
+  ShardedStore &operator=(const ShardedStore &) = delete;
+
+  // Loads the catalog into every shard.
+  bool loadMovies(const std::string &filename);
+  // Loads each customer into the shard that owns it.
+  bool loadCustomers(const std::string &filename);
+
+  // Parses a command line and queues it on the shard that owns its
+  // customer, or on every shard. Returns false, after reporting why, if
+  // the line is invalid or a store-wide command a sharded store refuses.
+  bool submit(const std::string &line);
+  // Waits until every submitted command has been executed.
+  void drain();
+  // Runs a file of commands, then writes the output of each shard in turn
+  // to standard output.
+  bool processCommands(const std::string &filename);
+
+  // Returns the number of shards.
+  size_t shardCount() const { return shards.size(); }
+  // Returns the shard that owns a customer.
+  size_t shardOf(int customerId) const;
+  // Returns the output a shard produced since the last call and clears it.
+  std::string takeOutput(size_t shard);
+  // Returns the CPU time a shard's worker spent executing commands.
+  double busySeconds(size_t shard);
+
+private:
+  using Batch = std::vector<std::unique_ptr<Command>>;
+
+  struct Shard {
+    Store store;
+    std::string output;
+    AppendBuffer outputBuffer;
+    std::unique_ptr<std::ostream> outputStream;
+    Batch pending;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable idle;
+    std::vector<Batch> queue;
+    size_t submitted = 0;
+    size_t completed = 0;
+    double busySeconds = 0.0;
+    bool stopping = false;
+    std::thread worker;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards;
+
+  // Waits for the shards, then queues on the first an inventory report of
+  // every shard's stock as of now.
+  void submitInventory();
+  // Queues a command on one shard.
+  void enqueue(Shard &shard, std::unique_ptr<Command> cmd);
+  // Hands a shard's pending batch to its worker.
+  void flush(Shard &shard);
+  // Executes the batches queued on a shard until stopped.
+  static void work(Shard &shard);
+};
+
+#endif // SHARDED_STORE_H
@@ -0,0 +1,263 @@
+#include "simulation.h"
+#include "Store.h"
+#include "arg_parse.h"
+#include "command.h"
+#include "trace.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+// Counters a child sends back through its pipe.
+struct Counts {
+  uint64_t restocked;
+  uint64_t commands;
+  uint64_t borrows;
+  uint64_t outOfStock;
+  uint64_t failed;
+};
+
+// A scenario whose child is still running.
+struct Running {
+  size_t index;
+  int fd;
+};
+
+} // namespace
+
+// Constructs a simulator.
+WhatIfSimulator::WhatIfSimulator(Store &store,
+                                 std::vector<std::string> commands)
+    : store(store), commands(std::move(commands)) {}
+
+// Forks a child per scenario, keeping at most `jobs` alive. A child
+// writes its counters to a pipe and exits without destroying its copy of
+// the store, which would touch, and so copy, every page of it. The
+// counters are smaller than PIPE_BUF, so the write never blocks and the
+// child can be reaped before its pipe is read.
+std::vector<ScenarioResult>
+WhatIfSimulator::run(const std::vector<Scenario> &scenarios, int jobs) {
+  TraceSpan span("simulate");
+  std::vector<ScenarioResult> results(scenarios.size());
+  std::unordered_map<pid_t, Running> running;
+  std::cout.flush();
+  std::cerr.flush();
+
+  auto reap = [&]() {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    auto it = running.find(pid);
+    if (it == running.end()) {
+      return;
+    }
+    ScenarioResult &result = results[it->second.index];
+    Counts counts{};
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+        read(it->second.fd, &counts, sizeof(counts)) == sizeof(counts)) {
+      result.completed = true;
+      result.restocked = counts.restocked;
+      result.commands = counts.commands;
+      result.borrows = counts.borrows;
+      result.outOfStock = counts.outOfStock;
+      result.failed = counts.failed;
+    }
+    close(it->second.fd);
+    running.erase(it);
+  };
+
+  for (size_t i = 0; i < scenarios.size(); i++) {
+    results[i].name = scenarios[i].name;
+    while (static_cast<int>(running.size()) >= jobs) {
+      reap();
+    }
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+      std::cerr << "Error: pipe: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::cerr << "Error: fork: " << std::strerror(errno) << std::endl;
+      close(fds[0]);
+      close(fds[1]);
+      break;
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      ScenarioResult result = simulate(scenarios[i]);
+      Counts counts{result.restocked, result.commands, result.borrows,
+                    result.outOfStock, result.failed};
+      bool sent = write(fds[1], &counts, sizeof(counts)) == sizeof(counts);
+      _exit(sent ? 0 : 1);
+    }
+    close(fds[1]);
+    running[pid] = Running{i, fds[0]};
+  }
+  while (!running.empty()) {
+    reap();
+  }
+  return results;
+}
+
+// Restocks the store as the scenario says, then replays the commands
+// with their output discarded.
+ScenarioResult WhatIfSimulator::simulate(const Scenario &scenario) {
+  ScenarioResult result;
+  for (const StockOverride &change : scenario.overrides) {
+    result.restocked +=
+        store.overrideStock(change.genre, change.minYear, change.stock);
+  }
+
+  std::ofstream sink("/dev/null");
+  store.setOutput(sink, sink);
+  uint64_t refusedBefore = store.getOutOfStockCount();
+  for (const std::string &line : commands) {
+    std::unique_ptr<Command> cmd(
+        CommandFactory::getInstance().createCommand(line, sink));
+    bool succeeded = cmd != nullptr && store.runCommand(*cmd);
+    result.commands++;
+    result.borrows += line[0] == 'B';
+    result.failed += !succeeded;
+  }
+  store.finishReload();
+  result.outOfStock = store.getOutOfStockCount() - refusedBefore;
+  return result;
+}
+
+// Prints each scenario's borrow failures and, after the first, how they
+// compare with the first.
+void WhatIfSimulator::print(const std::vector<ScenarioResult> &results) {
+  for (const ScenarioResult &result : results) {
+    std::cout << result.name << ": ";
+    if (!result.completed) {
+      std::cout << "did not complete" << std::endl;
+      continue;
+    }
+    double percent =
+        result.borrows == 0 ? 0.0 : 100.0 * result.outOfStock / result.borrows;
+    std::cout << result.restocked << " movies restocked, " << result.borrows
+              << " borrows, " << result.outOfStock << " out of stock ("
+              << percent << "%), " << result.failed << " of "
+              << result.commands << " commands failed";
+    const ScenarioResult &base = results.front();
+    if (&result != &base && base.completed) {
+      auto delta = static_cast<int64_t>(result.outOfStock) -
+                   static_cast<int64_t>(base.outOfStock);
+      std::cout << ", " << (delta > 0 ? "+" : "") << delta
+                << " out of stock vs " << base.name;
+    }
+    std::cout << std::endl;
+  }
+}
+
+// Reads "name genre minYear stock" lines, skipping blank lines and
+// comments.
+bool WhatIfSimulator::loadScenarios(const std::string &filename,
+                                    std::vector<Scenario> &scenarios) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string name;
+    char genre = 0;
+    StockOverride change{};
+    if (!(fields >> name >> genre >> change.minYear >> change.stock)) {
+      std::cerr << "Error parsing scenario line: " << line << std::endl;
+      continue;
+    }
+    change.genre = genre == '*' ? 0 : genre;
+
+    Scenario *scenario = nullptr;
+    for (Scenario &existing : scenarios) {
+      if (existing.name == name) {
+        scenario = &existing;
+      }
+    }
+    if (scenario == nullptr) {
+      scenarios.push_back(Scenario{name, {}});
+      scenario = &scenarios.back();
+    }
+    scenario->overrides.push_back(change);
+  }
+  return true;
+}
+
+/**
+ * Loads the store once, then replays the command file under an unchanged
+ * baseline and each scenario in the scenario file, running as many at
+ * once as there are cores unless "--jobs N" says otherwise.
+ */
+int runSimulation(int argc, char *argv[]) {
+  // Each job is a forked process, so their number is capped.
+  const unsigned long maxJobs = 1024;
+  int jobs = static_cast<int>(std::thread::hardware_concurrency());
+  std::vector<std::string> files;
+  bool valid = true;
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--jobs") {
+      unsigned long count = 0;
+      valid = parseNumber(argv[++i], maxJobs, count) && count > 0 && valid;
+      jobs = static_cast<int>(count);
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (!valid || (files.size() != 1 && files.size() != 4)) {
+    std::cerr << "Usage: simulate [--jobs N] scenarios "
+                 "[movies customers commands]"
+              << std::endl;
+    return 1;
+  }
+  if (jobs < 1) {
+    jobs = 1;
+  }
+  std::string moviesFile = files.size() == 4 ? files[1] : "data4movies.txt";
+  std::string customersFile =
+      files.size() == 4 ? files[2] : "data4customers.txt";
+  std::string commandsFile =
+      files.size() == 4 ? files[3] : "data4commands.txt";
+
+  std::vector<Scenario> scenarios{Scenario{"baseline", {}}};
+  if (!WhatIfSimulator::loadScenarios(files[0], scenarios)) {
+    return 1;
+  }
+  std::ifstream file(commandsFile);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << commandsFile << std::endl;
+    return 1;
+  }
+  std::vector<std::string> commands;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      commands.push_back(line);
+    }
+  }
+
+  Store store;
+  if (!store.loadMovies(moviesFile) || !store.loadCustomers(customersFile)) {
+    return 1;
+  }
+  store.materializeCatalog();
+
+  WhatIfSimulator simulator(store, commands);
+  WhatIfSimulator::print(simulator.run(scenarios, jobs));
+  return 0;
+}
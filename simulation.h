@@ -0,0 +1,69 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Store;
+
+// A stock change to try: every movie of the genre (0 means all genres)
+// released in or after `minYear` gets `stock` copies.
+struct StockOverride {
+  char genre;
+  int minYear;
+  int stock;
+};
+
+// A named set of stock changes applied together before the replay.
+struct Scenario {
+  std::string name;
+  std::vector<StockOverride> overrides;
+};
+
+// What replaying the commands under one scenario came to.
+struct ScenarioResult {
+  std::string name;
+  // False if the scenario's process failed before reporting.
+  bool completed = false;
+  uint64_t restocked = 0;
+  uint64_t commands = 0;
+  uint64_t borrows = 0;
+  uint64_t outOfStock = 0;
+  uint64_t failed = 0;
+};
+
+// Replays a command log against a loaded store under many what-if stock
+// scenarios. Each scenario runs in a forked child process, so the loaded
+// catalog and customers are shared copy-on-write and only the pages a
+// scenario changes are copied; up to `jobs` scenarios run at once, one per
+// core. The store itself is never changed.
+class WhatIfSimulator {
+public:
+  // Constructs a simulator over a loaded store and the commands to replay.
+  WhatIfSimulator(Store &store, std::vector<std::string> commands);
+
+  // Runs each scenario and returns their results in the same order.
+  std::vector<ScenarioResult> run(const std::vector<Scenario> &scenarios,
+                                  int jobs);
+  // Prints one line per scenario, comparing each with the first.
+  static void print(const std::vector<ScenarioResult> &results);
+  // Reads scenarios from a file of "name genre minYear stock" lines, where
+  // genre '*' means every genre. Lines with the same name add to one
+  // scenario. Returns false if the file cannot be opened.
+  static bool loadScenarios(const std::string &filename,
+                            std::vector<Scenario> &scenarios);
+
+private:
+  Store &store;
+  std::vector<std::string> commands;
+
+  // Applies a scenario and replays the commands. Runs in the child.
+  ScenarioResult simulate(const Scenario &scenario);
+};
+
+// Command line entry point:
+// "simulate [--jobs N] scenarios [movies customers commands]".
+int runSimulation(int argc, char *argv[]);
+
+#endif // SIMULATION_H
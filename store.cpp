@@ -1,284 +1,1430 @@
 #include "Store.h"
+#include "columnar.h"
 #include "command.h"
 #include "customer.h"
+#include "memory_usage.h"
 #include "movie.h"
 #include "movie_factory.h"
+#include "trace.h"
 #include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
 #include <vector>
 
 // Constructs a new Store object.
-Store::Store() {}
+Store::Store() : out(&std::cout), err(&std::cerr) {}
+
+// Redirects command output and error messages to the given streams.
+void Store::setOutput(std::ostream &output, std::ostream &errors) {
+  out = &output;
+  err = &errors;
+}
 
 // Loads movies from a specified file into the store's inventory.
 bool Store::loadMovies(const std::string &filename) {
+  TraceSpan span("loadMovies");
+  finishReload();
+  materializeCatalog();
   std::ifstream file(filename);
   if (!file.is_open()) {
-    std::cerr << "Error: Cannot open " << filename << std::endl;
+    *err << "Error: Cannot open " << filename << std::endl;
     return false;
   }
+  if (lazyCatalog) {
+    indexMovies(file, filename);
+    return true;
+  }
 
   std::string line;
+  size_t lineNumber = 0;
   while (std::getline(file, line)) {
+    lineNumber++;
     if (line.empty()) {
       continue;
     }
 
-    std::string tempLine = line;
-    trimString(tempLine);
-    std::vector<std::string> parts = split(tempLine, ',');
+    inputErrors.setPosition(filename, lineNumber, line);
+    Movie *movie = parseMovieLine(line, inputErrors, *out, *err);
+    if (movie != nullptr) {
+      auto inserted = movies.insert(std::unique_ptr<Movie>(movie));
+      if (inserted.second) {
+        attachTotals(*movie);
+        std::string key = movie->getKey();
+        admission.addMovie(key);
+        movieIndex.insert(key, movie);
+        versions.publish(*movie);
+      }
+    }
+  }
+
+  publishCatalog();
+  return true;
+}
+
+// Switches loadMovies between building every movie and indexing the file.
+void Store::setLazyCatalog(bool lazy) { lazyCatalog = lazy; }
 
-    if (parts.size() < 5) {
-      std::cerr << "Error: Invalid movie format: " << line << std::endl;
+// Indexes a movie file. Lines that will not build a movie are parsed in
+// full so they are reported just as loadMovies would report them.
+void Store::indexMovies(std::ifstream &file, const std::string &filename) {
+  MovieFactory &factory = MovieFactory::getInstance();
+  MovieRecord record;
+  InputError error;
+  std::string line;
+  size_t lineNumber = 0;
+  std::streamoff offset = 0;
+  while (std::getline(file, line)) {
+    std::streamoff start = offset;
+    offset += line.size() + 1;
+    lineNumber++;
+    if (line.empty()) {
       continue;
     }
 
-    for (auto &part : parts) {
-      trimString(part);
+    std::string key;
+    if (splitMovieLine(line, record, error)) {
+      key = factory.recordKey(record.genre, record.director, record.title,
+                              record.extra);
+    }
+    if (key.empty()) {
+      inputErrors.setPosition(filename, lineNumber, line);
+      std::unique_ptr<Movie> rejected(
+          parseMovieLine(line, inputErrors, *out, *err));
+      continue;
     }
 
-    char genre = parts[0][0];
-    int stock;
-
-    try {
-      stock = std::stoi(parts[1]);
-    } catch (...) {
-      std::cerr << "Error: Invalid stock number in: " << line << std::endl;
+    // As when loading eagerly, the first line of a title wins.
+    if (movieIndex.exists(key) || unbuiltMovies.exists(key)) {
       continue;
     }
+    admission.addMovie(key);
+    unbuiltMovies.insert(std::move(key), lazyRecords.size());
+    StockTally tally = totals.tally(record.genre, std::string(record.director));
+    int stock = totalCount(record.stock);
+    tally.add(stock, 0, 1);
+    lazyRecords.push_back({start, lineNumber, stock, tally});
+  }
+
+  lazyFilename = filename;
+  lazyFile.open(filename);
+  publishCatalog();
+}
 
-    std::string director = parts[2];
-    std::string title = parts[3];
-    std::string extra = parts[4];
+// Reads the line of a lazily loaded record and builds its movie.
+Movie *Store::buildMovie(size_t record) {
+  LazyRecord &lazy = lazyRecords[record];
+  lazy.tally.add(lazy.stock, 0, -1);
+  std::string line;
+  lazyFile.clear();
+  lazyFile.seekg(lazy.offset);
+  std::getline(lazyFile, line);
+  lazy.offset = BUILT;
+
+  ErrorReporter reporter(inputErrors.getDetailLimit());
+  Movie *movie = buildMovie(line, lazy.lineNumber, reporter);
+  inputErrors.add(reporter.getCounts());
+  return movie;
+}
+
+// Builds a movie from a line of the lazily loaded file and adds it to the
+// inventory. Problems, which mean the file changed after it was indexed,
+// are counted in a reporter of their own so they are attributed to that
+// file rather than the command being run.
+Movie *Store::buildMovie(const std::string &line, size_t lineNumber,
+                         ErrorReporter &reporter) {
+  reporter.setPosition(lazyFilename, lineNumber, line);
+  std::unique_ptr<Movie> movie(parseMovieLine(line, reporter, *out, *err));
+  if (movie == nullptr) {
+    return nullptr;
+  }
+  std::string key = movie->getKey();
+  if (movieIndex.exists(key)) {
+    return nullptr;
+  }
+
+  Movie *built = movie.get();
+  movies.insert(std::move(movie));
+  attachTotals(*built);
+  movieIndex.insert(key, built);
+  versions.publish(*built);
+  return built;
+}
+
+// Builds the movies of a lazily loaded catalog that no command has looked
+// up yet, reading the file front to back from the first of them, and
+// publishes the complete catalog.
+void Store::materializeCatalog() {
+  TraceSpan span("materializeCatalog");
+  if (lazyRecords.empty()) {
+    return;
+  }
 
-    for (size_t i = 5; i < parts.size(); i++) {
-      extra += "," + parts[i];
+  // The built movies are counted in place of their records.
+  for (const LazyRecord &lazy : lazyRecords) {
+    if (lazy.offset != BUILT) {
+      lazy.tally.add(lazy.stock, 0, -1);
     }
+  }
 
-    Movie *movie = MovieFactory::getInstance().createMovie(
-        genre, stock, director, title, extra);
-    if (movie != nullptr) {
-      movies.insert(std::unique_ptr<Movie>(movie));
-    } else {
-      std::cout << "Unknown movie type: " << genre
-                << ", discarding line: " << line << std::endl;
+  size_t next = 0;
+  auto skipBuilt = [&] {
+    while (next < lazyRecords.size() && lazyRecords[next].offset == BUILT) {
+      next++;
+    }
+  };
+  skipBuilt();
+  if (next < lazyRecords.size()) {
+    std::streamoff offset = lazyRecords[next].offset;
+    lazyFile.clear();
+    lazyFile.seekg(offset);
+    ErrorReporter reporter(inputErrors.getDetailLimit());
+    std::string line;
+    while (next < lazyRecords.size() && std::getline(lazyFile, line)) {
+      std::streamoff start = offset;
+      offset += line.size() + 1;
+      if (start == lazyRecords[next].offset) {
+        buildMovie(line, lazyRecords[next].lineNumber, reporter);
+        next++;
+        skipBuilt();
+      }
     }
+    inputErrors.add(reporter.getCounts());
   }
 
-  return true;
+  lazyRecords.clear();
+  unbuiltMovies.clear();
+  lazyFile.close();
+  publishCatalog();
 }
 
 // Loads customer data from a specified file.
 bool Store::loadCustomers(const std::string &filename) {
+  TraceSpan span("loadCustomers");
   std::ifstream file(filename);
   if (!file.is_open()) {
-    std::cerr << "Error: Cannot open " << filename << std::endl;
+    *err << "Error: Cannot open " << filename << std::endl;
     return false;
   }
 
   std::string line;
+  size_t lineNumber = 0;
+  CustomerRecord record;
   while (std::getline(file, line)) {
-    if (line.empty()) {
+    lineNumber++;
+    if (!line.empty() &&
+        parseCustomerLine(filename, lineNumber, line, record)) {
+      addCustomer(record.id, record.lastName, record.firstName);
+    }
+  }
+  sortCustomerNames();
+  return true;
+}
+
+// Splits a customer line into its id and names, reporting it if they are
+// missing.
+bool Store::parseCustomerLine(const std::string &source, size_t lineNumber,
+                              const std::string &line,
+                              CustomerRecord &record) {
+  std::istringstream iss(line);
+  if (iss >> record.id >> record.lastName >> record.firstName) {
+    return true;
+  }
+  inputErrors.setPosition(source, lineNumber, line);
+  if (inputErrors.admit(InputError::InvalidCustomerLine)) {
+    *err << "Error parsing customer line: " << line << std::endl;
+  }
+  return false;
+}
+
+// Sorts newly added customers into the name index.
+void Store::sortCustomerNames() { customerNames.sort(); }
+
+// Adds a customer to the store.
+void Store::addCustomer(int id, const std::string &lastName,
+                        const std::string &firstName) {
+  customerNames.add(customers.add(id, lastName, firstName));
+  admission.addCustomer(id);
+}
+
+// Processes a file of commands.
+bool Store::processCommands(const std::string &filename) {
+  TraceSpan span("processCommands");
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    *err << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  size_t lineNumber = 0;
+  while (std::getline(file, line)) {
+    processLine(filename, ++lineNumber, line);
+  }
+  finishCommands();
+  return true;
+}
+
+// Waits for the batch and a reload in progress, then summarizes the
+// errors of the stream.
+void Store::finishCommands() {
+  finishBatch();
+  finishReload();
+  printErrorSummary();
+}
+
+// Counts the movie in its genre's and director's totals.
+void Store::attachTotals(Movie &movie) {
+  movie.attachTotals(totals.tally(movie.getGenre(), movie.getDirector()));
+}
+
+// Processes the lines as if they were the lines of a file, running what
+// is left of the last batch at the end.
+void Store::processLines(const std::vector<std::string> &lines,
+                         const std::string &source) {
+  size_t lineNumber = 0;
+  for (const std::string &line : lines) {
+    processLine(source, ++lineNumber, line);
+  }
+  finishBatch();
+}
+
+// Runs a line another thread parsed. Lines that did not parse are rare,
+// so parsing them again is cheaper than carrying their error out of the
+// parsing thread, and reports them exactly as processLine does.
+void Store::processParsedLine(const std::string &source, size_t lineNumber,
+                              std::string line,
+                              std::unique_ptr<Command> command) {
+  if (command == nullptr) {
+    processLine(source, lineNumber, line);
+    return;
+  }
+  runLine(source, lineNumber, std::move(line), std::move(command));
+}
+
+// Parses a command line and runs it.
+void Store::processLine(const std::string &source, size_t lineNumber,
+                        const std::string &line) {
+  if (line.empty()) {
+    return;
+  }
+
+  // While commands are batched, a line that fails to parse is reported
+  // only after the batch has run, to keep the output in order.
+  inputErrors.setPosition(source, lineNumber, line);
+  std::unique_ptr<Command> cmd(CommandFactory::getInstance().createCommand(
+      line, batch.empty() ? *out : deferred, inputErrors));
+  runLine(source, lineNumber, line, std::move(cmd));
+}
+
+// Batches borrows and returns; anything else runs the batch first, so
+// commands take effect in stream order.
+void Store::runLine(const std::string &source, size_t lineNumber,
+                    std::string line, std::unique_ptr<Command> cmd) {
+  StockRequest request;
+  if (cmd != nullptr && batchSize > 1 && cmd->getStockRequest(request)) {
+    batch.push_back(
+        {std::move(cmd), request, std::move(line), &source, lineNumber, ++now});
+    if (batch.size() >= batchSize) {
+      runBatch();
+    }
+    return;
+  }
+
+  finishBatch();
+  if (cmd != nullptr) {
+    inputErrors.setPosition(source, lineNumber, line);
+    runCommand(*cmd);
+  }
+}
+
+// Runs the batch, then writes what was deferred.
+void Store::finishBatch() {
+  runBatch();
+  if (deferred.tellp() > 0) {
+    *out << deferred.str();
+    deferred.str("");
+  }
+}
+
+// Sets the number of borrows and returns executed as one batch.
+void Store::setBatchSize(size_t size) { batchSize = size; }
+
+// Sets the loan period of later borrows.
+void Store::setLoanPeriod(uint64_t ticks) { loanPeriod = ticks; }
+
+// Sets the history budget, creating the spill file the first time.
+bool Store::setHistoryBudget(size_t entries, const std::string &directory) {
+  if (!historySpill) {
+    std::string path = directory;
+    if (path.empty()) {
+      path = std::filesystem::temp_directory_path().string();
+    }
+    auto spill = std::make_unique<HistorySpill>(entries, path);
+    if (!spill->isOpen()) {
+      return false;
+    }
+    historySpill = std::move(spill);
+  }
+  historySpill->setBudget(entries);
+  return true;
+}
+
+// Runs the batched borrows and returns in three passes: looks up each
+// distinct title once, applies the stock changes movie by movie in
+// command order, then records and reports every command in its original
+// order. The results are those of running the commands one at a time.
+void Store::runBatch() {
+  TraceSpan span("runBatch");
+  if (batch.empty()) {
+    return;
+  }
+  applyReadyReload();
+
+  // Validate the media types and customers, then look up the titles in
+  // search order so repeated searches are resolved once.
+  batchOrder.clear();
+  for (size_t i = 0; i < batch.size(); i++) {
+    BatchSlot &slot = batch[i];
+    slot.valid = false;
+    slot.succeeded = false;
+    slot.customer = nullptr;
+    slot.movie = nullptr;
+    slot.holdFilled = nullptr;
+    int format = mediaFormat(slot.request.mediaType);
+    if (format < 0) {
+      slot.error = InputError::InvalidMediaType;
       continue;
     }
+    slot.format = static_cast<MediaFormat>(format);
+    if (admission.mayHaveCustomer(slot.request.customerId)) {
+      slot.customer = findCustomer(slot.request.customerId);
+    }
+    if (slot.customer == nullptr) {
+      slot.error = InputError::InvalidCustomer;
+      continue;
+    }
+    slot.error = InputError::InvalidMovie;
+    if (admission.mayHaveMovie(slot.request.movieType,
+                               *slot.request.movieInfo)) {
+      batchOrder.push_back(i);
+    }
+  }
+
+  std::sort(batchOrder.begin(), batchOrder.end(), [this](size_t a, size_t b) {
+    const StockRequest &x = batch[a].request;
+    const StockRequest &y = batch[b].request;
+    if (x.movieType != y.movieType) {
+      return x.movieType < y.movieType;
+    }
+    int order = x.movieInfo->compare(*y.movieInfo);
+    return order != 0 ? order < 0 : a < b;
+  });
+  const StockRequest *previous = nullptr;
+  Movie *movie = nullptr;
+  for (size_t index : batchOrder) {
+    BatchSlot &slot = batch[index];
+    const StockRequest &request = slot.request;
+    if (previous == nullptr || previous->movieType != request.movieType ||
+        *previous->movieInfo != *request.movieInfo) {
+      movie = findMovie(request.movieType, *request.movieInfo);
+      previous = &request;
+    }
+    slot.movie = movie;
+    slot.valid = movie != nullptr;
+  }
 
-    std::istringstream iss(line);
-    int id;
-    std::string lastName;
-    std::string firstName;
+  // Apply the stock changes movie by movie, in command order within each
+  // movie, publishing each movie's counters once.
+  batchOrder.erase(std::remove_if(batchOrder.begin(), batchOrder.end(),
+                                  [this](size_t index) {
+                                    return !batch[index].valid;
+                                  }),
+                   batchOrder.end());
+  std::sort(batchOrder.begin(), batchOrder.end(), [this](size_t a, size_t b) {
+    if (batch[a].movie != batch[b].movie) {
+      return std::less<const Movie *>()(batch[a].movie, batch[b].movie);
+    }
+    return a < b;
+  });
+  for (size_t k = 0; k < batchOrder.size();) {
+    movie = batch[batchOrder[k]].movie;
+    bool changed = false;
+    for (; k < batchOrder.size() && batch[batchOrder[k]].movie == movie; k++) {
+      BatchSlot &slot = batch[batchOrder[k]];
+      if (slot.request.type == Transaction::BORROW) {
+        slot.succeeded = movie->borrowMovie(slot.format);
+      } else {
+        movie->returnMovie(slot.format);
+        slot.succeeded = true;
+        if (!holds[slot.format].empty()) {
+          slot.holdFilled = lendToHold(movie, slot.format);
+        }
+      }
+      changed = changed || slot.succeeded;
+    }
+    if (changed) {
+      versions.publish(*movie);
+    }
+  }
 
-    if (iss >> id >> lastName >> firstName) {
-      auto customer = std::make_unique<Customer>(id, lastName, firstName);
-      customers.insert(id, customer.get());
-      customerStorage.push_back(std::move(customer));
+  // Record and report the commands in their original order.
+  for (BatchSlot &slot : batch) {
+    const StockRequest &request = slot.request;
+    if (!slot.valid) {
+      inputErrors.setPosition(*slot.source, slot.lineNumber, slot.line);
+      reportInvalidRequest(slot.error, request.customerId, request.mediaType,
+                           request.movieType, *request.movieInfo,
+                           slot.customer);
+    } else if (request.type == Transaction::BORROW) {
+      if (slot.succeeded) {
+        recordBorrow(*slot.customer, slot.movie, slot.format, slot.time);
+      } else {
+        reportOutOfStock(*slot.customer, *slot.movie, slot.format);
+      }
     } else {
-      std::cerr << "Error parsing customer line: " << line << std::endl;
+      recordReturn(*slot.customer, slot.movie, slot.format, slot.time);
+      if (slot.holdFilled != nullptr) {
+        recordHoldFilled(*slot.holdFilled, slot.movie, slot.format,
+                         slot.time);
+      }
     }
   }
-  return true;
+  batch.clear();
 }
 
-// Processes a file of commands.
-bool Store::processCommands(const std::string &filename) {
+// Sets the number of input errors of each kind that are detailed.
+void Store::setErrorDetailLimit(size_t limit) {
+  inputErrors.setDetailLimit(limit);
+}
+
+// Starts recording input errors in a sidecar file.
+bool Store::openErrorSidecar(const std::string &path) {
+  return inputErrors.openSidecar(path);
+}
+
+// Writes the input error summary to the error stream.
+void Store::printErrorSummary() { inputErrors.printSummary(*err); }
+
+// Executes a command once any finished catalog reload has been applied.
+bool Store::runCommand(Command &command) {
+  TraceSpan span("execute");
+  applyReadyReload();
+  now++;
+  return command.execute(*this);
+}
+
+// Applies the pending catalog reload if it has finished diffing.
+void Store::applyReadyReload() {
+  if (pendingReload.valid() &&
+      pendingReload.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    applyCatalogDiff(pendingReload.get());
+  }
+}
+
+// Starts diffing a catalog file against the inventory in the background.
+void Store::reloadCatalog(const std::string &filename) {
+  finishReload();
+  materializeCatalog();
+  size_t detailLimit = inputErrors.getDetailLimit();
+  pendingReload =
+      std::async(std::launch::async, [this, filename, detailLimit] {
+        return diffCatalog(filename, detailLimit);
+      });
+}
+
+// Applies the pending catalog reload, waiting for its diff if necessary.
+void Store::finishReload() {
+  if (pendingReload.valid()) {
+    applyCatalogDiff(pendingReload.get());
+  }
+}
+
+// Restocks the matching movies the way a reload does.
+size_t Store::overrideStock(char genre, int minYear, int stock) {
+  finishReload();
+  materializeCatalog();
+  size_t changed = 0;
+  for (const auto &entry : movies) {
+    Movie *movie = entry.get();
+    if ((genre != 0 && movie->getGenre() != genre) ||
+        movie->getYear() < minYear) {
+      continue;
+    }
+    FormatCounts counts = movie->getStock();
+    counts[DVD] = stock;
+    movie->setStock(counts);
+    fillHolds(movie);
+    versions.publish(*movie);
+    changed++;
+  }
+  return changed;
+}
+
+// Diffs a catalog file against a snapshot of the inventory. Movies are
+// only read through the snapshot and their immutable key fields.
+CatalogDiff Store::diffCatalog(const std::string &filename,
+                               size_t detailLimit) const {
+  TraceSpan span("diffCatalog");
+  CatalogDiff diff;
+  diff.filename = filename;
   std::ifstream file(filename);
   if (!file.is_open()) {
-    std::cerr << "Error: Cannot open " << filename << std::endl;
-    return false;
+    diff.errors = "Error: Cannot open " + filename + "\n";
+    return diff;
+  }
+  diff.opened = true;
+
+  // Live keys and stock in catalog order, so retirements are reported in
+  // inventory order.
+  std::vector<std::pair<std::string, FormatCounts>> live;
+  {
+    InventorySnapshot snapshot = versions.snapshot();
+    live.reserve(snapshot.size());
+    for (size_t i = 0; i < snapshot.size(); i++) {
+      InventorySnapshot::Row row = snapshot.row(i);
+      live.emplace_back(row.movie->getKey(), row.stock);
+    }
+  }
+  std::unordered_map<std::string, size_t> liveIndex;
+  liveIndex.reserve(live.size());
+  for (size_t i = 0; i < live.size(); i++) {
+    liveIndex.emplace(live[i].first, i);
   }
 
+  std::ostringstream output;
+  std::ostringstream errors;
+  ErrorReporter reporter(detailLimit);
+  std::vector<bool> listed(live.size(), false);
+  std::unordered_set<std::string> addedKeys;
   std::string line;
+  size_t lineNumber = 0;
   while (std::getline(file, line)) {
+    lineNumber++;
     if (line.empty()) {
       continue;
     }
 
-    Command *cmd = CommandFactory::getInstance().createCommand(line);
-    if (cmd != nullptr) {
-      cmd->execute(*this);
-      delete cmd;
+    reporter.setPosition(filename, lineNumber, line);
+    std::unique_ptr<Movie> movie(
+        parseMovieLine(line, reporter, output, errors));
+    if (movie == nullptr) {
+      continue;
+    }
+
+    std::string key = movie->getKey();
+    auto it = liveIndex.find(key);
+    if (it == liveIndex.end()) {
+      if (addedKeys.insert(key).second) {
+        diff.added.push_back(std::move(movie));
+      }
+    } else if (!listed[it->second]) {
+      listed[it->second] = true;
+      if (live[it->second].second != movie->getStock()) {
+        diff.restocked.emplace_back(key, movie->getStock());
+      }
     }
   }
-  return true;
+
+  for (size_t i = 0; i < live.size(); i++) {
+    if (!listed[i]) {
+      diff.retired.push_back(std::move(live[i].first));
+    }
+  }
+  diff.output = output.str();
+  diff.errors = errors.str();
+  diff.errorCounts = reporter.getCounts();
+  return diff;
 }
 
-// Finds a movie in the inventory based on its genre and search criteria.
-Movie *Store::findMovie(char genre, const std::string &searchCriteria) {
-  std::string parsedCriteria = parseMovieSearchCriteria(genre, searchCriteria);
-
-  for (const auto &moviePtr : movies) {
-    if (moviePtr->getGenre() == genre) {
-      if (genre == 'F') { // Comedy: Title, Year
-        std::vector<std::string> parts = split(parsedCriteria, ',');
-        if (parts.size() >= 2) {
-          std::string searchTitle = parts[0];
-          trimString(searchTitle);
-          int searchYear = 0;
-          try {
-            searchYear = std::stoi(parts[1]);
-          } catch (...) {
-            continue;
-          }
-
-          const Comedy *comedy = dynamic_cast<const Comedy *>(moviePtr.get());
-          if ((comedy != nullptr) && comedy->getTitle() == searchTitle &&
-              comedy->getYear() == searchYear) {
-            return moviePtr.get();
-          }
-        }
-      } else if (genre == 'D') { // Drama: Director, Title
-        std::vector<std::string> parts = split(parsedCriteria, ',');
-        if (parts.size() >= 2) {
-          std::string searchDirector = parts[0];
-          std::string searchTitle = parts[1];
-          trimString(searchDirector);
-          trimString(searchTitle);
-
-          const Drama *drama = dynamic_cast<const Drama *>(moviePtr.get());
-          if ((drama != nullptr) && drama->getDirector() == searchDirector &&
-              drama->getTitle() == searchTitle) {
-            return moviePtr.get();
-          }
-        }
-      } else if (genre == 'C') { // Classic: Month Year Actor
-        std::istringstream iss(parsedCriteria);
-        int searchMonth = 0;
-        int searchYear = 0;
-        std::string actorFirstName;
-        std::string actorLastName;
-
-        iss >> searchMonth >> searchYear >> actorFirstName >> actorLastName;
-        std::string searchActor = actorFirstName + " " + actorLastName;
-        trimString(searchActor);
-
-        const Classic *classic = dynamic_cast<const Classic *>(moviePtr.get());
-        if ((classic != nullptr) && classic->getMonth() == searchMonth &&
-            classic->getYear() == searchYear &&
-            classic->getActor() == searchActor) {
-          return moviePtr.get();
-        }
+// Applies a catalog diff. Each change costs a key lookup, except that the
+// catalog order is republished once if titles were added or retired.
+void Store::applyCatalogDiff(CatalogDiff diff) {
+  TraceSpan span("applyCatalogDiff");
+  *out << diff.output;
+  *err << diff.errors;
+  inputErrors.add(diff.errorCounts);
+  if (!diff.opened) {
+    return;
+  }
+
+  size_t added = 0;
+  for (auto &movie : diff.added) {
+    std::string key = movie->getKey();
+    if (movieIndex.exists(key)) {
+      continue;
+    }
+    auto retired = retiredMovies.find(key);
+    if (retired != retiredMovies.end()) {
+      retired->second->setStock(movie->getStock());
+      movie = std::move(retired->second);
+      retiredMovies.erase(retired);
+    }
+    Movie *inserted = movie.get();
+    movies.insert(std::move(movie));
+    attachTotals(*inserted);
+    admission.addMovie(key);
+    movieIndex.insert(key, inserted);
+    versions.publish(*inserted);
+    added++;
+  }
+
+  size_t restocked = 0;
+  for (const auto &change : diff.restocked) {
+    Movie *movie = nullptr;
+    if (!movieIndex.find(change.first, movie)) {
+      continue;
+    }
+    movie->setStock(change.second);
+    fillHolds(movie);
+    versions.publish(*movie);
+    restocked++;
+  }
+
+  size_t retired = 0;
+  for (const auto &key : diff.retired) {
+    Movie *movie = nullptr;
+    if (!movieIndex.find(key, movie)) {
+      continue;
+    }
+    for (int format = 0; format < MEDIA_FORMATS; format++) {
+      auto hold = holds[format].find(movie);
+      if (hold != holds[format].end()) {
+        report << "Cancelled " << hold->second.size() << " holds on "
+               << movie->getTitle();
+        appendMediaFormat(report, static_cast<MediaFormat>(format));
+        report << '\n';
+        report.flushTo(*out);
+        holds[format].erase(hold);
       }
     }
+    movieIndex.remove(key);
+    movie->detachTotals();
+    retiredMovies[key] = std::move(movies.extract(movies.find(movie)).value());
+    retired++;
+  }
+
+  if (added > 0 || retired > 0) {
+    publishCatalog();
   }
-  return nullptr;
+  report << "Reloaded catalog from " << diff.filename << ": " << added
+         << " added, " << restocked << " restocked, " << retired
+         << " retired\n";
+  report.flushTo(*out);
+}
+
+// Finds a movie in the inventory by the key its search criteria describe.
+Movie *Store::findMovie(char genre, const std::string &searchCriteria) {
+  TraceSpan span("findMovie");
+  std::string key = searchKey(genre, searchCriteria);
+  Movie *movie = nullptr;
+  if (key.empty() || movieIndex.find(key, movie)) {
+    return movie;
+  }
+
+  // Build the movie now if its catalog line was only indexed.
+  size_t record = 0;
+  if (!unbuiltMovies.find(key, record)) {
+    return nullptr;
+  }
+  unbuiltMovies.remove(key);
+  movie = buildMovie(record);
+  return movie != nullptr && movie->getKey() == key ? movie : nullptr;
 }
 
 // Finds a customer in the store by their ID.
 Customer *Store::findCustomer(int customerId) {
-  Customer *customer = nullptr;
-  if (customers.find(customerId, customer)) {
-    return customer;
-  }
-  return nullptr;
+  return customers.find(customerId);
 }
 
 // Processes a movie borrow transaction.
 bool Store::borrowMovie(int customerId, char mediaType, char movieType,
                         const std::string &movieInfo) {
-  if (mediaType != 'D') {
-    std::cout << "Invalid media type " << mediaType
-              << ", discarding line: " << movieType << " " << movieInfo
-              << std::endl;
+  MediaFormat format = DVD;
+  Customer *customer = nullptr;
+  Movie *movie = nullptr;
+  if (!resolveRequest(customerId, mediaType, movieType, movieInfo, format,
+                      customer, movie)) {
     return false;
   }
 
-  Customer *customer = findCustomer(customerId);
-  if (customer == nullptr) {
-    std::cout << "Invalid customer ID " << customerId
-              << ", discarding line: " << mediaType << " " << movieType << " "
-              << movieInfo << std::endl;
+  if (!movie->borrowMovie(format)) {
+    reportOutOfStock(*customer, *movie, format);
     return false;
   }
 
-  Movie *movie = findMovie(movieType, movieInfo);
-  if (movie == nullptr) {
-    std::cout << "Invalid movie for customer " << customer->getFullName()
-              << ", discarding line: " << movieInfo << std::endl;
+  versions.publish(*movie);
+  recordBorrow(*customer, movie, format, now);
+  return true;
+}
+
+// Processes a movie borrow, placing a hold when the movie is out of stock.
+bool Store::holdMovie(int customerId, char mediaType, char movieType,
+                      const std::string &movieInfo) {
+  MediaFormat format = DVD;
+  Customer *customer = nullptr;
+  Movie *movie = nullptr;
+  if (!resolveRequest(customerId, mediaType, movieType, movieInfo, format,
+                      customer, movie)) {
     return false;
   }
 
-  if (!movie->borrowMovie()) {
-    std::cout << "==========================" << std::endl;
-    std::cout << customer->getFullName() << " could NOT borrow "
-              << movie->getTitle() << ", out of stock: " << std::endl;
-    std::cout << "==========================" << std::endl;
-    std::cout << "Failed to execute command: Borrow " << customer->getFullName()
-              << " " << movie->getTitle() << std::endl;
-    return false;
+  if (movie->borrowMovie(format)) {
+    versions.publish(*movie);
+    recordBorrow(*customer, movie, format, now);
+    return true;
   }
 
-  customer->addTransaction(Transaction::BORROW, movie);
+  HoldQueue &queue = holds[format][movie];
+  queue.push(customerId);
+  customer->formatTo(report);
+  report << " placed a hold on " << movie->getTitle();
+  appendMediaFormat(report, format);
+  report << ", position " << queue.size() << '\n';
+  report.flushTo(*out);
   return true;
 }
 
 // Processes a movie return transaction.
 bool Store::returnMovie(int customerId, char mediaType, char movieType,
                         const std::string &movieInfo) {
-  if (mediaType != 'D') {
-    std::cout << "Invalid media type " << mediaType
-              << ", discarding line: " << movieType << " " << movieInfo
-              << std::endl;
+  MediaFormat format = DVD;
+  Customer *customer = nullptr;
+  Movie *movie = nullptr;
+  if (!resolveRequest(customerId, mediaType, movieType, movieInfo, format,
+                      customer, movie)) {
     return false;
   }
 
-  Customer *customer = findCustomer(customerId);
+  movie->returnMovie(format);
+  recordReturn(*customer, movie, format, now);
+  if (!holds[format].empty()) {
+    fulfillHold(movie, format);
+  }
+  versions.publish(*movie);
+  return true;
+}
+
+// Runs a borrow, hold or return the way borrowMovie, holdMovie and
+// returnMovie do, recording what they would report in the outcome.
+StockOutcome Store::transact(const StockRequest &request, bool hold) {
+  TraceSpan span("transact");
+  applyReadyReload();
+  now++;
+  StockOutcome outcome;
+  outcome.time = now;
+  Customer *customer = nullptr;
+  Movie *movie = nullptr;
+  if (!lookupRequest(request.customerId, request.mediaType, request.movieType,
+                     *request.movieInfo, outcome.format, customer, movie,
+                     outcome.error)) {
+    outcome.customer = customer;
+    return outcome;
+  }
+  outcome.customer = customer;
+  outcome.movie = movie;
+  MediaFormat format = outcome.format;
+
+  if (request.type == Transaction::RETURN) {
+    movie->returnMovie(format);
+    recordReturn(*customer, movie, format, now);
+    Customer *served =
+        holds[format].empty() ? nullptr : lendToHold(movie, format);
+    if (served != nullptr) {
+      recordBorrow(*served, movie, format, now);
+      outcome.holdFilled = served;
+    }
+    versions.publish(*movie);
+    outcome.status = StockOutcome::DONE;
+    return outcome;
+  }
+
+  if (movie->borrowMovie(format)) {
+    versions.publish(*movie);
+    recordBorrow(*customer, movie, format, now);
+    outcome.status = StockOutcome::DONE;
+  } else if (hold) {
+    HoldQueue &queue = holds[format][movie];
+    queue.push(request.customerId);
+    outcome.holdPosition = queue.size();
+    outcome.status = StockOutcome::HELD;
+  } else {
+    outOfStock++;
+    outcome.status = StockOutcome::OUT_OF_STOCK;
+  }
+  return outcome;
+}
+
+// Returns the number of customers waiting for a movie in a format.
+size_t Store::holdCount(const Movie *movie, MediaFormat format) const {
+  auto it = holds[format].find(movie);
+  return it == holds[format].end() ? 0 : it->second.size();
+}
+
+// Looks up the format, customer and movie of a borrow, hold or return
+// request, stopping at the first that is invalid.
+bool Store::lookupRequest(int customerId, char mediaType, char movieType,
+                          const std::string &movieInfo, MediaFormat &format,
+                          Customer *&customer, Movie *&movie,
+                          InputError &error) {
+  customer = nullptr;
+  movie = nullptr;
+  int code = mediaFormat(mediaType);
+  if (code < 0) {
+    error = InputError::InvalidMediaType;
+    return false;
+  }
+  format = static_cast<MediaFormat>(code);
+
+  customer = admission.mayHaveCustomer(customerId) ? findCustomer(customerId)
+                                                   : nullptr;
   if (customer == nullptr) {
-    std::cout << "Invalid customer ID " << customerId
-              << ", discarding line: " << mediaType << " " << movieType << " "
-              << movieInfo << std::endl;
+    error = InputError::InvalidCustomer;
     return false;
   }
 
-  Movie *movie = findMovie(movieType, movieInfo);
+  movie = admission.mayHaveMovie(movieType, movieInfo)
+              ? findMovie(movieType, movieInfo)
+              : nullptr;
   if (movie == nullptr) {
-    std::cout << "Invalid movie for customer " << customer->getFullName()
-              << ", discarding line: " << movieInfo << std::endl;
+    error = InputError::InvalidMovie;
     return false;
   }
-
-  movie->returnMovie();
-  customer->addTransaction(Transaction::RETURN, movie);
   return true;
 }
 
-// Displays the current inventory of all movies.
+// Validates a borrow, hold or return request and looks up its format,
+// customer and movie, reporting the first problem found.
+bool Store::resolveRequest(int customerId, char mediaType, char movieType,
+                           const std::string &movieInfo, MediaFormat &format,
+                           Customer *&customer, Movie *&movie) {
+  InputError error = InputError::InvalidMovie;
+  if (lookupRequest(customerId, mediaType, movieType, movieInfo, format,
+                    customer, movie, error)) {
+    return true;
+  }
+  reportInvalidRequest(error, customerId, mediaType, movieType, movieInfo,
+                       customer);
+  return false;
+}
+
+// Reports a borrow, hold or return request that names an invalid media
+// type, customer or movie.
+void Store::reportInvalidRequest(InputError error, int customerId,
+                                 char mediaType, char movieType,
+                                 const std::string &movieInfo,
+                                 const Customer *customer) {
+  if (!inputErrors.admit(error)) {
+    return;
+  }
+
+  if (error == InputError::InvalidMediaType) {
+    report << "Invalid media type " << mediaType
+           << ", discarding line: " << movieType << " " << movieInfo << '\n';
+  } else if (error == InputError::InvalidCustomer) {
+    report << "Invalid customer ID " << customerId
+           << ", discarding line: " << mediaType << " " << movieType << " "
+           << movieInfo << '\n';
+  } else {
+    report << "Invalid movie for customer ";
+    customer->formatTo(report);
+    report << ", discarding line: " << movieInfo << '\n';
+  }
+  report.flushTo(*out);
+}
+
+// Reports a borrow that failed because every copy in the format is out.
+void Store::reportOutOfStock(const Customer &customer, const Movie &movie,
+                             MediaFormat format) {
+  outOfStock++;
+  report << "==========================\n";
+  customer.formatTo(report);
+  report << " could NOT borrow " << movie.getTitle();
+  appendMediaFormat(report, format);
+  report << ", out of stock: \n";
+  report << "==========================\n";
+  report << "Failed to execute command: Borrow ";
+  customer.formatTo(report);
+  report << " " << movie.getTitle();
+  appendMediaFormat(report, format);
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Hands a copy that was just returned to the first customer waiting for
+// the format, recording the borrow on their behalf.
+void Store::fulfillHold(Movie *movie, MediaFormat format) {
+  Customer *customer = lendToHold(movie, format);
+  if (customer != nullptr) {
+    recordHoldFilled(*customer, movie, format, now);
+  }
+}
+
+// Fills the holds of each format while it has copies on the shelf.
+void Store::fillHolds(Movie *movie) {
+  for (int index = 0; index < MEDIA_FORMATS; index++) {
+    auto format = static_cast<MediaFormat>(index);
+    while (holdCount(movie, format) > 0 &&
+           movie->getStock(format) > movie->getBorrowed(format)) {
+      fulfillHold(movie, format);
+    }
+  }
+}
+
+// Lends a copy of the movie in the format to the first customer waiting
+// for it and returns that customer, or nullptr if nobody could be served.
+Customer *Store::lendToHold(Movie *movie, MediaFormat format) {
+  auto it = holds[format].find(movie);
+  if (it == holds[format].end()) {
+    return nullptr;
+  }
+
+  Customer *served = nullptr;
+  HoldQueue &queue = it->second;
+  while (!queue.empty()) {
+    Customer *customer = findCustomer(queue.pop());
+    if (customer != nullptr && movie->borrowMovie(format)) {
+      served = customer;
+      break;
+    }
+  }
+
+  if (queue.empty()) {
+    holds[format].erase(it);
+  }
+  return served;
+}
+
+// Records the borrow made on behalf of a customer whose hold was filled.
+void Store::recordHoldFilled(Customer &customer, Movie *movie,
+                             MediaFormat format, uint64_t time) {
+  recordBorrow(customer, movie, format, time);
+  report << "Hold filled: ";
+  customer.formatTo(report);
+  report << " borrows " << movie->getTitle();
+  appendMediaFormat(report, format);
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Records a borrow and opens a loan due one loan period later.
+void Store::recordBorrow(Customer &customer, Movie *movie, MediaFormat format,
+                         uint64_t time) {
+  customer.addTransaction(Transaction::BORROW, movie, format, time,
+                          historySpill.get());
+  popularity.record(movie);
+  loans.open(customer.getHandle(), movie, format, time, time + loanPeriod);
+}
+
+// Records a return and closes the customer's oldest loan of the movie in
+// the format, if the copy was borrowed from this store.
+void Store::recordReturn(Customer &customer, Movie *movie, MediaFormat format,
+                         uint64_t time) {
+  customer.addTransaction(Transaction::RETURN, movie, format, time,
+                          historySpill.get());
+  loans.close(customer.getHandle(), movie, format);
+}
+
+// Displays the current inventory of all movies from a snapshot, so the
+// report is consistent even while other threads borrow and return.
 void Store::displayInventory() {
-  std::cout << "INVENTORY:" << std::endl;
+  TraceSpan span("displayInventory");
+  materializeCatalog();
+  std::vector<InventorySnapshot> snapshots;
+  snapshots.push_back(versions.snapshot());
+  displayInventory(snapshots);
+}
+
+// Displays the stock and copies out of each title summed over the
+// snapshots. Their catalogs list the same titles in the same order, so
+// the rows are matched by position.
+void Store::displayInventory(const std::vector<InventorySnapshot> &snapshots) {
+  report << "INVENTORY:\n";
+  size_t rows = snapshots.empty() ? 0 : snapshots[0].size();
+  for (size_t i = 0; i < rows; i++) {
+    InventorySnapshot::Row row = snapshots[0].row(i);
+    for (size_t s = 1; s < snapshots.size(); s++) {
+      if (i < snapshots[s].size()) {
+        InventorySnapshot::Row other = snapshots[s].row(i);
+        for (int format = 0; format < MEDIA_FORMATS; format++) {
+          row.stock[format] += other.stock[format];
+          row.borrowed[format] += other.borrowed[format];
+        }
+      }
+    }
+    row.movie->formatTo(report, row.stock, row.borrowed);
+    report << '\n';
+  }
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Takes a point-in-time snapshot of the inventory.
+InventorySnapshot Store::snapshotInventory() const {
+  return versions.snapshot();
+}
+
+// Publishes the current catalog order for inventory snapshots.
+void Store::publishCatalog() {
+  std::vector<const Movie *> catalog;
+  catalog.reserve(movies.size());
   for (const auto &movie : movies) {
-    std::cout << movie->toString() << std::endl;
+    catalog.push_back(movie.get());
   }
-  std::cout << std::endl;
+  versions.publishCatalog(std::move(catalog));
 }
 
 // Displays the transaction history for a given customer.
 void Store::displayCustomerHistory(int customerId) {
+  displayCustomerHistory(customerId, HistoryQuery());
+}
+
+// Displays the selected page of the transaction history for a customer.
+void Store::displayCustomerHistory(int customerId, const HistoryQuery &query) {
+  TraceSpan span("displayHistory");
   Customer *customer = findCustomer(customerId);
   if (customer == nullptr) {
-    std::cerr << "Error: Customer " << customerId << " not found" << std::endl;
+    if (inputErrors.admit(InputError::InvalidCustomer)) {
+      report << "Error: Customer " << customerId << " not found\n";
+      report.flushTo(*err);
+    }
     return;
   }
-  customer->displayHistory();
+  customer->displayHistory(report, query, historySpill.get());
+  report.flushTo(*out);
+}
+
+// Copies the selected page of a customer's history.
+bool Store::customerHistory(int customerId, const HistoryQuery &query,
+                            std::vector<Transaction> &page, size_t &total) {
+  TraceSpan span("customerHistory");
+  Customer *customer = findCustomer(customerId);
+  if (customer == nullptr) {
+    page.clear();
+    total = 0;
+    return false;
+  }
+  total = customer->historyPage(query, historySpill.get(), page);
+  return true;
+}
+
+// Displays the most borrowed titles overall or within one genre.
+void Store::displayPopularity(size_t n, char genre) {
+  TraceSpan span("displayPopularity");
+  std::vector<TopTitles::Entry> entries =
+      (genre == 0) ? popularity.top(n) : popularity.top(n, genre);
+
+  report << "TOP " << n << " TITLES";
+  if (genre != 0) {
+    report << " IN GENRE " << genre;
+  }
+  report << ":\n";
+
+  if (entries.empty()) {
+    report << "No borrows recorded\n";
+  }
+  for (size_t i = 0; i < entries.size(); i++) {
+    const TopTitles::Entry &entry = entries[i];
+    report << i + 1 << ". " << entry.movie->getTitle() << " ("
+           << (entry.error == 0 ? "" : "~") << entry.count << " borrows)\n";
+  }
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Displays the customers whose last name starts with the prefix. The
+// count comes from the index's bounds, so a short prefix matching most
+// customers costs no more than a long one.
+void Store::displayCustomersNamed(const std::string &prefix, size_t count) {
+  TraceSpan span("displayCustomersNamed");
+  customerNames.sort();
+  report << "CUSTOMERS NAMED " << prefix << "*:\n";
+  size_t matches =
+      customerNames.find(prefix, count, [this](const Customer &customer) {
+        report << customer.getId() << ' ';
+        customer.formatTo(report);
+        report << '\n';
+      });
+  if (matches == 0) {
+    report << "No customers found\n";
+  } else if (matches > count) {
+    report << "... " << matches - count << " more\n";
+  }
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Displays the loans past their due date. Bringing the loans up to the
+// current time only touches those that fell due since the last report.
+void Store::displayOverdue() {
+  TraceSpan span("displayOverdue");
+  loans.advance(now);
+  report << "OVERDUE AT " << now << ":\n";
+  if (loans.overdueCount() == 0) {
+    report << "No overdue loans\n";
+  }
+  loans.forEachOverdue([this](const Loan &loan) {
+    customers[loan.customer].formatTo(report);
+    report << ": " << loan.movie->getTitle();
+    appendMediaFormat(report, loan.format);
+    report << ", borrowed " << loan.borrowedAt << ", due " << loan.due
+           << '\n';
+  });
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Displays the estimated memory of each part of the store. Movies include
+// the catalog's indexes, lazily indexed lines and stock totals; customers
+// include the id table, the pooled names and the name index.
+void Store::displayMemory() {
+  TraceSpan span("displayMemory");
+  const size_t setNodeBytes =
+      4 * sizeof(void *) + sizeof(std::unique_ptr<Movie>);
+  size_t movieCount = movies.size() + unbuiltMovies.size();
+  size_t movieBytes = movies.size() * setNodeBytes +
+                      movieIndex.memoryUsage() + unbuiltMovies.memoryUsage() +
+                      heapBytes(lazyRecords) + hashNodeBytes(retiredMovies) +
+                      totals.memoryUsage();
+  for (const auto &movie : movies) {
+    movieBytes += movie->memoryUsage();
+  }
+  for (const auto &retired : retiredMovies) {
+    movieBytes += heapBytes(retired.first) + retired.second->memoryUsage();
+  }
+
+  size_t transactionCount = 0;
+  size_t transactionBytes = 0;
+  customers.forEach([&](const Customer &customer) {
+    transactionCount +=
+        customer.getHistorySize() - customer.getSpilledCount();
+    transactionBytes += customer.historyMemoryUsage();
+  });
+
+  struct Part {
+    const char *name;
+    const char *item;
+    size_t count;
+    size_t bytes;
+  };
+  const Part parts[] = {
+      {"Movies", "movie", movieCount, movieBytes},
+      {"Customers", "customer", customers.size(),
+       customers.memoryUsage() + customerNames.memoryUsage()},
+      {"Transactions", "transaction", transactionCount, transactionBytes},
+      {"Loans", "loan", loans.openCount(), loans.memoryUsage()},
+  };
+
+  size_t total = 0;
+  report << "MEMORY:\n";
+  for (const Part &part : parts) {
+    report << part.name << ": " << part.count << ", " << part.bytes
+           << " bytes";
+    if (part.count > 0) {
+      report << ", " << part.bytes / part.count << " per " << part.item;
+    }
+    report << '\n';
+    total += part.bytes;
+  }
+  report << "Total: " << total << " bytes\n";
+  if (historySpill) {
+    report << "Spilled to disk: " << historySpill->getEntryCount()
+           << " transactions, " << historySpill->getSize() << " bytes\n";
+  }
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Formats the summary lines from the counters, without visiting a movie.
+void Store::displaySummary(char genre, const std::string &director) {
+  TraceSpan span("displaySummary");
+  auto line = [this](const StockTotals &group) {
+    report << group.titles << " titles, " << group.copies << " copies, "
+           << group.out << " out, ";
+    if (group.copies > 0) {
+      int64_t permille = group.out * 1000 / group.copies;
+      report << permille / 10 << '.' << permille % 10 << "% utilized, ";
+    }
+    report << group.fullyOut << " fully checked out\n";
+  };
+
+  if (!director.empty()) {
+    report << "SUMMARY FOR DIRECTOR " << director << ":\n";
+    line(totals.director(director));
+  } else if (genre != 0) {
+    report << "SUMMARY FOR GENRE " << genre << ":\n";
+    line(totals.genre(genre));
+  } else {
+    report << "SUMMARY:\n";
+    report << "All genres: ";
+    line(totals.genre(0));
+    totals.forEachGenre([&](char each, const StockTotals &group) {
+      report << "Genre " << each << ": ";
+      line(group);
+    });
+  }
+  report << '\n';
+  report.flushTo(*out);
+}
+
+// Streams the catalog in inventory order, then the histories in the
+// order the customers were added, holding one chunk at a time.
+bool Store::exportColumnar(const std::string &filename) {
+  TraceSpan span("exportColumnar");
+  materializeCatalog();
+  ColumnarWriter writer(filename);
+  if (!writer.isOpen()) {
+    *err << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+  for (const auto &movie : movies) {
+    writer.addMovie(*movie);
+  }
+  bool complete = true;
+  customers.forEach([&](const Customer &customer) {
+    complete &= customer.forEachTransaction(
+        historySpill.get(), [&](const Transaction &txn) {
+          writer.addTransaction(customer.getId(), txn);
+        });
+  });
+  if (!writer.finish() || !complete) {
+    *err << "Error: Cannot write " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Parses a movie file line of the form "genre, stock, director, title,
+// extra" into a new movie.
+Movie *Store::parseMovieLine(const std::string &line,
+                             ErrorReporter &reporter, std::ostream &output,
+                             std::ostream &errors) {
+  MovieRecord record;
+  InputError error = InputError::InvalidMovieLine;
+  if (!splitMovieLine(line, record, error)) {
+    if (!reporter.admit(error)) {
+      return nullptr;
+    }
+    if (error == InputError::InvalidMovieLine) {
+      errors << "Error: Invalid movie format: " << line << std::endl;
+    } else {
+      errors << "Error: Invalid stock number in: " << line << std::endl;
+    }
+    return nullptr;
+  }
+
+  Movie *movie = MovieFactory::getInstance().createMovie(
+      record.genre, record.stock[DVD], std::string(record.director),
+      std::string(record.title), std::string(record.extra));
+  if (movie == nullptr) {
+    // A known genre fails only on its last field, such as a bad year.
+    if (MovieFactory::getInstance().hasGenre(record.genre)) {
+      if (reporter.admit(InputError::InvalidMovieLine)) {
+        errors << "Error: Invalid movie format: " << line << std::endl;
+      }
+    } else if (reporter.admit(InputError::UnknownMovieType)) {
+      output << "Unknown movie type: " << record.genre
+             << ", discarding line: " << line << std::endl;
+    }
+    return nullptr;
+  }
+  movie->setStock(record.stock);
+  return movie;
+}
+
+// Splits a line of a movie file into its fields, as split and trimString
+// would. The genre is left for the factory to check.
+bool Store::splitMovieLine(std::string_view line, MovieRecord &record,
+                           InputError &error) {
+  std::string_view text = trimString(line);
+  std::string_view parts[4];
+  size_t count = 0;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = std::min(text.find(',', start), text.size());
+    std::string_view part = trimString(text.substr(start, end - start));
+    start = end + 1;
+    if (count < 4) {
+      parts[count++] = part;
+    } else if (count++ == 4) {
+      record.extra = part;
+    } else {
+      if (count == 6) {
+        record.joinedExtra.assign(record.extra);
+      }
+      record.joinedExtra += ',';
+      record.joinedExtra += part;
+      record.extra = record.joinedExtra;
+    }
+  }
+
+  if (count < 5) {
+    error = InputError::InvalidMovieLine;
+    return false;
+  }
+
+  record.genre = parts[0].empty() ? '\0' : parts[0][0];
+  if (!parseFormatCounts(parts[1], record.stock)) {
+    error = InputError::InvalidStock;
+    return false;
+  }
+  record.director = parts[2];
+  record.title = parts[3];
+  return true;
+}
+
+// Builds the catalog key a command's search criteria refer to:
+// "Title, Year" for comedies, "Director, Title" for dramas and
+// "Month Year First Last" for classics.
+std::string Store::searchKey(char genre, const std::string &info) {
+  std::string criteria = parseMovieSearchCriteria(genre, info);
+
+  if (genre == 'F') {
+    std::vector<std::string> parts = split(criteria, ',');
+    if (parts.size() < 2) {
+      return "";
+    }
+    std::string title = parts[0];
+    trimString(title);
+    int year = 0;
+    try {
+      year = std::stoi(parts[1]);
+    } catch (...) {
+      return "";
+    }
+    return Comedy::makeKey(title, year);
+  }
+
+  if (genre == 'D') {
+    std::vector<std::string> parts = split(criteria, ',');
+    if (parts.size() < 2) {
+      return "";
+    }
+    std::string director = parts[0];
+    std::string title = parts[1];
+    trimString(director);
+    trimString(title);
+    return Drama::makeKey(director, title);
+  }
+
+  if (genre == 'C') {
+    std::istringstream iss(criteria);
+    int month = 0;
+    int year = 0;
+    std::string actorFirstName;
+    std::string actorLastName;
+    iss >> month >> year >> actorFirstName >> actorLastName;
+    std::string actor = actorFirstName + " " + actorLastName;
+    trimString(actor);
+    return Classic::makeKey(month, year, actor);
+  }
+
+  return "";
 }
 
 // Parses movie search criteria from a raw string.
@@ -300,13 +1446,31 @@ void Store::trimString(std::string &str) {
             str.end());
 }
 
+// Returns the part of a string without leading and trailing whitespace.
+std::string_view Store::trimString(std::string_view str) {
+  auto isSpace = [](unsigned char ch) { return std::isspace(ch) != 0; };
+  while (!str.empty() && isSpace(str.front())) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && isSpace(str.back())) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
 // Splits a string by a delimiter into a vector of strings.
+// Like reading tokens with std::getline, a trailing delimiter does not
+// start another, empty token.
 std::vector<std::string> Store::split(const std::string &str, char delimiter) {
   std::vector<std::string> tokens;
-  std::stringstream ss(str);
-  std::string token;
-  while (std::getline(ss, token, delimiter)) {
-    tokens.push_back(token);
+  size_t start = 0;
+  while (start < str.size()) {
+    size_t end = str.find(delimiter, start);
+    if (end == std::string::npos) {
+      end = str.size();
+    }
+    tokens.emplace_back(str, start, end - start);
+    start = end + 1;
   }
   return tokens;
 }
\ No newline at end of file
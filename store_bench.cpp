@@ -0,0 +1,1578 @@
+#include "Store.h"
+#include "async_store.h"
+#include "columnar.h"
+#include "feed_ingester.h"
+#include "loadgen.h"
+#include "loan_tracker.h"
+#include "popularity.h"
+#include "scheduler.h"
+#include "server.h"
+#include "sharded_store.h"
+#include "simulation.h"
+#include "trace.h"
+#include "workload.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef COUNT_ALLOCATIONS
+// Heap allocations made so far, counted by the replacement operator new
+// below so benchmarks can check that a path does not allocate. The
+// replacement would cost every mode of the binary an atomic increment per
+// allocation, so only builds with -DCOUNT_ALLOCATIONS have it. Kept out of
+// line so the compiler does not pair the malloc and free across callers.
+static std::atomic<uint64_t> allocations{0};
+
+__attribute__((noinline)) void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory,
+                                               size_t /*unused*/) noexcept {
+  std::free(memory);
+}
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Returns the nanoseconds elapsed since start.
+double elapsedNs(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+      .count();
+}
+
+// Returns the CPU time the calling thread has used.
+double threadCpuSeconds() {
+  timespec now{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return static_cast<double>(now.tv_sec) + now.tv_nsec / 1e9;
+}
+
+// Describes the heap allocations a benchmark counted per operation, with
+// `unit` naming the operation, or says that the build does not count them.
+std::string allocationsPer(uint64_t count, double operations,
+                           const char *unit) {
+#ifdef COUNT_ALLOCATIONS
+  std::ostringstream text;
+  text << static_cast<double>(count) / operations << " allocations" << unit;
+  return text.str();
+#else
+  (void)count;
+  (void)operations;
+  (void)unit;
+  return "allocations not counted";
+#endif
+}
+
+// Returns the heap allocations made so far, or 0 if the build does not
+// count them.
+uint64_t allocationCount() {
+#ifdef COUNT_ALLOCATIONS
+  return allocations.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif
+}
+
+// Returns the path of a scratch file for generated benchmark data.
+std::string scratchFile(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / ("movie_bench_" + name))
+      .string();
+}
+
+// Measures the cost of recording borrows in the popularity tracker, alone
+// and as a share of the store's borrow path.
+int benchPopularity() {
+  // The sketch alone over a catalog far larger than its capacity.
+  const int distinct = 1000000;
+  const int draws = 10000000;
+  std::vector<char> fakeMovies(distinct);
+  std::vector<int> stream;
+  std::mt19937 rng(7);
+  std::vector<double> weights(distinct);
+  for (int i = 0; i < distinct; i++) {
+    weights[i] = 1.0 / (i + 1);
+  }
+  std::discrete_distribution<int> zipf(weights.begin(), weights.end());
+  stream.reserve(draws);
+  for (int i = 0; i < draws; i++) {
+    stream.push_back(zipf(rng));
+  }
+
+  // Only the addresses are used as keys, so stand-ins work for movies.
+  TopTitles sketch(PopularityTracker::DEFAULT_CAPACITY);
+  auto start = Clock::now();
+  for (int index : stream) {
+    sketch.record(reinterpret_cast<const Movie *>(&fakeMovies[index]));
+  }
+  double sketchNs = elapsedNs(start) / draws;
+  std::cout << "popularity sketch: " << sketchNs << " ns/record over "
+            << distinct << " titles, capacity "
+            << PopularityTracker::DEFAULT_CAPACITY << std::endl;
+
+  // The store's borrow path, which now records every successful borrow.
+  const int titles = 300;
+  const int customers = 1000;
+  const int commands = 50000;
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, commands);
+  generator.writeCustomers(customersFile);
+
+  Store store;
+  store.loadMovies(moviesFile);
+  store.loadCustomers(customersFile);
+
+  WorkloadGenerator::Mix mix;
+  mix.returns = 0.0;
+  mix.histories = 0.0;
+  std::vector<std::string> lines = generator.commands(commands, mix);
+  std::vector<int> ids;
+  std::vector<char> genres;
+  std::vector<std::string> infos;
+  for (const auto &line : lines) {
+    std::istringstream iss(line);
+    char cmd;
+    char media;
+    char genre;
+    int id;
+    iss >> cmd >> id >> media >> genre;
+    std::string info;
+    std::getline(iss, info);
+    ids.push_back(id);
+    genres.push_back(genre);
+    infos.push_back(info.substr(1));
+  }
+
+  start = Clock::now();
+  for (size_t i = 0; i < lines.size(); i++) {
+    store.borrowMovie(ids[i], 'D', genres[i], infos[i]);
+  }
+  double borrowNs = elapsedNs(start) / commands;
+
+  // Replay the same borrows into a separate tracker to isolate its cost.
+  PopularityTracker shadow;
+  std::vector<const Movie *> borrowed;
+  for (size_t i = 0; i < lines.size(); i++) {
+    borrowed.push_back(store.findMovie(genres[i], infos[i]));
+  }
+  start = Clock::now();
+  for (const Movie *movie : borrowed) {
+    shadow.record(movie);
+  }
+  double recordNs = elapsedNs(start) / commands;
+
+  std::cout << "store borrow: " << borrowNs << " ns/borrow, of which "
+            << recordNs << " ns (" << 100.0 * recordNs / borrowNs
+            << "%) is popularity tracking" << std::endl;
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Serves a generated store over loopback and drives it with a thousand
+// concurrent connections.
+int benchServer() {
+  const int titles = 300;
+  const int customers = 20000;
+  const int connections = 1000;
+
+  // Both ends of every connection live in this process.
+  rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < 2 * connections + 64) {
+    std::cerr << "server: needs " << 2 * connections + 64
+              << " file descriptors, have " << limit.rlim_cur << std::endl;
+    return 1;
+  }
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  Store store;
+  store.loadMovies(moviesFile);
+  store.loadCustomers(customersFile);
+
+  CommandServer::Options serverOptions;
+  serverOptions.port = 0;
+  CommandServer server(store, serverOptions);
+  if (!server.start()) {
+    return 1;
+  }
+  std::thread serverThread([&server] { server.run(); });
+
+  LoadGenerator::Options loadOptions;
+  loadOptions.port = server.getPort();
+  loadOptions.connections = connections;
+  loadOptions.seconds = 5.0;
+  LoadGenerator load(loadOptions,
+                     generator.commands(200000, WorkloadGenerator::Mix()));
+  LoadGenerator::Report report = load.run();
+
+  server.stop();
+  serverThread.join();
+  std::cout << "server: ";
+  LoadGenerator::print(report);
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Measures command throughput of the sharded store as shards are added.
+// With fewer cores than shards the workers take turns, so the measured
+// speedup stays near 1; the CPU time of the routing thread and of the
+// busiest shard bound the wall time with a core each, which gives the
+// speedup the partitioning allows.
+int benchSharded() {
+  const int titles = 300;
+  const int customers = 20000;
+  const int commands = 100000;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  std::vector<std::string> lines =
+      generator.commands(commands, WorkloadGenerator::Mix());
+
+  double baseline = 0.0;
+  double baselineCpu = 0.0;
+  for (size_t shards : {1, 2, 4, 8}) {
+    ShardedStore store(shards);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+
+    auto start = Clock::now();
+    double routerStart = threadCpuSeconds();
+    for (const auto &line : lines) {
+      store.submit(line);
+    }
+    store.drain();
+    double routerCpu = threadCpuSeconds() - routerStart;
+    double seconds = elapsedNs(start) / 1e9;
+    double throughput = commands / seconds;
+
+    double totalCpu = routerCpu;
+    double busiest = 0.0;
+    for (size_t i = 0; i < shards; i++) {
+      double busy = store.busySeconds(i);
+      totalCpu += busy;
+      busiest = std::max(busiest, busy);
+    }
+    if (baseline == 0.0) {
+      baseline = throughput;
+      baselineCpu = totalCpu;
+    }
+    std::cout << "sharded: " << shards << " shards, " << throughput
+              << " commands/s, speedup " << throughput / baseline
+              << "x; CPU router " << routerCpu * 1000 << " ms, busiest shard "
+              << busiest * 1000 << " ms of " << (totalCpu - routerCpu) * 1000
+              << " ms, speedup with a core each "
+              << baselineCpu / std::max(routerCpu, busiest) << "x"
+              << std::endl;
+  }
+  std::cout << "sharded: " << std::thread::hardware_concurrency()
+            << " hardware threads available" << std::endl;
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Runs borrows on one thread while another takes inventory snapshots,
+// checking that every snapshot is a consistent point-in-time view.
+int benchSnapshot() {
+  const int titles = 300;
+  const int customers = 1000;
+  const int borrows = 50000;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.returns = 0.0;
+  mix.histories = 0.0;
+  std::vector<std::string> lines = generator.commands(borrows, mix);
+  std::vector<std::unique_ptr<Command>> commands;
+  for (const auto &line : lines) {
+    commands.emplace_back(CommandFactory::getInstance().createCommand(line));
+  }
+
+  for (bool withReader : {false, true}) {
+    Store store;
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    uint64_t baseVersion = store.snapshotInventory().getVersion();
+
+    std::atomic<bool> done{false};
+    uint64_t snapshots = 0;
+    uint64_t inconsistent = 0;
+    std::thread reader([&] {
+      while (withReader && !done) {
+        // Every borrow publishes exactly one version, so a consistent
+        // view has as many copies out as versions since the start.
+        InventorySnapshot snapshot = store.snapshotInventory();
+        uint64_t out = 0;
+        for (size_t i = 0; i < snapshot.size(); i++) {
+          out += static_cast<uint64_t>(totalCount(snapshot.row(i).borrowed));
+        }
+        if (out != snapshot.getVersion() - baseVersion) {
+          inconsistent++;
+        }
+        snapshots++;
+      }
+    });
+
+    auto start = Clock::now();
+    for (auto &cmd : commands) {
+      cmd->execute(store);
+    }
+    double borrowNs = elapsedNs(start) / borrows;
+    done = true;
+    reader.join();
+
+    std::cout << "snapshot: " << borrowNs << " ns/borrow";
+    if (withReader) {
+      std::cout << " with a concurrent reader, " << snapshots
+                << " snapshots, " << inconsistent << " inconsistent";
+    }
+    std::cout << std::endl;
+  }
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Measures how cheaply the admission filter turns away requests for titles
+// the catalog does not have, compared with a full lookup, and how often it
+// lets one through by mistake.
+int benchAdmission() {
+  const int titles = 100000;
+  const int probes = 300000;
+
+  WorkloadGenerator generator(titles, 1000);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  std::string garbageFile = scratchFile("garbage.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+
+  Store store;
+  store.loadMovies(moviesFile);
+  store.loadCustomers(customersFile);
+
+  // A filter holding the same catalog, and the search text of titles
+  // that are not in it.
+  AdmissionFilter filter;
+  for (int i = 0; i < titles; i++) {
+    std::string criteria = WorkloadGenerator::movieCriteria(i);
+    filter.addMovie(store.findMovie(criteria[0], criteria.substr(2))->getKey());
+  }
+  std::vector<std::string> unknown;
+  for (int i = 0; i < probes; i++) {
+    unknown.push_back(WorkloadGenerator::movieCriteria(titles + i));
+  }
+
+  uint64_t allocationsBefore = allocationCount();
+  int passed = 0;
+  auto start = Clock::now();
+  for (const auto &criteria : unknown) {
+    std::string_view info(criteria);
+    passed += filter.mayHaveMovie(criteria[0], info.substr(2));
+  }
+  double filterNs = elapsedNs(start) / probes;
+  uint64_t filterAllocations = allocationCount() - allocationsBefore;
+
+  int found = 0;
+  start = Clock::now();
+  for (const auto &criteria : unknown) {
+    found += store.findMovie(criteria[0], criteria.substr(2)) != nullptr;
+  }
+  double lookupNs = elapsedNs(start) / probes;
+
+  std::cout << "admission filter: " << filterNs << " ns/reject, "
+            << allocationsPer(filterAllocations, 1, "") << ", "
+            << 100.0 * passed / probes
+            << "% false positives" << std::endl;
+  std::cout << "admission lookup: " << lookupNs << " ns/reject (" << found
+            << " found)" << std::endl;
+
+  // End to end, with most lines naming unknown customers or titles.
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  mix.garbage = 0.9;
+  generator.writeCommands(garbageFile, probes, mix);
+  std::ofstream sink("/dev/null");
+  store.setOutput(sink, sink);
+  start = Clock::now();
+  store.processCommands(garbageFile);
+  std::cout << "admission garbage: " << elapsedNs(start) / probes
+            << " ns/line" << std::endl;
+
+  for (const auto &file : {moviesFile, customersFile, garbageFile}) {
+    std::filesystem::remove(file);
+  }
+  return 0;
+}
+
+// Returns the resident set size of the process.
+size_t residentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  statm >> pages >> resident;
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Loads millions of customers and reports their memory, as the store
+// accounts it and as resident memory, and the cost of looking them up.
+int benchCustomers() {
+  const int customers = 5000000;
+  const int lookups = 5000000;
+
+  WorkloadGenerator generator(1, customers);
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeCustomers(customersFile);
+
+  size_t before = residentBytes();
+  Store store;
+  auto start = Clock::now();
+  store.loadCustomers(customersFile);
+  std::cout << "customers: " << elapsedNs(start) / customers
+            << " ns/customer loaded, "
+            << static_cast<double>(residentBytes() - before) / customers
+            << " resident bytes/customer" << std::endl;
+
+  std::stringstream report;
+  store.setOutput(report, report);
+  store.displayMemory();
+  std::string line;
+  while (std::getline(report, line)) {
+    if (line.rfind("Customers:", 0) == 0) {
+      std::cout << "customers accounted: " << line.substr(11) << std::endl;
+    }
+  }
+
+  std::mt19937 rng(39);
+  std::uniform_int_distribution<int> anyCustomer(0, customers - 1);
+  size_t found = 0;
+  start = Clock::now();
+  for (int i = 0; i < lookups; i++) {
+    int id = WorkloadGenerator::customerId(anyCustomer(rng));
+    found += store.findCustomer(id) != nullptr;
+  }
+  std::cout << "customers: " << elapsedNs(start) / lookups
+            << " ns/lookup (" << found << " found)" << std::endl;
+
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Replays millions of borrows and returns with histories kept in memory
+// and with only a budget of recent entries kept there, sampling resident
+// memory as the histories grow, then times full history reports.
+int benchHistory() {
+  const int titles = 1000;
+  const int customers = 20000;
+  const int pairs = 1500000;
+  const int samples = 3;
+  const size_t budget = 64;
+  const int reports = 2000;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  std::vector<std::pair<char, std::string>> criteria;
+  for (int i = 0; i < titles; i++) {
+    std::string text = WorkloadGenerator::movieCriteria(i);
+    criteria.emplace_back(text[0], text.substr(2));
+  }
+
+  std::ofstream sink("/dev/null");
+  for (bool tiered : {true, false}) {
+    const char *mode = tiered ? "tiered" : "in memory";
+    // Hand memory freed by the previous mode back, so each mode's growth
+    // is measured from the same start.
+    malloc_trim(0);
+    Store store;
+    store.setOutput(sink, sink);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    if (tiered && !store.setHistoryBudget(budget)) {
+      return 1;
+    }
+
+    std::mt19937 rng(40);
+    std::uniform_int_distribution<int> anyCustomer(0, customers - 1);
+    std::uniform_int_distribution<int> anyTitle(0, titles - 1);
+    size_t base = residentBytes();
+    std::cout << "history " << mode << ": resident MB after";
+    auto start = Clock::now();
+    for (int i = 1; i <= pairs; i++) {
+      int id = WorkloadGenerator::customerId(anyCustomer(rng));
+      const auto &title = criteria[anyTitle(rng)];
+      store.borrowMovie(id, 'D', title.first, title.second);
+      store.returnMovie(id, 'D', title.first, title.second);
+      if (i % (pairs / samples) == 0) {
+        std::cout << " " << 2 * i / 1000000.0 << "M: "
+                  << (static_cast<double>(residentBytes()) - base) / 1e6;
+      }
+    }
+    std::cout << " (" << elapsedNs(start) / (2 * pairs) << " ns/transaction)"
+              << std::endl;
+
+    start = Clock::now();
+    for (int i = 0; i < reports; i++) {
+      store.displayCustomerHistory(
+          WorkloadGenerator::customerId(anyCustomer(rng)));
+    }
+    std::cout << "history " << mode << ": "
+              << elapsedNs(start) / reports / 1000
+              << " us per full history report" << std::endl;
+  }
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Compares loading a large catalog in full with indexing it and building
+// movies as commands look them up.
+int benchLazy() {
+  const int titles = 1000000;
+  const int commands = 20000;
+
+  WorkloadGenerator generator(titles, 1000);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  std::string commandsFile = scratchFile("commands.txt");
+  std::string firstFile = scratchFile("first.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  generator.writeCommands(commandsFile, commands, mix);
+  std::ofstream(firstFile) << "B " << WorkloadGenerator::customerId(0)
+                           << " D " << WorkloadGenerator::movieCriteria(7)
+                           << '\n';
+
+  std::ofstream sink("/dev/null");
+  for (bool lazy : {false, true}) {
+    const char *mode = lazy ? "lazy" : "eager";
+    Store store;
+    store.setOutput(sink, sink);
+    store.setLazyCatalog(lazy);
+    store.loadCustomers(customersFile);
+    auto start = Clock::now();
+    store.loadMovies(moviesFile);
+    store.processCommands(firstFile);
+    std::cout << "catalog " << mode << ": first command after "
+              << elapsedNs(start) / 1e6 << " ms" << std::endl;
+
+    start = Clock::now();
+    store.processCommands(commandsFile);
+    std::cout << "catalog " << mode << ": " << elapsedNs(start) / commands
+              << " ns/command" << std::endl;
+
+    start = Clock::now();
+    store.displayInventory();
+    std::cout << "catalog " << mode << ": inventory report "
+              << elapsedNs(start) / 1e6 << " ms" << std::endl;
+  }
+
+  for (const auto &file :
+       {moviesFile, customersFile, commandsFile, firstFile}) {
+    std::filesystem::remove(file);
+  }
+  return 0;
+}
+
+// Opens millions of loans with spread due dates, then sweeps the clock
+// across them, comparing the timer wheel with scanning every open loan.
+int benchLoans() {
+  const int loanCount = 4000000;
+  const int customerCount = 100000;
+  const int movieCount = 1000;
+  const uint64_t horizon = 1000000;
+  const uint64_t step = 100;
+  const int scans = 20;
+
+  std::vector<std::unique_ptr<Movie>> movies;
+  for (int i = 0; i < movieCount; i++) {
+    movies.push_back(std::make_unique<Comedy>(1, "Director",
+                                              "Title" + std::to_string(i),
+                                              2000));
+  }
+
+  std::mt19937_64 rng(38);
+  std::vector<uint64_t> dues(loanCount);
+  for (auto &due : dues) {
+    due = 1 + rng() % horizon;
+  }
+
+  LoanTracker tracker;
+  auto start = Clock::now();
+  for (int i = 0; i < loanCount; i++) {
+    tracker.open(i % customerCount, movies[i % movieCount].get(), DVD, 0,
+                 dues[i]);
+  }
+  std::cout << "loans: " << loanCount << " open, "
+            << elapsedNs(start) / loanCount << " ns/open" << std::endl;
+
+  start = Clock::now();
+  for (uint64_t now = step; now <= horizon; now += step) {
+    tracker.advance(now);
+  }
+  double sweepNs = elapsedNs(start);
+  std::cout << "loans wheel: " << sweepNs / (horizon / step) / 1000
+            << " us/sweep, " << sweepNs / tracker.overdueCount()
+            << " ns/loan fallen due" << std::endl;
+
+  size_t overdue = 0;
+  start = Clock::now();
+  for (int i = 1; i <= scans; i++) {
+    uint64_t now = horizon * i / scans;
+    for (uint64_t due : dues) {
+      overdue += due <= now;
+    }
+  }
+  std::cout << "loans scan: " << elapsedNs(start) / scans / 1e6
+            << " ms/sweep (" << overdue << " overdue seen)" << std::endl;
+
+  start = Clock::now();
+  for (int i = 0; i < loanCount; i++) {
+    tracker.close(i % customerCount, movies[i % movieCount].get(), DVD);
+  }
+  std::cout << "loans: " << elapsedNs(start) / loanCount << " ns/close, "
+            << tracker.openCount() << " left open" << std::endl;
+  return 0;
+}
+
+// Compares running a command file one command at a time with running its
+// borrows and returns in batches, on a workload concentrated on a few hot
+// titles.
+int benchBatch() {
+  const int titles = 2000;
+  const int customers = 10000;
+  const int commands = 300000;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  std::string commandsFile = scratchFile("commands.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  mix.skew = 1.5;
+  generator.writeCommands(commandsFile, commands, mix);
+
+  std::ofstream sink("/dev/null");
+  for (size_t batchSize : {1, 16, 256, 4096}) {
+    Store store;
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    store.setOutput(sink, sink);
+    store.setBatchSize(batchSize);
+    auto start = Clock::now();
+    store.processCommands(commandsFile);
+    std::cout << "batch size " << batchSize << ": "
+              << elapsedNs(start) / commands << " ns/command" << std::endl;
+  }
+
+  for (const auto &file : {moviesFile, customersFile, commandsFile}) {
+    std::filesystem::remove(file);
+  }
+  return 0;
+}
+
+// Measures the cost of a trace span with tracing off and on, alone and
+// across a command file.
+int benchTrace() {
+  const int spans = 20000000;
+  const int tracedSpans = 1000000;
+  const int titles = 1000;
+  const int customers = 1000;
+  const int commands = 200000;
+
+  auto start = Clock::now();
+  for (int i = 0; i < spans; i++) {
+    TraceSpan span("bench");
+  }
+  std::cout << "trace off: " << elapsedNs(start) / spans << " ns/span"
+            << std::endl;
+
+  Tracer::start();
+  start = Clock::now();
+  for (int i = 0; i < tracedSpans; i++) {
+    TraceSpan span("bench");
+  }
+  std::cout << "trace on: " << elapsedNs(start) / tracedSpans << " ns/span"
+            << std::endl;
+  Tracer::stop("/dev/null");
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  std::string commandsFile = scratchFile("commands.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  generator.writeCommands(commandsFile, commands, WorkloadGenerator::Mix());
+
+  std::ofstream sink("/dev/null");
+  for (bool traced : {false, true}) {
+    Store store;
+    store.setOutput(sink, sink);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    if (traced) {
+      Tracer::start();
+    }
+    start = Clock::now();
+    store.processCommands(commandsFile);
+    std::cout << "trace " << (traced ? "on" : "off") << ": "
+              << elapsedNs(start) / commands << " ns/command" << std::endl;
+    if (traced) {
+      Tracer::stop("/dev/null");
+    }
+  }
+
+  for (const auto &file : {moviesFile, customersFile, commandsFile}) {
+    std::filesystem::remove(file);
+  }
+  return 0;
+}
+
+// Stream buffer that discards everything written to it.
+class NullBuffer : public std::streambuf {
+protected:
+  int_type overflow(int_type ch) override { return ch; }
+  std::streamsize xsputn(const char * /*unused*/,
+                         std::streamsize count) override {
+    return count;
+  }
+};
+
+// Counts the heap allocations made by the report paths once their
+// buffers have grown, per line of output.
+int benchFormat() {
+  const int titles = 300;
+  const int customers = 1000;
+  const int borrows = 20000;
+  const int rounds = 100;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+
+  NullBuffer discard;
+  std::ostream null(&discard);
+  Store store;
+  store.loadMovies(moviesFile);
+  store.loadCustomers(customersFile);
+  store.setOutput(null, null);
+  for (const auto &line : generator.commands(borrows, mix)) {
+    std::unique_ptr<Command> cmd(
+        CommandFactory::getInstance().createCommand(line));
+    if (cmd != nullptr) {
+      cmd->execute(store);
+    }
+  }
+
+  // Runs a report until its buffers have grown, then measures it.
+  auto measure = [&](const char *name, size_t lines, auto report) {
+    report();
+    uint64_t before = allocationCount();
+    auto start = Clock::now();
+    for (int i = 0; i < rounds; i++) {
+      report();
+    }
+    double ns = elapsedNs(start) / (static_cast<double>(lines) * rounds);
+    uint64_t count = allocationCount() - before;
+    std::cout << "format " << name << ": " << ns << " ns/line, "
+              << allocationsPer(count, static_cast<double>(lines) * rounds,
+                                "/line")
+              << std::endl;
+  };
+
+  measure("inventory", titles + 2, [&] { store.displayInventory(); });
+
+  size_t historyLines = 0;
+  for (int i = 0; i < customers; i++) {
+    Customer *customer =
+        store.findCustomer(WorkloadGenerator::customerId(i));
+    historyLines += customer->getHistorySize() + 2;
+  }
+  measure("history", historyLines, [&] {
+    for (int i = 0; i < customers; i++) {
+      store.displayCustomerHistory(WorkloadGenerator::customerId(i));
+    }
+  });
+
+  const std::string criteria = WorkloadGenerator::movieCriteria(0);
+  measure("errors", 2 * customers, [&] {
+    for (int i = 0; i < customers; i++) {
+      store.borrowMovie(-1 - i, 'D', 'F', criteria);
+      store.returnMovie(WorkloadGenerator::customerId(i), 'X', 'F', criteria);
+    }
+  });
+
+  // The string API, which builds a temporary for every line.
+  InventorySnapshot snapshot = store.snapshotInventory();
+  measure("toString", snapshot.size(), [&] {
+    for (size_t i = 0; i < snapshot.size(); i++) {
+      InventorySnapshot::Row row = snapshot.row(i);
+      null << row.movie->toString(row.stock, row.borrowed) << std::endl;
+    }
+  });
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Compares processing a clean command file with one that is mostly
+// rejected lines, with every error detailed and with the default sampling.
+int benchErrors() {
+  const int titles = 300;
+  const int customers = 1000;
+  const int commands = 200000;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  std::string cleanFile = scratchFile("clean.txt");
+  std::string garbageFile = scratchFile("garbage.txt");
+  std::string sidecarFile = scratchFile("errors.jsonl");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  generator.writeCommands(cleanFile, commands, mix);
+  mix.garbage = 0.9;
+  generator.writeCommands(garbageFile, commands, mix);
+
+  // Output goes to a file stream flushed after every report, as it would
+  // to a log pipe.
+  std::ofstream sink("/dev/null");
+  auto run = [&](const char *name, const std::string &file,
+                 size_t detailLimit, bool sidecar) {
+    Store store;
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    store.setOutput(sink, sink);
+    store.setErrorDetailLimit(detailLimit);
+    if (sidecar) {
+      store.openErrorSidecar(sidecarFile);
+    }
+    auto start = Clock::now();
+    store.processCommands(file);
+    std::cout << "errors " << name << ": " << elapsedNs(start) / commands
+              << " ns/line" << std::endl;
+  };
+
+  run("clean", cleanFile, ErrorReporter::DEFAULT_DETAIL_LIMIT, false);
+  run("garbage, all detailed", garbageFile, ErrorReporter::UNLIMITED, false);
+  run("garbage, sampled", garbageFile, ErrorReporter::DEFAULT_DETAIL_LIMIT,
+      false);
+  run("garbage, sampled with sidecar", garbageFile,
+      ErrorReporter::DEFAULT_DETAIL_LIMIT, true);
+
+  for (const auto &file :
+       {moviesFile, customersFile, cleanFile, garbageFile, sidecarFile}) {
+    std::filesystem::remove(file);
+  }
+  return 0;
+}
+
+// Replays a command log under several stock scenarios, loading a fresh
+// store for each one, then forking the loaded store for each one, one
+// scenario at a time and then one per core.
+int benchSimulate() {
+  const int titles = 200000;
+  const int customers = 200000;
+  const int commands = 50000;
+  const int scenarioCount = 8;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 2);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  mix.skew = 1.2;
+  std::vector<std::string> lines = generator.commands(commands, mix);
+
+  std::vector<Scenario> scenarios;
+  for (int i = 0; i < scenarioCount; i++) {
+    scenarios.push_back(
+        Scenario{"stock" + std::to_string(i + 1), {{0, 0, i + 1}}});
+  }
+
+  std::ofstream sink("/dev/null");
+  auto start = Clock::now();
+  std::vector<uint64_t> reloaded;
+  for (const Scenario &scenario : scenarios) {
+    Store store;
+    store.setOutput(sink, sink);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    for (const StockOverride &change : scenario.overrides) {
+      store.overrideStock(change.genre, change.minYear, change.stock);
+    }
+    for (const std::string &line : lines) {
+      std::unique_ptr<Command> cmd(
+          CommandFactory::getInstance().createCommand(line, sink));
+      if (cmd != nullptr) {
+        store.runCommand(*cmd);
+      }
+    }
+    reloaded.push_back(store.getOutOfStockCount());
+  }
+  std::cout << "simulate reload: " << elapsedNs(start) / 1e6 / scenarioCount
+            << " ms/scenario" << std::endl;
+
+  Store store;
+  store.setOutput(sink, sink);
+  store.loadMovies(moviesFile);
+  store.loadCustomers(customersFile);
+  WhatIfSimulator simulator(store, lines);
+  std::vector<int> jobCounts{1};
+  int cores = static_cast<int>(std::thread::hardware_concurrency());
+  if (cores > 1) {
+    jobCounts.push_back(cores);
+  }
+  for (int jobs : jobCounts) {
+    start = Clock::now();
+    std::vector<ScenarioResult> results = simulator.run(scenarios, jobs);
+    double ms = elapsedNs(start) / 1e6;
+    bool same = true;
+    for (size_t i = 0; i < results.size(); i++) {
+      same = same && results[i].completed &&
+             results[i].outOfStock == reloaded[i];
+    }
+    std::cout << "simulate fork, " << jobs << " jobs: " << ms / scenarioCount
+              << " ms/scenario, " << ms << " ms total"
+              << (same ? "" : ", RESULTS DIFFER") << std::endl;
+  }
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Submits a burst of bulk borrows and returns, then history lookups for
+// other customers at a steady rate while the burst runs, in arrival order
+// and through the priority scheduler.
+int benchSchedule() {
+  const int titles = 2000;
+  const int bulkCustomers = 50000;
+  const int customers = 100000;
+  const int commands = 300000;
+  const auto lookupInterval = std::chrono::microseconds(500);
+
+  WorkloadGenerator everyone(titles, customers);
+  WorkloadGenerator generator(titles, bulkCustomers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  everyone.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  std::vector<std::string> burst = generator.commands(commands, mix);
+
+  std::ofstream sink("/dev/null");
+  for (bool prioritized : {false, true}) {
+    Store store;
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    store.setOutput(sink, sink);
+    CommandScheduler::Options options;
+    if (!prioritized) {
+      options.interactiveTypes = "";
+    }
+    CommandScheduler scheduler(store, options);
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> lookedUp(bulkCustomers, customers - 1);
+    auto queued = Clock::now();
+    for (const std::string &line : burst) {
+      scheduler.submit(line, queued);
+    }
+    auto start = Clock::now();
+    auto nextLookup = start;
+    int lookups = 0;
+    while (scheduler.pending() > 0) {
+      for (auto now = Clock::now(); nextLookup <= now;
+           nextLookup += lookupInterval) {
+        scheduler.submit(
+            "H " + std::to_string(WorkloadGenerator::customerId(lookedUp(rng))),
+            nextLookup);
+        lookups++;
+      }
+      scheduler.step();
+    }
+    double seconds = elapsedNs(start) / 1e9;
+
+    // In arrival order every line is bulk; the lookups wait about as long
+    // as the bulk lines around them.
+    CommandScheduler::ClassReport lookup = scheduler.report(
+        prioritized ? CommandScheduler::INTERACTIVE : CommandScheduler::BULK);
+    std::cout << "schedule " << (prioritized ? "priority" : "arrival order")
+              << ": " << commands / seconds << " bulk commands/s, " << lookups
+              << " lookups, p50 " << lookup.p50Micros << " us";
+    if (prioritized) {
+      std::cout << ", p99 " << lookup.p99Micros << " us, max "
+                << lookup.maxMicros << " us, " << lookup.late << " late";
+    }
+    std::cout << std::endl;
+  }
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Reads the stock totals of a large catalog through the summary command
+// and compares it with an inventory report, which has to visit every
+// title.
+int benchSummary() {
+  const int titles = 1000000;
+  const int commands = 200000;
+  const int summaries = 10000;
+
+  WorkloadGenerator generator(titles, 1000);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 3);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  std::vector<std::string> lines = generator.commands(commands, mix);
+
+  std::ofstream sink("/dev/null");
+  Store store;
+  store.setOutput(sink, sink);
+  store.loadMovies(moviesFile);
+  store.loadCustomers(customersFile);
+  auto start = Clock::now();
+  store.processLines(lines, "bench");
+  std::cout << "summary: borrows and returns keeping totals "
+            << elapsedNs(start) / commands << " ns/command" << std::endl;
+
+  std::vector<std::string> summary(summaries, "S");
+  start = Clock::now();
+  store.processLines(summary, "bench");
+  std::cout << "summary: " << elapsedNs(start) / summaries / 1000
+            << " us per catalog summary" << std::endl;
+
+  start = Clock::now();
+  store.displayInventory();
+  std::cout << "summary: " << elapsedNs(start) / 1e6
+            << " ms per inventory report" << std::endl;
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Builds 3 million transactions, most of them spilled, then compares
+// writing the inventory and every history as `I` and `H` reports with
+// exporting them to a columnar file, and times reading the file back.
+int benchExport() {
+  const int titles = 1000;
+  const int customers = 20000;
+  const int pairs = 1500000;
+  const size_t budget = 64;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  std::string textFile = scratchFile("reports.txt");
+  std::string exportFile = scratchFile("export.col");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+
+  Store store;
+  store.loadMovies(moviesFile);
+  store.loadCustomers(customersFile);
+  if (!store.setHistoryBudget(budget)) {
+    return 1;
+  }
+  std::mt19937 rng(46);
+  std::uniform_int_distribution<int> anyCustomer(0, customers - 1);
+  std::uniform_int_distribution<int> anyTitle(0, titles - 1);
+  for (int i = 0; i < pairs; i++) {
+    int id = WorkloadGenerator::customerId(anyCustomer(rng));
+    std::string text = WorkloadGenerator::movieCriteria(anyTitle(rng));
+    store.borrowMovie(id, 'D', text[0], text.substr(2));
+    store.returnMovie(id, 'D', text[0], text.substr(2));
+  }
+
+  {
+    std::ofstream text(textFile);
+    store.setOutput(text, text);
+    auto start = Clock::now();
+    store.displayInventory();
+    for (int i = 0; i < customers; i++) {
+      store.displayCustomerHistory(WorkloadGenerator::customerId(i));
+    }
+    text.flush();
+    std::cout << "export: text reports " << elapsedNs(start) / 1e9 << " s, "
+              << std::filesystem::file_size(textFile) / 1000000 << " MB"
+              << std::endl;
+    store.setOutput(std::cout, std::cerr);
+  }
+
+  auto start = Clock::now();
+  if (!store.exportColumnar(exportFile)) {
+    return 1;
+  }
+  std::cout << "export: columnar " << elapsedNs(start) / 1e9 << " s, "
+            << std::filesystem::file_size(exportFile) / 1000000 << " MB"
+            << std::endl;
+
+  start = Clock::now();
+  ColumnarReader reader(exportFile);
+  ColumnarReader::Chunk chunk;
+  uint64_t borrows = 0;
+  while (reader.next(chunk)) {
+    for (char type : chunk.transactions.types) {
+      borrows += type == 'B' ? 1 : 0;
+    }
+  }
+  std::cout << "export: read back " << reader.getTransactionRows()
+            << " transactions (" << borrows << " borrows) in "
+            << elapsedNs(start) / 1e9 << " s"
+            << (reader.failed() ? ", FAILED" : "") << std::endl;
+
+  for (const auto &file :
+       {moviesFile, customersFile, textFile, exportFile}) {
+    std::filesystem::remove(file);
+  }
+  return reader.failed() ? 1 : 0;
+}
+
+// Times borrow and return pairs taking only DVDs against pairs spread over
+// every format, on titles stocked in all three, and counts the heap
+// allocations each makes.
+int benchMedia() {
+  const int titles = 2000;
+  const int customers = 10000;
+  const int pairs = 500000;
+  const std::string stock = "1000000";
+
+  WorkloadGenerator generator(titles, customers);
+  std::string generatedFile = scratchFile("generated.txt");
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(generatedFile, std::stoi(stock));
+  generator.writeCustomers(customersFile);
+  {
+    std::ifstream in(generatedFile);
+    std::ofstream out(moviesFile);
+    std::string line;
+    while (std::getline(in, line)) {
+      size_t field = line.find(", " + stock + ",");
+      if (field != std::string::npos) {
+        line.insert(field + 2 + stock.size(), "/" + stock + "/" + stock);
+      }
+      out << line << '\n';
+    }
+  }
+
+  struct Request {
+    int customerId;
+    char genre;
+    std::string criteria;
+  };
+  std::vector<Request> requests;
+  std::mt19937 rng(47);
+  std::uniform_int_distribution<int> anyCustomer(0, customers - 1);
+  std::uniform_int_distribution<int> anyTitle(0, titles - 1);
+  for (int i = 0; i < pairs; i++) {
+    std::string text = WorkloadGenerator::movieCriteria(anyTitle(rng));
+    requests.push_back({WorkloadGenerator::customerId(anyCustomer(rng)),
+                        text[0], text.substr(2)});
+  }
+
+  std::ofstream sink("/dev/null");
+  int status = 0;
+  for (const char *media : {"D", "DBL"}) {
+    Store store;
+    store.setOutput(sink, sink);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    size_t kinds = std::char_traits<char>::length(media);
+    int failed = 0;
+    uint64_t allocated = allocationCount();
+    auto start = Clock::now();
+    for (int i = 0; i < pairs; i++) {
+      const Request &request = requests[i];
+      char code = media[i % kinds];
+      if (!store.borrowMovie(request.customerId, code, request.genre,
+                             request.criteria)) {
+        failed++;
+      }
+      store.returnMovie(request.customerId, code, request.genre,
+                        request.criteria);
+    }
+    double ns = elapsedNs(start);
+    std::cout << "media " << media << ": " << ns / (2 * pairs)
+              << " ns/command, "
+              << allocationsPer(allocationCount() - allocated, 2.0 * pairs,
+                                "/command")
+              << std::endl;
+    status = failed > 0 ? 1 : status;
+  }
+
+  for (const auto &file : {generatedFile, moviesFile, customersFile}) {
+    std::filesystem::remove(file);
+  }
+  return status;
+}
+
+// Loads 5 million customers, then times name searches by prefixes from a
+// whole surname down to one letter, against counting the matches of one
+// prefix by scanning every customer.
+int benchNames() {
+  const int customers = 5000000;
+  const int searches = 100000;
+
+  WorkloadGenerator generator(1, customers);
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeCustomers(customersFile);
+
+  std::ofstream sink("/dev/null");
+  Store store;
+  store.setOutput(sink, sink);
+  auto start = Clock::now();
+  store.loadCustomers(customersFile);
+  std::cout << "names: " << elapsedNs(start) / 1e9
+            << " s to load and index " << customers << " customers"
+            << std::endl;
+
+  std::mt19937 rng(48);
+  std::uniform_int_distribution<int> anyCustomer(0, customers - 1);
+  for (size_t digits : {7, 4, 1, 0}) {
+    std::vector<std::string> lines;
+    for (int i = 0; i < searches; i++) {
+      std::string number = std::to_string(anyCustomer(rng));
+      lines.push_back("N Last" + number.substr(0, digits));
+    }
+    start = Clock::now();
+    store.processLines(lines, "bench");
+    std::cout << "names: prefix of " << 4 + digits << " characters "
+              << elapsedNs(start) / searches / 1000 << " us/search"
+              << std::endl;
+  }
+
+  // What a search would cost without the index.
+  start = Clock::now();
+  size_t matches = 0;
+  for (int id = 0; id < customers; id++) {
+    const Customer *customer =
+        store.findCustomer(WorkloadGenerator::customerId(id));
+    if (customer != nullptr &&
+        customer->getLastName().substr(0, 6) == "Last12") {
+      matches++;
+    }
+  }
+  std::cout << "names: scan " << elapsedNs(start) / 1e6 << " ms ("
+            << matches << " matches)" << std::endl;
+
+  std::filesystem::remove(customersFile);
+  return 0;
+}
+
+// Splits 2 million borrows and returns by customer into 1 to 8 feed
+// files and times running them through FeedIngester, against running the
+// same files one after another with processCommands.
+int benchIngest() {
+  const int titles = 2000;
+  const int customers = 20000;
+  const int commands = 2000000;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  std::vector<std::string> lines = generator.commands(commands, mix);
+
+  std::ofstream sink("/dev/null");
+  int status = 0;
+  for (size_t feeds : {1, 2, 4, 8}) {
+    std::vector<std::string> files;
+    std::vector<std::ofstream> outputs;
+    for (size_t i = 0; i < feeds; i++) {
+      files.push_back(scratchFile("feed" + std::to_string(i) + ".txt"));
+      outputs.emplace_back(files.back());
+    }
+    for (const std::string &line : lines) {
+      outputs[std::stoul(line.substr(2)) % feeds] << line << '\n';
+    }
+    outputs.clear();
+
+    double serialSeconds = 0.0;
+    {
+      Store store;
+      store.setOutput(sink, sink);
+      store.loadMovies(moviesFile);
+      store.loadCustomers(customersFile);
+      auto start = Clock::now();
+      for (const std::string &file : files) {
+        store.processCommands(file);
+      }
+      serialSeconds = elapsedNs(start) / 1e9;
+    }
+
+    Store store;
+    store.setOutput(sink, sink);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    FeedIngester ingester(store, FeedIngester::Options());
+    FeedIngester::Report report;
+    if (!ingester.run(files, report)) {
+      status = 1;
+    }
+    double parseSeconds = 0.0;
+    for (const FeedIngester::FeedStats &stats : report.feeds) {
+      parseSeconds += stats.parseSeconds;
+    }
+    std::cout << "ingest " << feeds << " feeds: "
+              << static_cast<uint64_t>(commands / serialSeconds)
+              << " lines/s one file at a time, "
+              << static_cast<uint64_t>(commands / report.seconds)
+              << " lines/s ingested, " << parseSeconds
+              << " s reading and parsing off the store's thread, store idle "
+              << report.idleSeconds * 1000 << " ms" << std::endl;
+
+    for (const std::string &file : files) {
+      std::filesystem::remove(file);
+    }
+  }
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  return status;
+}
+
+#if defined(__cpp_impl_coroutine)
+// Borrows and returns copies one at a time, awaiting each before the
+// next, as a handler on an event loop would.
+StoreTask runClient(AsyncStore &store,
+                    const std::vector<StockRequest> &requests,
+                    uint64_t &completed) {
+  for (const StockRequest &request : requests) {
+    if (request.type == Transaction::BORROW) {
+      co_await store.borrow(request.customerId, request.mediaType,
+                            request.movieType, *request.movieInfo);
+    } else {
+      co_await store.giveBack(request.customerId, request.mediaType,
+                              request.movieType, *request.movieInfo);
+    }
+    completed++;
+  }
+}
+
+// Writes the columnar export from a coroutine, recording when it ends.
+StoreTask runExport(AsyncStore &store, const std::string &filename,
+                    Clock::time_point &finished) {
+  co_await store.exportColumnar(filename);
+  finished = Clock::now();
+}
+#endif
+
+// Compares borrows and returns awaited through AsyncStore, from 1, 16 and
+// 256 coroutines at a time, with the same requests run by Store::transact
+// on the calling thread, and how long a columnar export holds up the
+// caller either way.
+int benchAsync() {
+#if defined(__cpp_impl_coroutine)
+  const int titles = 2000;
+  const int customers = 20000;
+  const int requests = 500000;
+
+  WorkloadGenerator generator(titles, customers);
+  std::string moviesFile = scratchFile("movies.txt");
+  std::string customersFile = scratchFile("customers.txt");
+  std::string exportFile = scratchFile("async.col");
+  generator.writeMovies(moviesFile, 1000000);
+  generator.writeCustomers(customersFile);
+  WorkloadGenerator::Mix mix;
+  mix.histories = 0.0;
+  std::vector<std::unique_ptr<Command>> commands;
+  std::vector<StockRequest> stock;
+  for (const std::string &line : generator.commands(requests, mix)) {
+    commands.emplace_back(CommandFactory::getInstance().parseCommand(line));
+    StockRequest request;
+    if (commands.back() != nullptr &&
+        commands.back()->getStockRequest(request)) {
+      stock.push_back(request);
+    }
+  }
+
+  std::ofstream sink("/dev/null");
+  double syncNs = 0.0;
+  double syncExportMs = 0.0;
+  {
+    Store store;
+    store.setOutput(sink, sink);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    auto start = Clock::now();
+    for (const StockRequest &request : stock) {
+      store.transact(request);
+    }
+    syncNs = elapsedNs(start) / stock.size();
+    start = Clock::now();
+    store.exportColumnar(exportFile);
+    syncExportMs = elapsedNs(start) / 1e6;
+  }
+  std::cout << "async: transact on the caller's thread " << syncNs
+            << " ns/op, columnar export blocks it " << syncExportMs << " ms"
+            << std::endl;
+
+  for (size_t clients : {1, 16, 256}) {
+    Store store;
+    store.setOutput(sink, sink);
+    store.loadMovies(moviesFile);
+    store.loadCustomers(customersFile);
+    // Each customer's requests go to one client, so they keep their order.
+    std::vector<std::vector<StockRequest>> shares(clients);
+    for (const StockRequest &request : stock) {
+      shares[static_cast<size_t>(request.customerId) % clients].push_back(
+          request);
+    }
+    uint64_t completed = 0;
+    {
+      AsyncStore async(store);
+      auto start = Clock::now();
+      for (const std::vector<StockRequest> &share : shares) {
+        runClient(async, share, completed);
+      }
+      async.drain();
+      double asyncNs = elapsedNs(start) / completed;
+
+      Clock::time_point finished;
+      start = Clock::now();
+      runExport(async, exportFile, finished);
+      double blockedMs = elapsedNs(start) / 1e6;
+      async.drain();
+      std::cout << "async: " << clients << " coroutines " << asyncNs
+                << " ns/op (" << asyncNs / syncNs
+                << "x transact), columnar export blocks the caller "
+                << blockedMs << " ms of "
+                << std::chrono::duration<double, std::milli>(finished - start)
+                       .count()
+                << " ms" << std::endl;
+    }
+  }
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(customersFile);
+  std::filesystem::remove(exportFile);
+  return 0;
+#else
+  std::cerr << "async: needs a C++20 build (g++ -std=c++20)" << std::endl;
+  return 1;
+#endif
+}
+
+} // namespace
+
+/**
+ * Benchmark runner for the movie store.
+ * Runs the benchmark named on the command line, or all of them.
+ */
+int runBenchmarks(int argc, char *argv[]) {
+  const std::map<std::string, int (*)()> benchmarks = {
+      {"admission", benchAdmission},
+      {"async", benchAsync},
+      {"batch", benchBatch},
+      {"customers", benchCustomers},
+      {"errors", benchErrors},
+      {"export", benchExport},
+      {"format", benchFormat},
+      {"history", benchHistory},
+      {"ingest", benchIngest},
+      {"lazy", benchLazy},
+      {"loans", benchLoans},
+      {"media", benchMedia},
+      {"names", benchNames},
+      {"popularity", benchPopularity},
+      {"schedule", benchSchedule},
+      {"server", benchServer},
+      {"sharded", benchSharded},
+      {"simulate", benchSimulate},
+      {"snapshot", benchSnapshot},
+      {"summary", benchSummary},
+      {"trace", benchTrace},
+  };
+
+  if (argc == 0) {
+    for (const auto &benchmark : benchmarks) {
+      benchmark.second();
+    }
+    return 0;
+  }
+
+  int status = 0;
+  for (int i = 0; i < argc; i++) {
+    auto it = benchmarks.find(argv[i]);
+    if (it == benchmarks.end()) {
+      std::cerr << "Unknown benchmark: " << argv[i] << std::endl;
+      status = 1;
+      continue;
+    }
+    status |= it->second();
+  }
+  return status;
+}
@@ -1,13 +1,820 @@
 #include "Store.h"
+#include "command.h"
+#include "customer_name_index.h"
+#include "customer_table.h"
+#include "feed_ingester.h"
+#include "inventory_snapshot.h"
+#include "loan_tracker.h"
+#include "media_format.h"
+#include "movie.h"
+#include "popularity.h"
+#include "replay.h"
+#include "scheduler.h"
+#include "sharded_store.h"
+#include "workload.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+// Reports a failed check on standard error, so passing checks leave the
+// test output unchanged.
+void check(bool passed, const char *what) {
+  if (!passed) {
+    std::cerr << "FAILED: " << what << std::endl;
+    failures++;
+  }
+}
+
+// Returns the path of a scratch file for a test.
+std::string scratchFile(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / ("movie_test_" + name))
+      .string();
+}
+
+// Returns the non-empty lines of a file.
+std::vector<std::string> readLines(const std::string &filename) {
+  std::ifstream file(filename);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+  return lines;
+}
+
+// Writes lines to a file, one per line.
+void writeLines(const std::string &filename,
+                const std::vector<std::string> &lines) {
+  std::ofstream file(filename);
+  for (const std::string &line : lines) {
+    file << line << '\n';
+  }
+}
+
+// Borrows copies while readers take snapshots. Every borrow publishes
+// exactly one version, so a consistent snapshot has as many copies out as
+// versions since the start; a version recycled while pinned breaks that.
+void testSnapshotsAgainstWriter() {
+  const int titles = 8;
+  const int borrows = 20000;
+  const int readers = 4;
+
+  std::vector<std::unique_ptr<Movie>> movies;
+  InventoryVersions versions;
+  std::vector<const Movie *> catalog;
+  for (int i = 0; i < titles; i++) {
+    movies.push_back(std::make_unique<Comedy>(borrows, "Director",
+                                              "Title " + std::to_string(i),
+                                              2000 + i));
+    versions.publish(*movies.back());
+    catalog.push_back(movies.back().get());
+  }
+  versions.publishCatalog(catalog);
+  uint64_t base = versions.snapshot().getVersion();
+
+  std::atomic<bool> done{false};
+  std::atomic<int> inconsistent{0};
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; r++) {
+    threads.emplace_back([&] {
+      while (!done) {
+        InventorySnapshot snapshot = versions.snapshot();
+        uint64_t out = 0;
+        for (size_t i = 0; i < snapshot.size(); i++) {
+          out += static_cast<uint64_t>(totalCount(snapshot.row(i).borrowed));
+        }
+        if (out != snapshot.getVersion() - base) {
+          inconsistent++;
+        }
+      }
+    });
+  }
+  for (int i = 0; i < borrows; i++) {
+    Movie &movie = *movies[i % titles];
+    movie.borrowMovie(DVD);
+    versions.publish(movie);
+  }
+  done = true;
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  check(inconsistent == 0, "snapshots are consistent during writes");
+  InventorySnapshot last = versions.snapshot();
+  check(last.getVersion() - base == static_cast<uint64_t>(borrows),
+        "every borrow publishes one version");
+}
+
+// Runs the same borrows and returns on a sharded store and on a single
+// store stocking as many copies as all the shards together. Nothing runs
+// out, so the summed inventory report must match the single store's. A
+// store-wide command that would describe one shard must be refused.
+void testShardedInventory() {
+  WorkloadGenerator generator(20, 60);
+  std::filesystem::path dir = std::filesystem::temp_directory_path();
+  std::string moviesFile = (dir / "movie_test_movies.txt").string();
+  std::string pooledFile = (dir / "movie_test_pooled.txt").string();
+  std::string customersFile = (dir / "movie_test_customers.txt").string();
+  generator.writeMovies(moviesFile, 1000);
+  generator.writeMovies(pooledFile, 3000);
+  generator.writeCustomers(customersFile);
+  std::vector<std::string> lines =
+      generator.commands(2000, WorkloadGenerator::Mix());
+
+  std::ostringstream expected;
+  std::ostringstream ignored;
+  Store single;
+  single.setOutput(ignored, ignored);
+  single.loadMovies(pooledFile);
+  single.loadCustomers(customersFile);
+  single.processLines(lines, "test");
+  single.finishCommands();
+  single.setOutput(expected, ignored);
+  single.displayInventory();
+
+  ShardedStore sharded(3);
+  sharded.loadMovies(moviesFile);
+  sharded.loadCustomers(customersFile);
+  for (const std::string &line : lines) {
+    sharded.submit(line);
+  }
+  sharded.drain();
+  for (size_t i = 0; i < sharded.shardCount(); i++) {
+    sharded.takeOutput(i);
+  }
+  check(sharded.submit("I"), "sharded store accepts I");
+  check(sharded.takeOutput(0) == expected.str(),
+        "sharded inventory matches a single store's");
+
+  std::streambuf *errors = std::cerr.rdbuf(ignored.rdbuf());
+  bool exported = sharded.submit("E " + (dir / "movie_test.col").string());
+  std::cerr.rdbuf(errors);
+  check(!exported, "sharded store refuses E");
+
+  std::filesystem::remove(moviesFile);
+  std::filesystem::remove(pooledFile);
+  std::filesystem::remove(customersFile);
+}
+
+// Replays the data4 files and compares the output with the golden copy
+// recorded from them.
+void testReplayMatchesGolden() {
+  ReplayDriver driver((ReplayDriver::Options()));
+  ReplayDriver::Report report;
+  check(driver.run(report) &&
+            ReplayDriver::verify(report.output, "data4golden.txt"),
+        "replay of the data4 files matches data4golden.txt");
+}
+
+// Checks that a history page must be given as two whole, non-negative
+// numbers.
+void testHistoryPageArguments() {
+  std::ostringstream ignored;
+  CommandFactory &factory = CommandFactory::getInstance();
+  std::unique_ptr<Command> page(factory.createCommand("H 1000 2 5", ignored));
+  check(page != nullptr, "H accepts an offset and a limit");
+  for (const char *line : {"H 1000 0 -1", "H 1000 -1 5", "H 1000 2x 5",
+                           "H 1000 2"}) {
+    std::unique_ptr<Command> rejected(factory.createCommand(line, ignored));
+    check(rejected == nullptr, line);
+  }
+  std::unique_ptr<Command> top(factory.createCommand("T 5 D", ignored));
+  check(top != nullptr, "T accepts a count and a genre");
+  for (const char *line : {"T 0", "T 5 Z", "T Z", "T 5 DF"}) {
+    std::unique_ptr<Command> rejected(factory.createCommand(line, ignored));
+    check(rejected == nullptr, line);
+  }
+}
+
+// Borrows more titles than the sketch counts, all equally often, so every
+// eviction picks among tied counts, then borrows one title past the rest.
+// Each count must still bound the true count, no title may be counted
+// twice, and the title borrowed most must lead.
+void testTopTitlesTies() {
+  const int titles = 10;
+  const size_t capacity = 4;
+
+  std::vector<std::unique_ptr<Movie>> movies;
+  for (int i = 0; i < titles; i++) {
+    movies.push_back(std::make_unique<Comedy>(
+        1, "Director", "Title " + std::to_string(i), 2000 + i));
+  }
+  TopTitles sketch(capacity);
+  std::vector<uint64_t> borrowed(titles);
+  auto borrow = [&](int i) {
+    sketch.record(movies[i].get());
+    borrowed[i]++;
+  };
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < titles; i++) {
+      borrow(i);
+    }
+  }
+  for (int i = 0; i < 20; i++) {
+    borrow(7);
+  }
+
+  std::vector<TopTitles::Entry> top = sketch.top(capacity);
+  check(top.size() == capacity, "top titles fill the sketch");
+  std::set<const Movie *> seen;
+  bool bounded = true;
+  for (const TopTitles::Entry &entry : top) {
+    seen.insert(entry.movie);
+    for (int i = 0; i < titles; i++) {
+      if (movies[i].get() == entry.movie) {
+        bounded = bounded && entry.count - entry.error <= borrowed[i] &&
+                  borrowed[i] <= entry.count;
+      }
+    }
+  }
+  check(seen.size() == top.size(), "tied evictions count no title twice");
+  check(bounded, "tied evictions keep the count bounds");
+  check(!top.empty() && top[0].movie == movies[7].get(),
+        "the most borrowed title leads after tied evictions");
+}
+
+// Lends the only copy of a title, queues two holds on it, then returns
+// it twice. Each return must go to the next hold in line, recorded as a
+// borrow in the waiting customer's history, and the copy stays out until
+// the last holder brings it back.
+void testHoldsFilledOnReturn() {
+  std::string moviesFile =
+      (std::filesystem::temp_directory_path() / "movie_test_holds.txt")
+          .string();
+  {
+    std::ofstream file(moviesFile);
+    file << "F, 1, Director, Only Copy, 2001\n";
+  }
+  std::ostringstream ignored;
+  Store store;
+  store.setOutput(ignored, ignored);
+  store.loadMovies(moviesFile);
+  for (int id : {1001, 1002, 1003}) {
+    store.addCustomer(id, "Last", "First");
+  }
+  const std::string title = "Only Copy, 2001";
+  Movie *movie = store.findMovie('F', title);
+  check(movie != nullptr, "the held title loads");
+  if (movie == nullptr) {
+    return;
+  }
+
+  // Counts the borrows in a customer's history.
+  auto borrows = [&store](int id) {
+    HistoryQuery query;
+    query.type = 'B';
+    std::vector<Transaction> page;
+    size_t total = 0;
+    store.customerHistory(id, query, page, total);
+    return total;
+  };
+
+  store.borrowMovie(1001, 'D', 'F', title);
+  store.holdMovie(1002, 'D', 'F', title);
+  store.holdMovie(1003, 'D', 'F', title);
+  check(store.holdCount(movie, DVD) == 2, "holds queue on a title out");
+  check(borrows(1002) == 0 && borrows(1003) == 0,
+        "a hold does not lend a copy out of stock");
+
+  store.returnMovie(1001, 'D', 'F', title);
+  check(store.holdCount(movie, DVD) == 1, "a return fills one hold");
+  check(borrows(1002) == 1 && borrows(1003) == 0,
+        "a return fills the first hold");
+  check(movie->getBorrowed(DVD) == 1, "a filled hold keeps the copy out");
+
+  store.returnMovie(1002, 'D', 'F', title);
+  check(store.holdCount(movie, DVD) == 0 && borrows(1003) == 1,
+        "the next return fills the next hold");
+
+  store.returnMovie(1003, 'D', 'F', title);
+  check(movie->getBorrowed(DVD) == 0, "the last return restocks the copy");
+  std::filesystem::remove(moviesFile);
+}
+
+// Opens loans due on both sides of each level boundary of the timer
+// wheel, and past its top level, then steps the clock to just before and
+// just at each due date. A loan must fall due exactly at its due date,
+// whichever levels it cascades through, and in due date order.
+void testLoanCascades() {
+  std::vector<uint64_t> dues = {1, 63, 64, 65, 127, 128, 4095, 4096, 4097};
+  for (int bits = 18; bits <= 36; bits += 6) {
+    uint64_t boundary = uint64_t{1} << bits;
+    for (uint64_t due : {boundary - 1, boundary, boundary + 1}) {
+      dues.push_back(due);
+    }
+  }
+
+  LoanTracker loans;
+  for (size_t i = 0; i < dues.size(); i++) {
+    loans.open(static_cast<CustomerHandle>(i), nullptr, DVD, 0, dues[i]);
+  }
+  std::vector<uint64_t> sorted = dues;
+  std::sort(sorted.begin(), sorted.end());
+
+  bool exact = true;
+  for (size_t i = 0; i < sorted.size(); i++) {
+    loans.advance(sorted[i] - 1);
+    exact = exact && loans.overdueCount() == i;
+    loans.advance(sorted[i]);
+    exact = exact && loans.overdueCount() == i + 1;
+  }
+  check(exact, "loans fall due exactly at level boundaries");
+
+  std::vector<uint64_t> order;
+  loans.forEachOverdue([&order](const Loan &loan) {
+    order.push_back(loan.due);
+  });
+  check(order == sorted, "loans fall due in due date order");
+}
+
+// Keeps an interactive line queued at every step while a bulk line that
+// arrived long ago waits. Once the bulk line is past its target, it must
+// run after the next interactive turn rather than wait for the
+// interactive lines to stop.
+void testBulkNotStarved() {
+  std::ostringstream ignored;
+  Store store;
+  store.setOutput(ignored, ignored);
+  store.loadMovies("data4movies.txt");
+  store.loadCustomers("data4customers.txt");
+
+  CommandScheduler::Options options;
+  CommandScheduler scheduler(store, options);
+  scheduler.submit("B 1111 D F You've Got Mail, 1998",
+                   CommandScheduler::Clock::now() - 10 * options.bulkTarget);
+  for (int i = 0; i < 2; i++) {
+    scheduler.submit("H 1000");
+    scheduler.submit("H 1000");
+    scheduler.step();
+  }
+  check(scheduler.report(CommandScheduler::BULK).completed == 1,
+        "a late bulk line runs while interactive lines wait");
+  check(scheduler.report(CommandScheduler::INTERACTIVE).completed > 0,
+        "interactive lines still run while bulk is late");
+  scheduler.drain();
+}
+
+// Searches last names that share their first 12 bytes, the part the index
+// keeps in its entries, with prefixes shorter than, as long as and longer
+// than that. Past 12 bytes the names must be told apart by reading the
+// records, in any case.
+void testLongNamePrefixes() {
+  CustomerTable table;
+  CustomerNameIndex index(table);
+  const char *names[] = {"Abcdefghijkl", "Abcdefghijklmnop",
+                         "ABCDEFGHIJKLMNOQ", "Abcdefghijklxyz",
+                         "Abcdefghijk"};
+  for (int i = 0; i < 5; i++) {
+    index.add(table.add(2000 + i, names[i], "First"));
+  }
+  index.sort();
+
+  // Returns the ids of the customers whose last name starts with prefix.
+  auto ids = [&index](const char *prefix) {
+    std::vector<int> found;
+    index.find(prefix, 10, [&found](const Customer &customer) {
+      found.push_back(customer.getId());
+    });
+    return found;
+  };
+  check(ids("abcdefghijk").size() == 5, "an 11-byte prefix matches all");
+  check(ids("abcdefghijkl").size() == 4, "a 12-byte prefix matches");
+  check(ids("abcdefghijklm") == std::vector<int>({2001, 2002}),
+        "a 13-byte prefix tells names apart past the key");
+  check(ids("ABCDEFGHIJKLMNOP") == std::vector<int>({2001}),
+        "a full-length prefix matches one name in any case");
+  check(ids("abcdefghijklmnopq").empty(),
+        "a prefix longer than every name matches none");
+  check(ids("abcdefghijklx") == std::vector<int>({2003}),
+        "a long prefix past the key finds the last name");
+}
+
+// Loads movie lines of known genres with bad years, and one of an unknown
+// genre. The bad years must be counted and sampled as malformed movie
+// lines rather than written out each time and counted as unknown types.
+void testBadMovieYears() {
+  std::string moviesFile =
+      (std::filesystem::temp_directory_path() / "movie_test_years.txt")
+          .string();
+  {
+    std::ofstream file(moviesFile);
+    for (int i = 0; i < 30; i++) {
+      file << "F, 1, Director, Title " << i << ", abc\n";
+    }
+    file << "D, 1, Director, Drama, year\n";
+    file << "C, 1, Director, Classic, Some Actor x 1950\n";
+    file << "Z, 1, Director, Unknown, 2000\n";
+  }
+  std::ostringstream output;
+  std::ostringstream errors;
+  Store store;
+  store.setOutput(output, errors);
+  store.loadMovies(moviesFile);
+  store.printErrorSummary();
+  std::filesystem::remove(moviesFile);
+
+  std::string text = errors.str();
+  size_t details = 0;
+  for (size_t at = text.find("Invalid movie format");
+       at != std::string::npos;
+       at = text.find("Invalid movie format", at + 1)) {
+    details++;
+  }
+  check(details > 0 && details < 32, "bad years are sampled");
+  check(text.find("invalid movie format: 32") != std::string::npos,
+        "bad years count as malformed movie lines");
+  check(text.find("unknown movie type: 1\n") != std::string::npos,
+        "only the unknown genre counts as an unknown type");
+}
+
+// Runs the data4 commands, followed by a batch in which a return fills a
+// hold and a borrow finds the title out of stock, one command at a time
+// and in batches. The output and the final inventory must be the same.
+void testBatchMatchesSingle() {
+  std::string moviesFile = scratchFile("batch_movies.txt");
+  std::vector<std::string> movies = readLines("data4movies.txt");
+  movies.push_back("F, 1, Director, Only Copy, 2001");
+  writeLines(moviesFile, movies);
+
+  std::vector<std::string> lines = readLines("data4commands.txt");
+  for (const char *line :
+       {"B 1000 D F Only Copy, 2001", "W 1111 D F Only Copy, 2001",
+        "R 1000 D F Only Copy, 2001", "B 8000 D F Only Copy, 2001",
+        "R 1111 D F Only Copy, 2001", "B 8000 D F Only Copy, 2001",
+        "H 1111", "H 8000"}) {
+    lines.push_back(line);
+  }
+
+  // Returns what running the lines prints, then the inventory.
+  auto run = [&](bool batched) {
+    std::ostringstream output;
+    Store store;
+    store.setOutput(output, output);
+    if (!batched) {
+      store.setBatchSize(1);
+    }
+    store.loadMovies(moviesFile);
+    store.loadCustomers("data4customers.txt");
+    store.processLines(lines, "commands");
+    store.finishCommands();
+    store.displayInventory();
+    return output.str();
+  };
+  std::string single = run(false);
+  std::string batched = run(true);
+  std::filesystem::remove(moviesFile);
+
+  check(single.find("Hold filled") != std::string::npos &&
+            single.find("out of stock") != std::string::npos,
+        "the batch fills a hold and finds a title out of stock");
+  check(batched == single, "batches print what single commands print");
+}
+
+// Builds a long history of borrows and returns in three genres, then
+// pages through it with and without a budget small enough to spill most
+// of it. Pages spanning spilled and in-memory entries, in either order
+// and filtered by type or genre, must read the same.
+void testSpilledHistoryPages() {
+  const char *titles[] = {"F Annie Hall, 1977",
+                          "D Barry Levinson, Good Morning Vietnam,",
+                          "C 5 1940 Katherine Hepburn"};
+  std::vector<std::string> lines;
+  for (int i = 0; i < 120; i++) {
+    std::string title = titles[i % 3];
+    lines.push_back("B 1000 D " + title);
+    if (i % 4 != 0) {
+      lines.push_back("R 1000 D " + title);
+    }
+  }
+  for (const char *query :
+       {"H 1000", "H 1000 5 30", "H 1000 150 40", "H 1000 5 30 newest",
+        "H 1000 0 200 newest", "H 1000 40 25 type=B",
+        "H 1000 10 20 newest type=R", "H 1000 3 50 genre=F",
+        "H 1000 20 15 newest genre=C", "H 1000 2 30 type=B genre=D"}) {
+    lines.push_back(query);
+  }
+
+  // Returns what running the lines prints, and how many entries spilled.
+  auto run = [&lines](size_t budget, size_t &spilled) {
+    std::ostringstream output;
+    Store store;
+    store.setOutput(output, output);
+    store.loadMovies("data4movies.txt");
+    store.loadCustomers("data4customers.txt");
+    if (budget > 0) {
+      store.setHistoryBudget(budget);
+    }
+    store.processLines(lines, "commands");
+    store.finishCommands();
+    spilled = store.findCustomer(1000)->getSpilledCount();
+    return output.str();
+  };
+  size_t spilled = 0;
+  std::string inMemory = run(0, spilled);
+  std::string paged = run(HistorySpill::MIN_BUDGET, spilled);
+  check(spilled > 150, "a small budget spills most of a history");
+  check(paged == inMemory, "spilled history pages match in-memory ones");
+}
+
+// Lends copies, then reloads a catalog that retires a title, restocks one
+// with copies out and adds one, and keeps lending. The inventory and the
+// open loans must be those of a store that loaded the new catalog fresh
+// and lent the same copies of the titles it has.
+void testReloadMatchesFreshLoad() {
+  std::string reloadFile = scratchFile("reload_movies.txt");
+  std::vector<std::string> movies;
+  for (const std::string &line : readLines("data4movies.txt")) {
+    if (line.find("Sleepless in Seattle") != std::string::npos) {
+      continue;
+    }
+    if (line.find("Barry Levinson, Good Morning Vietnam") !=
+        std::string::npos) {
+      movies.push_back("D, 3, Barry Levinson, Good Morning Vietnam, 1988");
+    } else {
+      movies.push_back(line);
+    }
+  }
+  movies.push_back("F, 2, New Director, New Title, 2020");
+  writeLines(reloadFile, movies);
+
+  std::vector<std::string> before = {
+      "B 1000 D F Annie Hall, 1977",
+      "B 1111 D D Barry Levinson, Good Morning Vietnam,",
+      "B 8000 D D Barry Levinson, Good Morning Vietnam,",
+      "B 2000 D F Sleepless in Seattle, 1993",
+      "R 2000 D F Sleepless in Seattle, 1993"};
+  std::vector<std::string> after = {
+      "B 9000 D F Annie Hall, 1977", "B 5000 D F New Title, 2020",
+      "B 3333 D D Barry Levinson, Good Morning Vietnam,",
+      "R 1111 D D Barry Levinson, Good Morning Vietnam,"};
+
+  // Returns the inventory and the overdue report once every loan is due.
+  auto report = [](Store &store) {
+    std::ostringstream output;
+    store.setOutput(output, output);
+    store.displayInventory();
+    store.displayOverdue();
+    return output.str();
+  };
+
+  std::ostringstream ignored;
+  Store reloaded;
+  reloaded.setOutput(ignored, ignored);
+  reloaded.setLoanPeriod(1);
+  reloaded.loadMovies("data4movies.txt");
+  reloaded.loadCustomers("data4customers.txt");
+  reloaded.processLines(before, "before");
+  reloaded.finishCommands();
+  reloaded.reloadCatalog(reloadFile);
+  reloaded.finishReload();
+  reloaded.processLines(after, "after");
+  reloaded.finishCommands();
+
+  // The fresh store runs a lookup in place of each command about the
+  // retired title, so the clocks agree.
+  Store fresh;
+  fresh.setOutput(ignored, ignored);
+  fresh.setLoanPeriod(1);
+  fresh.loadMovies(reloadFile);
+  fresh.loadCustomers("data4customers.txt");
+  std::vector<std::string> kept(before.begin(), before.begin() + 3);
+  kept.insert(kept.end(), {"H 2000", "H 2000"});
+  fresh.processLines(kept, "before");
+  fresh.processLines(after, "after");
+  fresh.finishCommands();
+  std::filesystem::remove(reloadFile);
+
+  std::string expected = report(fresh);
+  check(expected.find("Wally Wacky: Good Morning Vietnam") !=
+            std::string::npos,
+        "loans of a restocked title stay open");
+  check(report(reloaded) == expected,
+        "a reload matches a fresh load of the new catalog");
+}
+
+// Parses per-format stock fields, then lends and returns each format of
+// one title. The counts, the inventory and the history must name the
+// format each command asked for.
+void testFormatStock() {
+  FormatCounts counts;
+  check(parseFormatCounts("5/3/2", counts) && counts == FormatCounts{5, 3, 2},
+        "a stock field gives a count per format");
+  check(parseFormatCounts("4", counts) && counts == FormatCounts{4, 0, 0},
+        "formats left out have no copies");
+  check(!parseFormatCounts("1/2/3/4", counts), "extra formats are rejected");
+  check(!parseFormatCounts("5/", counts), "empty counts are rejected");
+
+  std::string moviesFile = scratchFile("format_movies.txt");
+  writeLines(moviesFile, {"F, 2/3/1, Director, Formats, 2001",
+                          "F, 1/2/3/4, Director, Too Many, 2001",
+                          "F, 5/, Director, Trailing, 2001"});
+  std::ostringstream output;
+  Store store;
+  store.setOutput(output, output);
+  store.loadMovies(moviesFile);
+  store.loadCustomers("data4customers.txt");
+  std::filesystem::remove(moviesFile);
+  store.processLines({"B 1000 B F Formats, 2001", "B 2000 B F Formats, 2001",
+                      "B 1111 L F Formats, 2001", "B 3333 L F Formats, 2001",
+                      "R 2000 B F Formats, 2001", "I", "H 1000"},
+                     "formats");
+  store.finishCommands();
+  store.printErrorSummary();
+
+  Movie *movie = store.findMovie('F', "Formats, 2001");
+  check(movie != nullptr && movie->getBorrowed(DVD) == 0 &&
+            movie->getBorrowed(BLU_RAY) == 1 &&
+            movie->getBorrowed(DIGITAL) == 1,
+        "borrows and returns change the format asked for");
+  std::string text = output.str();
+  check(text.find("invalid stock number: 2") != std::string::npos,
+        "bad stock fields are reported");
+  check(text.find(" Stock: 2 Out: 0 Blu-ray Stock: 2 Out: 1 Digital Stock: "
+                  "0 Out: 1") != std::string::npos,
+        "the inventory shows each format");
+  check(text.find("Formats (Blu-ray)") != std::string::npos,
+        "the history names the format");
+}
+
+// Runs three feeds about different customers through a FeedIngester in
+// small chunks. Each feed returns only what it borrowed before, so a line
+// run out of order fails; the histories must match running the feeds one
+// after another.
+void testFeedsMatchSerial() {
+  std::vector<std::vector<std::string>> feeds = {
+      {"B 1000 D F Annie Hall, 1977", "R 1000 D F Annie Hall, 1977",
+       "B 1000 D F Fargo, 1996", "B 1000 D F Annie Hall, 1977",
+       "R 1000 D F Fargo, 1996"},
+      {"B 1111 D D Gus Van Sant, Good Will Hunting,",
+       "R 1111 D D Gus Van Sant, Good Will Hunting,",
+       "B 1111 D D Clint Eastwood, Unforgiven,",
+       "R 1111 D D Clint Eastwood, Unforgiven,", "", "X bad line"},
+      {"B 8000 D C 2 1939 Vivien Leigh", "B 8000 D C 3 1971 Ruth Gordon",
+       "R 8000 D C 2 1939 Vivien Leigh", "R 8000 D C 3 1971 Ruth Gordon"}};
+  std::vector<std::string> files;
+  for (size_t i = 0; i < feeds.size(); i++) {
+    files.push_back(scratchFile("feed" + std::to_string(i) + ".txt"));
+    writeLines(files.back(), feeds[i]);
+  }
+
+  // Returns the history of each feed's customer.
+  auto histories = [](Store &store) {
+    std::ostringstream output;
+    store.setOutput(output, output);
+    store.processLines({"H 1000", "H 1111", "H 8000"}, "histories");
+    store.finishCommands();
+    return output.str();
+  };
+
+  std::ostringstream ignored;
+  Store serial;
+  serial.setOutput(ignored, ignored);
+  serial.loadMovies("data4movies.txt");
+  serial.loadCustomers("data4customers.txt");
+  for (const std::string &file : files) {
+    serial.processCommands(file);
+  }
+
+  Store fed;
+  fed.setOutput(ignored, ignored);
+  fed.loadMovies("data4movies.txt");
+  fed.loadCustomers("data4customers.txt");
+  FeedIngester::Options options;
+  options.chunkLines = 2;
+  options.queueChunks = 2;
+  FeedIngester ingester(fed, options);
+  FeedIngester::Report report;
+  bool ran = ingester.run(files, report);
+  for (const std::string &file : files) {
+    std::filesystem::remove(file);
+  }
+
+  check(ran && report.feeds.size() == 3 && report.lines == 15,
+        "every feed line is read");
+  check(ran && report.feeds[0].commands == 5 &&
+            report.feeds[1].commands == 4 && report.feeds[1].rejected == 1 &&
+            report.feeds[2].commands == 4,
+        "each feed counts its own commands");
+  std::string expected = histories(serial);
+  check(expected.find("Return Minnie Mouse Fargo") != std::string::npos,
+        "the serial run returns what it borrowed");
+  check(histories(fed) == expected, "feeds run in order like a serial run");
+}
+
+// Runs the data4 commands, a reload and more commands against a lazily
+// loaded catalog and an eager one. The commands must print the same.
+void testLazyMatchesEager() {
+  std::string reloadFile = scratchFile("lazy_movies.txt");
+  std::vector<std::string> movies = readLines("data4movies.txt");
+  movies.erase(movies.begin() + 3);
+  movies.push_back("F, 2, New Director, New Title, 2020");
+  writeLines(reloadFile, movies);
+
+  std::vector<std::string> before;
+  for (const std::string &line : readLines("data4commands.txt")) {
+    if (line != "I") {
+      before.push_back(line);
+    }
+  }
+  before.push_back("L " + reloadFile);
+  std::vector<std::string> after = {
+      "B 9000 D F New Title, 2020", "B 9000 D F Sleepless in Seattle, 1993",
+      "R 1000 D D Barry Levinson, Good Morning Vietnam,", "H 9000", "I"};
+
+  // Returns what the commands print.
+  auto run = [&](bool lazy) {
+    std::ostringstream ignored;
+    std::ostringstream output;
+    Store store;
+    store.setOutput(ignored, ignored);
+    store.setLazyCatalog(lazy);
+    store.loadMovies("data4movies.txt");
+    store.loadCustomers("data4customers.txt");
+    store.setOutput(output, output);
+    store.processLines(before, "before");
+    store.finishCommands();
+    store.finishReload();
+    store.processLines(after, "after");
+    store.finishCommands();
+    return output.str();
+  };
+
+  std::string eager = run(false);
+  std::string lazy = run(true);
+  std::filesystem::remove(reloadFile);
+  check(eager.find("New Title") != std::string::npos,
+        "the eager catalog reloads");
+  check(lazy == eager, "a lazy catalog prints what an eager one does");
+}
+
+// Loads a customer file with many malformed lines into a sharded store.
+// Only the first shard reports them, and only as many as a single store
+// would.
+void testShardedCustomerErrors() {
+  std::string customersFile = scratchFile("sharded_customers.txt");
+  std::vector<std::string> lines = readLines("data4customers.txt");
+  for (int i = 0; i < 30; i++) {
+    lines.push_back("bad" + std::to_string(i));
+  }
+  writeLines(customersFile, lines);
+
+  std::ostringstream expected;
+  Store single;
+  single.setOutput(expected, expected);
+  single.loadCustomers(customersFile);
+
+  ShardedStore sharded(3);
+  sharded.loadCustomers(customersFile);
+  std::filesystem::remove(customersFile);
+  check(sharded.takeOutput(0) == expected.str(),
+        "the first shard samples bad customer lines");
+  check(sharded.takeOutput(1).empty() && sharded.takeOutput(2).empty(),
+        "other shards report nothing");
+}
+
+} // namespace
 
 /**
  * Test runner for the movie store.
  * This function initializes the store, loads movie and customer data,
- * and processes a series of commands from files.
+ * and processes a series of commands from files, then runs the checks of
+ * the store's data structures. Returns false if a check failed.
  */
-void testAll() {
+bool testAll() {
   Store store;
   store.loadMovies("data4movies.txt");
   store.loadCustomers("data4customers.txt");
   store.processCommands("data4commands.txt");
-}
\ No newline at end of file
+
+  testHistoryPageArguments();
+  testTopTitlesTies();
+  testHoldsFilledOnReturn();
+  testLoanCascades();
+  testBulkNotStarved();
+  testLongNamePrefixes();
+  testBadMovieYears();
+  testBatchMatchesSingle();
+  testSpilledHistoryPages();
+  testReloadMatchesFreshLoad();
+  testFormatStock();
+  testFeedsMatchSerial();
+  testLazyMatchesEager();
+  testShardedCustomerErrors();
+  testSnapshotsAgainstWriter();
+  testShardedInventory();
+  testReplayMatchesGolden();
+  return failures == 0;
+}
@@ -0,0 +1,155 @@
+#include "trace.h"
+#include "format_buffer.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled{false};
+
+namespace {
+
+struct Event {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+// The spans of one thread. Only that thread appends to it; the buffer
+// outlives the thread so its spans can be written after it exits.
+struct ThreadBuffer {
+  size_t id;
+  std::string name;
+  std::vector<Event> events;
+  size_t dropped = 0;
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+uint64_t origin = 0;
+thread_local ThreadBuffer *localBuffer = nullptr;
+
+// Returns the calling thread's buffer, registering it on first use.
+ThreadBuffer &threadBuffer() {
+  if (localBuffer == nullptr) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(std::make_unique<ThreadBuffer>());
+    localBuffer = registry.back().get();
+    localBuffer->id = registry.size();
+  }
+  return *localBuffer;
+}
+
+// Appends a string as a JSON string literal.
+void appendJsonString(FormatBuffer &out, const std::string &text) {
+  out << '"';
+  for (char ch : text) {
+    if (ch == '"' || ch == '\\') {
+      out << '\\' << ch;
+    } else if (static_cast<unsigned char>(ch) >= 0x20) {
+      out << ch;
+    }
+  }
+  out << '"';
+}
+
+// Appends a duration in nanoseconds as microseconds with three decimals,
+// the unit of trace-event timestamps.
+void appendMicros(FormatBuffer &out, uint64_t ns) {
+  uint64_t fraction = ns % 1000;
+  out << ns / 1000 << '.' << static_cast<char>('0' + fraction / 100)
+      << static_cast<char>('0' + fraction / 10 % 10)
+      << static_cast<char>('0' + fraction % 10);
+}
+
+} // namespace
+
+// Clears every buffer and starts recording.
+void Tracer::start() {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  for (auto &buffer : registry) {
+    buffer->events.clear();
+    buffer->dropped = 0;
+  }
+  origin = now();
+  enabled.store(true, std::memory_order_relaxed);
+}
+
+// Stops recording and writes one complete event per span, and a name for
+// each named thread.
+bool Tracer::stop(const std::string &path) {
+  enabled.store(false, std::memory_order_relaxed);
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << path << std::endl;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  FormatBuffer out;
+  out << "{\"traceEvents\":[";
+  const char *separator = "\n";
+  size_t dropped = 0;
+  for (const auto &buffer : registry) {
+    if (!buffer->name.empty()) {
+      out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          << "\"tid\":" << buffer->id << ",\"args\":{\"name\":";
+      appendJsonString(out, buffer->name);
+      out << "}}";
+      separator = ",\n";
+    }
+    for (const Event &event : buffer->events) {
+      out << separator << "{\"name\":";
+      appendJsonString(out, event.name);
+      out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":";
+      appendMicros(out, event.start - origin);
+      out << ",\"dur\":";
+      appendMicros(out, event.end - event.start);
+      out << '}';
+      separator = ",\n";
+      if (out.size() >= 1 << 16) {
+        out.flushTo(file);
+      }
+    }
+    dropped += buffer->dropped;
+    buffer->events.clear();
+    buffer->events.shrink_to_fit();
+    buffer->dropped = 0;
+  }
+  out << "\n]}\n";
+  out.flushTo(file);
+
+  if (dropped > 0) {
+    std::cerr << "Trace: dropped " << dropped << " spans over the limit of "
+              << MAX_EVENTS_PER_THREAD << " per thread" << std::endl;
+  }
+  return file.good();
+}
+
+// Sets the name the calling thread is shown under.
+void Tracer::nameThread(const std::string &name) {
+  ThreadBuffer &buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(registryMutex);
+  buffer.name = name;
+}
+
+// Reads the monotonic clock.
+uint64_t Tracer::now() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+// Appends a span to the calling thread's buffer, or counts it as dropped
+// once the buffer is full.
+void Tracer::record(const char *name, uint64_t start, uint64_t end) {
+  ThreadBuffer &buffer = threadBuffer();
+  if (buffer.events.size() >= MAX_EVENTS_PER_THREAD) {
+    buffer.dropped++;
+    return;
+  }
+  buffer.events.push_back({name, start, end});
+}
@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Records scoped spans on every thread into per-thread buffers and writes
+// them as Chrome trace-event JSON, for chrome://tracing or Perfetto. While
+// tracing is off a span costs one relaxed atomic load.
+class Tracer {
+public:
+  // Most spans kept per thread; later ones are counted and dropped.
+  static constexpr size_t MAX_EVENTS_PER_THREAD = size_t{1} << 21;
+
+  // Starts recording spans, discarding any recorded before.
+  static void start();
+  // Stops recording and writes the recorded spans to a file. Spans still
+  // open on other threads must have finished. Returns false if the file
+  // cannot be written.
+  static bool stop(const std::string &path);
+  // Returns true while spans are recorded.
+  static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+  // Names the calling thread in the trace.
+  static void nameThread(const std::string &name);
+
+  // Returns the current time in nanoseconds.
+  static uint64_t now();
+  // Adds a finished span to the calling thread's buffer. `name` must
+  // outlive the trace; span names are string literals.
+  static void record(const char *name, uint64_t start, uint64_t end);
+
+private:
+  static std::atomic<bool> enabled;
+};
+
+// Records the time from its construction to its destruction as a span of
+// the calling thread, if tracing was on when it was constructed.
+class TraceSpan {
+public:
+  explicit TraceSpan(const char *name)
+      : name(name), start(Tracer::isEnabled() ? Tracer::now() : 0) {}
+  ~TraceSpan() {
+    if (start != 0) {
+      Tracer::record(name, start, Tracer::now());
+    }
+  }
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+  const char *name;
+  uint64_t start;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,168 @@
+#include "workload.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// Constructs a workload generator.
+WorkloadGenerator::WorkloadGenerator(int titles, int customers, unsigned seed)
+    : titles(titles), customers(customers), rng(seed) {}
+
+// Returns the genre and search text of a title. Titles cycle through the
+// three genres so every lookup path is exercised.
+std::string WorkloadGenerator::movieCriteria(int index) {
+  int year = 1930 + index % 90;
+  switch (index % 3) {
+  case 0:
+    return "F Comedy " + std::to_string(index) + ", " + std::to_string(year);
+  case 1:
+    return "D Director " + std::to_string(index) + ", Drama " +
+           std::to_string(index) + ",";
+  default:
+    return "C " + std::to_string(index % 12 + 1) + " " +
+           std::to_string(year) + " Actor " + std::to_string(index);
+  }
+}
+
+// Returns the catalog line of a title in data4movies.txt format.
+std::string WorkloadGenerator::movieLine(int index, int stock) {
+  std::string id = std::to_string(index);
+  std::string year = std::to_string(1930 + index % 90);
+  std::string count = std::to_string(stock);
+  switch (index % 3) {
+  case 0:
+    return "F, " + count + ", Director " + id + ", Comedy " + id + ", " + year;
+  case 1:
+    return "D, " + count + ", Director " + id + ", Drama " + id + ", " + year;
+  default:
+    return "C, " + count + ", Director " + id + ", Classic " + id +
+           ", Actor " + id + " " + std::to_string(index % 12 + 1) + " " +
+           year;
+  }
+}
+
+// Writes the generated catalog.
+bool WorkloadGenerator::writeMovies(const std::string &filename,
+                                    int stock) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+  for (int i = 0; i < titles; i++) {
+    file << movieLine(i, stock) << '\n';
+  }
+  return true;
+}
+
+// Writes the generated customers.
+bool WorkloadGenerator::writeCustomers(const std::string &filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+  for (int i = 0; i < customers; i++) {
+    file << customerId(i) << " Last" << i << " First" << i << '\n';
+  }
+  return true;
+}
+
+// Generates a command stream. Returns only name titles the customer
+// currently holds, so the stream replays without invalid returns.
+std::vector<std::string> WorkloadGenerator::commands(int count,
+                                                     const Mix &mix) {
+  buildDistribution(mix.skew);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::uniform_int_distribution<int> anyCustomer(0, customers - 1);
+  std::vector<std::vector<int>> holding(customers);
+
+  std::vector<std::string> lines;
+  lines.reserve(count);
+  for (int i = 0; i < count; i++) {
+    int customer = anyCustomer(rng);
+    std::string id = std::to_string(customerId(customer));
+    double roll = coin(rng);
+
+    if (roll < mix.garbage) {
+      switch (i % 4) {
+      case 0:
+        lines.push_back("Q " + id + " D " + movieCriteria(pickTitle()));
+        break;
+      case 1:
+        lines.push_back("B 9" + id + " D " + movieCriteria(pickTitle()));
+        break;
+      case 2:
+        lines.push_back("B " + id + " X " + movieCriteria(pickTitle()));
+        break;
+      default:
+        lines.push_back("B " + id + " D F No Such Title " + id + ", 1900");
+        break;
+      }
+      continue;
+    }
+    roll -= mix.garbage;
+    if (roll < mix.inventories) {
+      lines.emplace_back("I");
+      continue;
+    }
+    roll -= mix.inventories;
+    if (roll < mix.histories) {
+      lines.push_back("H " + id);
+      continue;
+    }
+    roll -= mix.histories;
+
+    std::vector<int> &held = holding[customer];
+    if (roll < mix.returns && !held.empty()) {
+      std::uniform_int_distribution<size_t> anyHeld(0, held.size() - 1);
+      size_t pick = anyHeld(rng);
+      int title = held[pick];
+      held[pick] = held.back();
+      held.pop_back();
+      lines.push_back("R " + id + " D " + movieCriteria(title));
+      continue;
+    }
+
+    int title = pickTitle();
+    held.push_back(title);
+    lines.push_back("B " + id + " D " + movieCriteria(title));
+  }
+  return lines;
+}
+
+// Generates a command stream and writes it to a file.
+bool WorkloadGenerator::writeCommands(const std::string &filename, int count,
+                                      const Mix &mix) {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    std::cerr << "Error: Cannot open " << filename << std::endl;
+    return false;
+  }
+  for (const auto &line : commands(count, mix)) {
+    file << line << '\n';
+  }
+  return true;
+}
+
+// Draws a title by binary searching the cumulative distribution.
+int WorkloadGenerator::pickTitle() {
+  std::uniform_real_distribution<double> unit(0.0, cumulative.back());
+  auto it = std::lower_bound(cumulative.begin(), cumulative.end(), unit(rng));
+  return static_cast<int>(std::min<std::ptrdiff_t>(it - cumulative.begin(),
+                                                   titles - 1));
+}
+
+// Builds the cumulative Zipf weights 1 / rank^skew.
+void WorkloadGenerator::buildDistribution(double skew) {
+  if (skew == builtSkew) {
+    return;
+  }
+  builtSkew = skew;
+  cumulative.resize(titles);
+  double sum = 0.0;
+  for (int i = 0; i < titles; i++) {
+    sum += 1.0 / std::pow(i + 1, skew);
+    cumulative[i] = sum;
+  }
+}
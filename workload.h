@@ -0,0 +1,62 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Generates synthetic catalogs, customer lists and command streams in the
+// data4*.txt formats for benchmarks and load tests. Title popularity
+// follows a Zipf distribution so a few titles receive most of the traffic.
+class WorkloadGenerator {
+public:
+  // Shape of a generated command stream.
+  struct Mix {
+    // Fraction of commands that return a copy the customer holds.
+    double returns = 0.45;
+    // Fraction of commands that display a customer's history.
+    double histories = 0.02;
+    // Fraction of commands that display the full inventory.
+    double inventories = 0.0;
+    // Fraction of lines that are malformed or rejected: unknown command
+    // types, unknown customers, bad media types and unknown titles.
+    double garbage = 0.0;
+    // Zipf exponent of title popularity; 0 is uniform.
+    double skew = 1.0;
+  };
+
+  // Constructs a generator for a catalog and customer base of the given
+  // sizes. The same seed always produces the same data.
+  WorkloadGenerator(int titles, int customers, unsigned seed = 42);
+
+  // Writes the catalog in data4movies.txt format.
+  bool writeMovies(const std::string &filename, int stock) const;
+  // Writes the customers in data4customers.txt format.
+  bool writeCustomers(const std::string &filename) const;
+  // Generates command lines in data4commands.txt format.
+  std::vector<std::string> commands(int count, const Mix &mix);
+  // Generates command lines and writes them to a file.
+  bool writeCommands(const std::string &filename, int count, const Mix &mix);
+
+  // Returns the id of the i-th generated customer.
+  static int customerId(int index) { return 10000 + index; }
+  // Returns the search text a command uses to name the i-th title,
+  // prefixed by its genre, e.g. "F Title 7, 1990".
+  static std::string movieCriteria(int index);
+  // Returns the catalog line of the i-th title.
+  static std::string movieLine(int index, int stock);
+
+private:
+  int titles;
+  int customers;
+  std::mt19937 rng;
+  std::vector<double> cumulative;
+
+  // Draws a title index from the Zipf distribution.
+  int pickTitle();
+  // Rebuilds the popularity distribution for a skew exponent.
+  void buildDistribution(double skew);
+  double builtSkew = -1.0;
+};
+
+#endif // WORKLOAD_H